@@ -0,0 +1,79 @@
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "../utils/zipf_generator.h"
+#include "../utils/partitioned_writer.h"
+
+using namespace std;
+
+// Generates R and S in a single pass, already row-numbered and split into
+// n_servers partitions. Produces the same files as the former pipeline
+// gen_zipf -> add_row_numbers -> split_file and gen_R -> add_row_numbers -> split_file:
+//   R_<n_unique>/<i>_R_<n_unique>.txt
+//   S_zipf_<seed>_<alpha>_<n_unique>_<n_rows>/<i>_S_zipf_<seed>_<alpha>_<n_unique>_<n_rows>.txt
+int main(int argc, char* argv[]) {
+
+    // Check if the correct number of arguments are provided
+    if (argc < 6 || argc > 8) {
+        cerr << "Error: Incorrect number of arguments.\n";
+        cerr << "Usage: " << argv[0] << " <seed> <alpha> <n_unique> <n_rows> <n_servers> [txt|bin] [n_threads]\n";
+        return 1;
+    }
+
+    try {
+        // Parse command-line arguments
+        long long seed = stoll(argv[1]);
+        double alpha = stod(argv[2]);
+        string alpha_str = argv[2];
+        replace(alpha_str.begin(), alpha_str.end(), '.', 'p');
+        uint64_t n_unique = stoull(argv[3]);
+        uint64_t n_rows = stoull(argv[4]);
+        int n_servers = stoi(argv[5]);
+        string format = argc > 6 ? argv[6] : "txt";
+        unsigned n_threads = argc > 7 ? stoul(argv[7]) : max(1u, thread::hardware_concurrency());
+
+        if (seed <= 0) {
+            cerr << "Random number seed must be greater than 0.\n";
+            return 1;
+        }
+        if (n_unique == 0 || n_unique > UINT32_MAX) {
+            cerr << "n_unique must be in the range [1, " << UINT32_MAX << "].\n";
+            return 1;
+        }
+        if (n_servers <= 0) {
+            cerr << "Number of servers must be greater than 0.\n";
+            return 1;
+        }
+        if (format != "txt" && format != "bin") {
+            cerr << "Output format must be txt or bin.\n";
+            return 1;
+        }
+        bool binary = format == "bin";
+
+        string r_dir = "R_" + string(argv[3]);
+        string s_dir = "S_zipf_" + string(argv[1]) + '_' + alpha_str + '_' + argv[3] + '_' + argv[4];
+
+        auto start = chrono::high_resolution_clock::now();
+
+        // R holds every key 1..n_unique exactly once
+        partitioned_writer::write_partitioned(r_dir, n_unique, n_servers, binary, n_threads,
+                                              [](uint64_t i) { return static_cast<uint32_t>(i + 1); });
+
+        // S holds n_rows Zipf distributed keys, same stream as gen_zipf with the same seed
+        ZipfGenerator zipf(seed, alpha, n_unique);
+        partitioned_writer::write_partitioned(s_dir, n_rows, n_servers, binary, n_threads, zipf);
+
+        auto end = chrono::high_resolution_clock::now();
+        auto duration = chrono::duration_cast<chrono::milliseconds>(end - start).count();
+
+        cout << "R written to " << r_dir << ", S written to " << s_dir << " (" << n_servers << " partitions)\n";
+        cout << "Runtime: " << duration << " ms" << endl;
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <map>
+#include "../utils/skew_generator.h"
+#include "../utils/partitioned_writer.h"
+
+using namespace std;
+
+void print_usage(const char* program) {
+    cerr << "Usage: " << program << " <zipf|hot> <seed> <n_unique> <n_rows> <n_servers> [key=value ...]\n"
+         << "Options (defaults for zipf / hot):\n"
+         << "  alpha=<double>          Zipf exponent of the background, 0 is uniform (1.0 / 0.0)\n"
+         << "  hot_keys=<int>          Number of hot keys (0 / 8)\n"
+         << "  hot_fraction=<double>   Fraction of S rows on hot keys (0.0 / 0.5)\n"
+         << "  placement=<random|late|clustered>  Position of hot rows in the input order (random)\n"
+         << "  late_window=<double>    Trailing fraction of S holding hot rows for placement=late (0.25)\n"
+         << "  keys=<first|spread|collide>  Hot keys 1..h, random keys, or keys that all go to server 0 (first)\n"
+         << "  partition=<modulo|multiplicative|crc32|radix>  Partition function of the join for keys=collide (modulo)\n"
+         << "  r_dup=<int>             Copies of each hot key in R, > 1 gives correlated skew (1)\n"
+         << "  format=<txt|bin>        Output format (txt)\n"
+         << "  threads=<int>           Writer threads (hardware concurrency)\n";
+}
+
+// Replaces '.' by 'p' to build file names, as gen_zipf does
+string file_str(string value) {
+    replace(value.begin(), value.end(), '.', 'p');
+    return value;
+}
+
+// Generates skewed R and S tables, row-numbered and split into n_servers partitions.
+// Output folders (partition files named <i>_<folder>.<txt|bin>):
+//   S_<distribution>_<seed>_<alpha>_<hot_keys>_<hot_fraction>_<placement>_<keys>_<n_unique>_<n_rows>
+//   R_<n_unique>, or R_<...same tag as S...>_dup<r_dup> with correlated skew
+// <keys> is collide-<partition> for colliding keys of another partition function than modulo.
+int main(int argc, char* argv[]) {
+    if (argc < 6) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        string distribution = argv[1];
+        if (distribution != "zipf" && distribution != "hot") {
+            print_usage(argv[0]);
+            return 1;
+        }
+        bool is_zipf = distribution == "zipf";
+
+        // Defaults depend on the distribution, key=value arguments override them
+        map<string, string> options = {
+            {"alpha", is_zipf ? "1.0" : "0.0"},
+            {"hot_keys", is_zipf ? "0" : "8"},
+            {"hot_fraction", is_zipf ? "0.0" : "0.5"},
+            {"placement", "random"},
+            {"late_window", "0.25"},
+            {"keys", "first"},
+            {"partition", "modulo"},
+            {"r_dup", "1"},
+            {"format", "txt"},
+            {"threads", to_string(max(1u, thread::hardware_concurrency()))}};
+        for (int i = 6; i < argc; ++i) {
+            string arg = argv[i];
+            size_t pos = arg.find('=');
+            if (pos == string::npos || options.find(arg.substr(0, pos)) == options.end()) {
+                cerr << "Unknown option: " << arg << "\n";
+                print_usage(argv[0]);
+                return 1;
+            }
+            options[arg.substr(0, pos)] = arg.substr(pos + 1);
+        }
+
+        skew_config config;
+        config.seed = stoull(argv[2]);
+        config.n_unique = stoull(argv[3]);
+        config.n_rows = stoull(argv[4]);
+        config.n_servers = stoi(argv[5]);
+        config.alpha = stod(options["alpha"]);
+        config.hot_keys = stoul(options["hot_keys"]);
+        config.hot_fraction = stod(options["hot_fraction"]);
+        config.late_window = stod(options["late_window"]);
+        config.r_dup = stoul(options["r_dup"]);
+
+        const map<string, skew_config::Placement> placements = {
+            {"random", skew_config::Random}, {"late", skew_config::Late}, {"clustered", skew_config::Clustered}};
+        const map<string, skew_config::KeyChoice> key_choices = {
+            {"first", skew_config::First}, {"spread", skew_config::Spread}, {"collide", skew_config::Collide}};
+        if (placements.find(options["placement"]) == placements.end() || key_choices.find(options["keys"]) == key_choices.end()) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        config.placement = placements.at(options["placement"]);
+        config.key_choice = key_choices.at(options["keys"]);
+        config.partition = PartitionFunction::parse(options["partition"]);
+
+        if (config.seed == 0 || config.n_unique == 0 || config.n_unique > UINT32_MAX || config.n_servers <= 0) {
+            cerr << "seed, n_unique and n_servers must be greater than 0, n_unique at most " << UINT32_MAX << ".\n";
+            return 1;
+        }
+        if (options["format"] != "txt" && options["format"] != "bin") {
+            cerr << "Output format must be txt or bin.\n";
+            return 1;
+        }
+        bool binary = options["format"] == "bin";
+        unsigned n_threads = stoul(options["threads"]);
+
+        SkewGenerator generator(config);
+
+        // Colliding keys depend on the partition function, named unless it is modulo
+        string keys = config.key_choice == skew_config::Collide && config.partition != PartitionFunction::Modulo
+                          ? options["keys"] + '-' + options["partition"] : options["keys"];
+        string tag = distribution + '_' + argv[2] + '_' + file_str(options["alpha"]) + '_' + options["hot_keys"] + '_' +
+                     file_str(options["hot_fraction"]) + '_' + options["placement"] + '_' + keys + '_' + argv[3] + '_' + argv[4];
+        string s_dir = "S_" + tag;
+        string r_dir = config.r_dup > 1 ? "R_" + tag + "_dup" + options["r_dup"] : "R_" + string(argv[3]);
+
+        auto start = chrono::high_resolution_clock::now();
+
+        partitioned_writer::write_partitioned(r_dir, generator.r_rows(), config.n_servers, binary, n_threads,
+                                              [&generator](uint64_t i) { return generator.r_value(i); });
+        partitioned_writer::write_partitioned(s_dir, config.n_rows, config.n_servers, binary, n_threads,
+                                              [&generator](uint64_t i) { return generator.s_value(i); });
+
+        auto end = chrono::high_resolution_clock::now();
+        auto duration = chrono::duration_cast<chrono::milliseconds>(end - start).count();
+
+        // Summary of the injected skew, including the target server of every hot key
+        PartitionFunction partition(config.partition, config.n_servers);
+        cout << "R written to " << r_dir << " (" << generator.r_rows() << " rows), S written to " << s_dir << "\n";
+        if (config.hot_keys > 0) {
+            cout << "Hot keys (" << config.hot_fraction * 100 << "% of S, placement " << options["placement"] << "):\n";
+            for (uint32_t key : generator.hot_key_values()) {
+                cout << "Key: " << key << ", Server: " << partition(key) << "\n";
+            }
+        }
+        cout << "Runtime: " << duration << " ms" << endl;
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,92 +1,64 @@
-//==================================================== file = genzipf.c =====
+//==================================================== file = gen_zipf.cpp ==
 //=  Program to generate Zipf (power law) distributed random variables      =
 //===========================================================================
-//=  Notes: 1) Writes to a user specified output file                       =
+//=  Notes: 1) Writes to an output file named after the arguments           =
 //=         2) Generates user specified number of values                    =
-//=         3) Run times is same as an empirical distribution generator     =
-//=         4) Implements p(i) = C/i^alpha for i = 1 to N where C is the    =
+//=         3) Implements p(i) = C/i^alpha for i = 1 to N where C is the    =
 //=            normalization constant (i.e., sum of p(i) = 1).              =
+//=         4) Uses rejection-inversion sampling (O(1) expected cost per    =
+//=            value, no CDF table) and the counter-based Philox RNG, so    =
+//=            the output only depends on the seed, not on <n_threads>.     =
+//=         5) Values are generated in chunks by <n_threads> threads and    =
+//=            written in order with large block writes.                    =
 //=-------------------------------------------------------------------------=
-//= Example user input:                                                     =
-//=                                                                         =
-//=   ---------------------------------------- genzipf.c -----              =
-//=   -     Program to generate Zipf random variables        -              =
-//=   --------------------------------------------------------              =
-//=   Output file name ===================================> output.dat      =
-//=   Random number seed =================================> 1               =
-//=   Alpha vlaue ========================================> 1.0             =
-//=   N value ============================================> 1000            =
-//=   Number of values to generate =======================> 5               =
-//=   --------------------------------------------------------              =
-//=   -  Generating samples to file                          -              =
-//=   --------------------------------------------------------              =
-//=   --------------------------------------------------------              =
-//=   -  Done!                                                              =
-//=   --------------------------------------------------------              =
+//=  Output formats:                                                        =
+//=    txt: one value per line ("zipf_<seed>_<alpha>_<N>_<n>.txt")          =
+//=    bin: raw little-endian uint32_t values ("zipf_..._<n>.bin")          =
 //=-------------------------------------------------------------------------=
-//= Example output file ("output.dat" for above):                           =
-//=                                                                         =
-//=   1                                                                     =
-//=   1                                                                     =
-//=   161                                                                   =
-//=   17                                                                    =
-//=   30                                                                    =
+//=  Build: g++ -std=c++20 -O3 gen_zipf.cpp -o gen_zipf -pthread            =
 //=-------------------------------------------------------------------------=
-//=  Build: bcc32 genzipf.c                                                 =
+//=  Execute: gen_zipf <seed> <alpha> <N> <num_values> [n_threads] [txt|bin]=
 //=-------------------------------------------------------------------------=
-//=  Execute: genzipf                                                       =
-//=-------------------------------------------------------------------------=
-//=  Author: Kenneth J. Christensen                                         =
-//=          University of South Florida                                    =
-//=          WWW: http://www.csee.usf.edu/~christen                         =
-//=          Email: christen@csee.usf.edu                                   =
-//=-------------------------------------------------------------------------=
-//=  History: KJC (11/16/03) - Genesis (from genexp.c)                      =
+//=  History: Based on genzipf.c by Kenneth J. Christensen (USF, 11/16/03)  =
 //===========================================================================
 //----- Include files -------------------------------------------------------
-#include <assert.h>             // Needed for assert() macro
-#include <stdio.h>              // Needed for printf()
-#include <stdlib.h>             // Needed for exit() and ato*()
-#include <math.h>               // Needed for pow()
 #include <string>
 #include <fstream>
 #include <iostream>
 #include <chrono>
+#include <thread>
+#include <vector>
+#include <charconv>
+#include <algorithm>
+#include "../utils/zipf_generator.h"
+
+using namespace std;
 
 //----- Constants -----------------------------------------------------------
-#define  FALSE          0       // Boolean false
-#define  TRUE           1       // Boolean true
+const uint64_t CHUNK_SIZE = 1 << 20;    // Values generated per thread and round
+const size_t MAX_CHARS_PER_VALUE = 11;  // 10 digits of uint32_t and a newline
 
 //----- Function prototypes -------------------------------------------------
-int      zipf(double alpha, int n);  // Returns a Zipf random variable
-int      zipf_bs(double alpha, int n);  // Optimized
-double   rand_val(int seed);         // Jain's RNG
-
-using namespace std;
+void fill_chunk(const ZipfGenerator& zipf, uint64_t begin, uint64_t end, bool binary, string& out);
 
 //===== Main program ========================================================
 int main(int argc, char* argv[]) {
-    ofstream fp;
-    string file_name;
-    int seed, n, num_values, zipf_rv;
-    double alpha;
-
     // Output banner
     cout << "---------------------------------------- gen_zipf.cpp ----- \n";
     cout << "-     Program to generate Zipf random variables        - \n";
     cout << "-------------------------------------------------------- \n";
 
     // Check if the correct number of arguments are provided
-    if (argc != 5) {
+    if (argc < 5 || argc > 7) {
         cerr << "Error: Incorrect number of arguments.\n";
-        cerr << "Usage: " << argv[0] << " <seed> <alpha> <N> <num_values>\n";
+        cerr << "Usage: " << argv[0] << " <seed> <alpha> <N> <num_values> [n_threads] [txt|bin]\n";
         return 1;
     }
 
     // Parse command-line arguments
-    seed = stoi(argv[1]);
+    long long seed = stoll(argv[1]);
     string seed_str = argv[1];
-    alpha = stod(argv[2]);
+    double alpha = stod(argv[2]);
     string alpha_str = argv[2];
 
     size_t pos = alpha_str.find('.');
@@ -94,28 +66,44 @@ int main(int argc, char* argv[]) {
         alpha_str.replace(pos, 1, "p");
     }
 
-    n = stoi(argv[3]);
+    uint64_t n = stoull(argv[3]);
     string n_str = argv[3];
 
-    num_values = stoi(argv[4]);
+    uint64_t num_values = stoull(argv[4]);
     string num_values_str = argv[4];
 
-    file_name = "zipf_" + seed_str + '_' + alpha_str + '_' + n_str + '_' + num_values_str + ".txt";
-
-    // Create/open the output file
-    fp.open(file_name);
-    if (!fp.is_open()) {
-        cerr << "ERROR in creating output file (" << file_name << ") \n";
+    unsigned n_threads = argc > 5 ? stoul(argv[5]) : max(1u, thread::hardware_concurrency());
+    string format = argc > 6 ? argv[6] : "txt";
+    if (n_threads == 0) {
+        cerr << "Number of threads must be greater than 0.\n";
+        return 1;
+    }
+    if (format != "txt" && format != "bin") {
+        cerr << "Output format must be txt or bin.\n";
         return 1;
     }
+    bool binary = format == "bin";
 
     // Use the random number seed
     if (seed <= 0) {
         cerr << "Random number seed must be greater than 0.\n";
-        fp.close();
         return 1;
     }
-    rand_val(seed);
+    if (n == 0 || n > UINT32_MAX) {
+        cerr << "N must be in the range [1, " << UINT32_MAX << "].\n";
+        return 1;
+    }
+
+    string file_name = "zipf_" + seed_str + '_' + alpha_str + '_' + n_str + '_' + num_values_str + '.' + format;
+
+    // Create/open the output file
+    ofstream fp(file_name, ios::binary);
+    if (!fp.is_open()) {
+        cerr << "ERROR in creating output file (" << file_name << ") \n";
+        return 1;
+    }
+
+    ZipfGenerator zipf(seed, alpha, n);
 
     // Output "generating" message
     cout << "-------------------------------------------------------- \n";
@@ -123,159 +111,60 @@ int main(int argc, char* argv[]) {
     cout << "-------------------------------------------------------- \n";
 
     auto start = chrono::high_resolution_clock::now();
-    // Generate and output Zipf random variables
-    for (int i = 0; i < num_values; i++) {
-        zipf_rv = zipf_bs(alpha, n);
-        fp << zipf_rv << "\n";
+    // Generate Zipf random variables chunk by chunk; every thread fills its own buffer
+    // and the buffers are written in chunk order, so the file is independent of n_threads
+    vector<string> buffers(n_threads);
+    for (uint64_t round_begin = 0; round_begin < num_values; round_begin += CHUNK_SIZE * n_threads) {
+        vector<thread> workers;
+        for (unsigned t = 0; t < n_threads; t++) {
+            uint64_t begin = min(num_values, round_begin + t * CHUNK_SIZE);
+            uint64_t end = min(num_values, begin + CHUNK_SIZE);
+            workers.emplace_back(fill_chunk, cref(zipf), begin, end, binary, ref(buffers[t]));
+        }
+        for (unsigned t = 0; t < n_threads; t++) {
+            workers[t].join();
+            fp.write(buffers[t].data(), buffers[t].size());
+        }
+    }
+    fp.close();
+    if (!fp) {
+        cerr << "ERROR in writing output file (" << file_name << ") \n";
+        return 1;
     }
     auto end = chrono::high_resolution_clock::now();
 
     auto duration = chrono::duration_cast<chrono::milliseconds>(end - start).count();
     cout << "Runtime: " << duration << " ms" << endl;
 
-    // Output "done" message and close the output file
+    // Output "done" message
     cout << "-------------------------------------------------------- \n";
     cout << "-  Done! \n";
     cout << "-------------------------------------------------------- \n";
-    fp.close();
 
     return 0;
 }
 
 //===========================================================================
-//=  Function to generate Zipf (power law) distributed random variables     =
-//=    - Input: alpha and N                                                 =
-//=    - Output: Returns with Zipf distributed random variable              =
+//=  Function to generate the values [begin, end) of the Zipf stream        =
+//=    - Input: generator, index range and output format                    =
+//=    - Output: Formatted values stored in out                             =
 //===========================================================================
-int zipf(double alpha, int n)
-{
-  static int first = TRUE;      // Static first time flag
-  static double c = 0;          // Normalization constant
-  double z;                     // Uniform random number (0 < z < 1)
-  double sum_prob;              // Sum of probabilities
-  double zipf_value;            // Computed exponential value to be returned
-  int    i;                     // Loop counter
-
-  // Compute normalization constant on first call only
-  if (first == TRUE)
-  {
-    for (i=1; i<=n; i++)
-      c = c + (1.0 / pow((double) i, alpha));
-    c = 1.0 / c;
-    first = FALSE;
-  }
-
-  // Pull a uniform random number (0 < z < 1)
-  do
-  {
-    z = rand_val(0);
-  }
-  while ((z == 0) || (z == 1));
-
-  // Map z to the value
-  sum_prob = 0;
-  for (i=1; i<=n; i++)
-  {
-    sum_prob = sum_prob + c / pow((double) i, alpha);
-    if (sum_prob >= z)
-    {
-      zipf_value = i;
-      break;
-    }
-  }
-
-  // Assert that zipf_value is between 1 and N
-  assert((zipf_value >=1) && (zipf_value <= n));
-
-  return(zipf_value);
-}
-
-int zipf_bs(double alpha, int n)
+void fill_chunk(const ZipfGenerator& zipf, uint64_t begin, uint64_t end, bool binary, string& out)
 {
-  static int first = TRUE;      // Static first time flag
-  static double c = 0;          // Normalization constant
-  static double *sum_probs;     // Pre-calculated sum of probabilities
-  double z;                     // Uniform random number (0 < z < 1)
-  int zipf_value;               // Computed exponential value to be returned
-  int    i;                     // Loop counter
-  int low, high, mid;           // Binary-search bounds
-
-  // Compute normalization constant on first call only
-  if (first == TRUE)
-  {
-    for (i=1; i<=n; i++)
-      c = c + (1.0 / pow((double) i, alpha));
-    c = 1.0 / c;
-
-    sum_probs = (double*) malloc((n+1)*sizeof(*sum_probs));
-    sum_probs[0] = 0;
-    for (i=1; i<=n; i++) {
-      sum_probs[i] = sum_probs[i-1] + c / pow((double) i, alpha);
-    }
-    first = FALSE;
+  if (binary) {
+    out.resize((end - begin) * sizeof(uint32_t));
+    uint32_t* values = reinterpret_cast<uint32_t*>(out.data());
+    for (uint64_t i = begin; i < end; i++)
+      values[i - begin] = zipf(i);
+    return;
   }
 
-  // Pull a uniform random number (0 < z < 1)
-  do
-  {
-    z = rand_val(0);
+  out.resize((end - begin) * MAX_CHARS_PER_VALUE);
+  char* cursor = out.data();
+  char* last = out.data() + out.size();
+  for (uint64_t i = begin; i < end; i++) {
+    cursor = to_chars(cursor, last, zipf(i)).ptr;
+    *cursor++ = '\n';
   }
-  while ((z == 0) || (z == 1));
-
-  // Map z to the value
-  low = 1, high = n, mid;
-  do {
-    mid = floor((low+high)/2);
-    if (sum_probs[mid] >= z && sum_probs[mid-1] < z) {
-      zipf_value = mid;
-      break;
-    } else if (sum_probs[mid] >= z) {
-      high = mid-1;
-    } else {
-      low = mid+1;
-    }
-  } while (low <= high);
-
-  // Assert that zipf_value is between 1 and N
-  assert((zipf_value >=1) && (zipf_value <= n));
-
-  return(zipf_value);
+  out.resize(cursor - out.data());
 }
-
-//=========================================================================
-//= Multiplicative LCG for generating uniform(0.0, 1.0) random numbers    =
-//=   - x_n = 7^5*x_(n-1)mod(2^31 - 1)                                    =
-//=   - With x seeded to 1 the 10000th x value should be 1043618065       =
-//=   - From R. Jain, "The Art of Computer Systems Performance Analysis," =
-//=     John Wiley & Sons, 1991. (Page 443, Figure 26.2)                  =
-//=========================================================================
-double rand_val(int seed)
-{
-  const long  a =      16807;  // Multiplier
-  const long  m = 2147483647;  // Modulus
-  const long  q =     127773;  // m div a
-  const long  r =       2836;  // m mod a
-  static long x;               // Random int value
-  long        x_div_q;         // x divided by q
-  long        x_mod_q;         // x modulo q
-  long        x_new;           // New x value
-
-  // Set the seed if argument is non-zero and then return zero
-  if (seed > 0)
-  {
-    x = seed;
-    return(0.0);
-  }
-
-  // RNG using integer arithmetic
-  x_div_q = x / q;
-  x_mod_q = x % q;
-  x_new = (a * x_mod_q) - (r * x_div_q);
-  if (x_new > 0)
-    x = x_new;
-  else
-    x = x_new + m;
-
-  // Return a random value between 0.0 and 1.0
-  return((double) x / m);
-}
\ No newline at end of file
@@ -2,313 +2,494 @@
 #include <thread>
 #include <string>
 #include <vector>
-#include <zmq.hpp>
 #include <algorithm>
 #include <tuple>
-#include <mutex>
-#include <barrier>
 #include <unordered_map>
 #include <atomic>
+#include <memory>
+#include <chrono>
+#include <numeric>
 #include "./utils/helper_functions.h"
 #include "./utils/SpaceSaving.h"
-
-// Function to allocate memory for tuples_data
+#include "./utils/result_writer.h"
+#include "./utils/partition_function.h"
+#include "./utils/skew_planner.h"
+#include "./utils/pipelined_join.h"
+#include "./utils/transport.h"
+#include "./utils/batch_protocol.h"
+#include "./utils/receive_engine.h"
+#include "./utils/coordinator.h"
+#include "./utils/traffic_matrix.h"
+#include "./utils/async_loader.h"
+#include "./utils/trace.h"
+
+// Function to allocate memory for tuples_data (uninitialized, pre-faulted)
 void allocate_mem(tuples_data& data, size_t size) {
     data.tuples.resize(size);
     data.filled_rows = 0;
 }
 
-int copy_local_data_to_s_receive_buffers(
-        int my_id,
-        const tuples_data& s_data_send,
-        std::vector<tuples_data>& s_data_receive,
-        const std::unordered_map<int, float>& heavy_hitters) {
-
-    int n_tuples_copied = 0;
-
-    // Copy/send only, if it is not a heavy hitter
-    for(const auto& t : s_data_send.tuples) {
-        // Check if the tuple is not a heavy hitter
-        if (heavy_hitters.find(t.join_val) == heavy_hitters.end()) {
-            // Copy to the receive buffer corresponding to the target row
-            s_data_receive[t.row_S - 1].tuples[s_data_receive[t.row_S - 1].filled_rows] = t;
-            s_data_receive[t.row_S - 1].filled_rows++;
-            if((t.row_S - 1) != my_id){ // Only count if not sent/copied to other servers
-                n_tuples_copied++;
-            }
-        }
-        // if it is a heavy hitter, it stays on this server
-        else {
-            s_data_receive[my_id].tuples[s_data_receive[my_id].filled_rows] = t;
-            s_data_receive[my_id].filled_rows++;
-        }
-    }
-
-    return n_tuples_copied;
-}
-
-int copy_local_data_to_r_receive_buffers(
-        int my_id,
-        const tuples_data& r_data_send,
-        std::vector<tuples_data>& r_data_receive,
-        const std::unordered_map<int, float>& heavy_hitters) {
-
-    int n_tuples_copied = 0;
-
-    for (const auto& t : r_data_send.tuples) {
-        // Check if the tuple is a heavy hitter
-        if (heavy_hitters.find(t.join_val) != heavy_hitters.end()) {
-            // If it's a heavy hitter, copy to all other servers
-            for (int i = 0; i < r_data_receive.size(); ++i) {
-                    r_data_receive[i].tuples[r_data_receive[i].filled_rows] = t;
-                    r_data_receive[i].filled_rows++;
-                // Count only when actually sent
-                if (i != my_id) {
-                    n_tuples_copied++;
-                }
-            }
-        // Otherwise, copy to the corresponding server
-        } else {
-            r_data_receive[t.row_S - 1].tuples[r_data_receive[t.row_S - 1].filled_rows] = t;
-            r_data_receive[t.row_S - 1].filled_rows++;
-            n_tuples_copied++;
-        }
-    }
-
-    return n_tuples_copied;
-}
-
-void node_thread(int id, int n_servers, const std::vector<std::string>& r_files, const std::vector<std::string>& s_files, const std::string& r_folder, const std::string& s_folder,
-                 tuples_data& r_data_receive_total, tuples_data& s_data_receive_total, std::mutex& r_mutex, std::mutex& s_mutex, std::barrier<>& sync_point, std::atomic<bool>& done) {
+// Runs node id. All nodes synchronize and exchange samples and counts through the coordinator.
+// Every node joins the tuples it received into join_result, while receiving if pipeline is given,
+// otherwise as soon as its own shuffle is complete. statistics and traffic_links, if given,
+// receive the statistics and traffic of all nodes at the end.
+void node_thread(int id, int n_servers, Coordinator& coordinator, TransportFactory& transports, const PartitionFunction& partition, const std::string& r_path, const std::string& s_path,
+                 std::vector<joined_row>& join_result, PipelinedJoin* pipeline, size_t batch_tuples, const batch_protocol::flow_control_options& flow_options, const loader_options& load_options,
+                 std::vector<node_statistics>* statistics,
+                 std::vector<std::vector<link_traffic>>* traffic_links) {
     try {
-        zmq::context_t context(1);
-        zmq::socket_t receiver(context, zmq::socket_type::pull);
-        receiver.bind("tcp://*:" + std::to_string(5550 + id));
-
-        std::unordered_map<int, zmq::socket_t> senders;
-        for (int i = 0; i < n_servers; ++i) {
-            if (i != id) {
-                zmq::socket_t sender(context, zmq::socket_type::push);
-                sender.connect("tcp://localhost:" + std::to_string(5550 + i));
-                senders[i] = std::move(sender);
-            }
-        }
-
-        // Read local files
-        auto r_data_send_tmp = read_data(r_folder + '/' + r_files[id]);
-        auto s_data_send_tmp = read_data(s_folder + '/' + s_files[id]);
+        // Bound here, connected to the other nodes once all of them are bound
+        TRACE_THREAD_NAME("node " + std::to_string(id));
+        auto transport = transports.create(id);
+
+        TRACE_PHASES("load");
+
+        // Read local files, both through one ring of the loader
+        auto load_start = std::chrono::high_resolution_clock::now();
+        load_statistics loaded;
+        auto local_data = load_partitions({r_path, s_path}, load_options, &loaded);
+        auto r_data_send_tmp = std::move(local_data[0]);
+        auto s_data_send_tmp = std::move(local_data[1]);
+        std::chrono::duration<double> load_elapsed = std::chrono::high_resolution_clock::now() - load_start;
+        std::cout << "Node " << id << " loaded " << loaded.bytes << " bytes of binary partitions in " << load_elapsed.count() << " seconds ("
+                  << (loaded.uring ? "io_uring" : "pread") << ", " << loaded.direct_files << " files with O_DIRECT)." << std::endl;
 
         // Prepare data for sending
-        tuples_data r_data_send = {r_data_send_tmp, static_cast<int>(r_data_send_tmp.size())};
-        tuples_data s_data_send = {s_data_send_tmp, static_cast<int>(s_data_send_tmp.size())};
+        tuples_data r_data_send = {std::move(r_data_send_tmp), 0};
+        r_data_send.filled_rows = r_data_send.tuples.size();
+        tuples_data s_data_send = {std::move(s_data_send_tmp), 0};
+        s_data_send.filled_rows = s_data_send.tuples.size();
+
+        // Sample 1% of s_data_send to estimate heavy hitters
+        TRACE_NEXT_PHASE("sample");
+        std::vector<int> sample;
+        for (size_t j = 0; j < s_data_send.tuples.size(); j += 100) {
+            sample.push_back(s_data_send.tuples[j].join_val);
+        }
 
-        // Sample 1% of s_data_send_tmp to estimate heavy hitters
+        // Sample exchange: every node detects heavy hitters on the samples of all nodes, so that all
+        // nodes agree on them (an S tuple kept local must meet its broadcast R tuple)
+        TRACE_NEXT_PHASE("exchange samples");
+        auto samples = coordinator.all_gather_values(id, sample);
+        transport->connect();
+        TRACE_NEXT_PHASE("detect heavy hitters");
         std::vector<int> sample_stream;
-        for (size_t j = 0; j < s_data_send_tmp.size(); j += 100) {
-            sample_stream.push_back(s_data_send_tmp[j].join_val);
+        for (const auto& sample : samples) {
+            sample_stream.insert(sample_stream.end(), sample.begin(), sample.end());
         }
 
-        // Estimate heavy hitters using SpaceSaving algorithm
+        // Estimate heavy hitters using SpaceSaving algorithm, threshold and capacity derived as in flow_join_local
+        // (heavy hitters always keep S local and broadcast R here, nodes do not exchange R counts for the planner)
+        SkewPlanner planner(n_servers, SkewPlanner::parameters());
         SpaceSaving::DataStructure ds = SpaceSaving::HashTableOnly;
-        int k = 128;  // Capacity of the histogram for heavy hitter detection
+        int k = planner.capacity(sample_stream.size());  // Capacity of the histogram for heavy hitter detection
         SpaceSaving ss(k, ds);
-        
+
         ss.process(sample_stream);
 
-        float threshold = 0.01;  // Define a threshold
+        float threshold = planner.threshold(sample_stream.size());
         auto heavy_hitters = ss.get_heavy_hitters(threshold);
 
         // Print detected heavy hitters
-        std::cout << "Heavy Hitters:" << std::endl;
-        for (const auto& [element, frequency] : heavy_hitters) {
-            std::cout << "Element: " << element << ", Frequency: " << frequency * 100 << "%" << std::endl;
+        if (id == 0) {
+            std::cout << "Heavy Hitters:" << std::endl;
+            for (const auto& [element, frequency] : heavy_hitters) {
+                std::cout << "Element: " << element << ", Frequency: " << frequency * 100 << "%" << std::endl;
+            }
         }
 
-        // Process local data
-        calculate_receiver_and_store(s_data_send.tuples, n_servers);
-        calculate_receiver_and_store(r_data_send.tuples, n_servers);
+        // Count exchange: tuples for every destination, R in [0, n_servers), S in [n_servers, 2 n_servers).
+        // Heavy hitter R tuples go to every server, heavy hitter S tuples stay here.
+        TRACE_NEXT_PHASE("count destinations");
+        std::vector<size_t> destination_counts(2 * n_servers, 0);
+        for (const auto& t : r_data_send.tuples) {
+            if (heavy_hitters.find(t.join_val) != heavy_hitters.end()) {
+                for (int i = 0; i < n_servers; ++i) {
+                    destination_counts[i]++;
+                }
+            } else {
+                destination_counts[partition(t.join_val)]++;
+            }
+        }
+        for (const auto& t : s_data_send.tuples) {
+            bool heavy_hitter = heavy_hitters.find(t.join_val) != heavy_hitters.end();
+            destination_counts[n_servers + (heavy_hitter ? id : partition(t.join_val))]++;
+        }
+        TRACE_NEXT_PHASE("exchange counts");
+        auto counts = coordinator.all_gather_values(id, destination_counts);
+
+        // Receive buffers of this node, sized exactly; the pipelined join needs none
+        tuples_data r_data_receive = {{}, 0};
+        tuples_data s_data_receive = {{}, 0};
+        if (!pipeline) {
+            size_t n_r = 0, n_s = 0;
+            for (const auto& c : counts) {
+                n_r += c[id];
+                n_s += c[n_servers + id];
+            }
+            allocate_mem(r_data_receive, n_r);
+            allocate_mem(s_data_receive, n_s);
+        }
 
         // Synchronize before sending data
-        sync_point.arrive_and_wait();
-
-        // Send S data to other nodes
-        int num_s_tuples_sent = 0;
-        for (const auto& t : s_data_send.tuples) {
-            if (heavy_hitters.find(t.join_val) == heavy_hitters.end()) {
-                int target_server = t.row_S - 1;
-                if (target_server != id) {
-                    zmq::message_t message(sizeof(joined_row) + sizeof(char));
-                    char header = 'S';
-                    memcpy(message.data(), &header, sizeof(char));
-                    memcpy(static_cast<char*>(message.data()) + sizeof(char), &t, sizeof(joined_row));
-                    if (senders.find(target_server) != senders.end()) {
-                        senders[target_server].send(message, zmq::send_flags::none);
-                        num_s_tuples_sent++;
-                    } else {
-                        std::cerr << "Invalid target server: " << target_server << " in node " << id << std::endl;
-                    }
+        TRACE_NEXT_PHASE("barrier");
+        coordinator.barrier(id);
+        auto shuffle_start = std::chrono::high_resolution_clock::now();
+
+        // Hands received tuples to the pipelined join or appends them to the receive buffers
+        auto deliver = [&](char relation, const joined_row* rows, size_t n) {
+            if (pipeline) {
+                if (relation == 'R') {
+                    pipeline->add_r(rows, n);
+                } else {
+                    pipeline->add_s(rows, n);
                 }
             } else {
-                // Heavy hitter stays on this server
-                std::lock_guard<std::mutex> lock(s_mutex);
-                s_data_receive_total.tuples[s_data_receive_total.filled_rows++] = t;
+                append_batch(relation == 'R' ? r_data_receive : s_data_receive, rows, n);
+            }
+        };
+        auto finish_source = [&](char relation) {
+            if (pipeline) {
+                if (relation == 'R') {
+                    pipeline->finish_r_source();
+                } else {
+                    pipeline->finish_s_source();
+                }
             }
+        };
+
+        // Thread to handle receiving messages, started before sending so that no sender blocks on a full queue.
+        // Every message is a batch of one relation (utils/batch_protocol.h), appended as a whole.
+        // Credits bound the tuples in flight per destination (hwm=0: no flow control)
+        NodeTraffic traffic(id, n_servers);
+        std::unique_ptr<batch_protocol::FlowControl> flow;
+        if (flow_options.window_tuples > 0) {
+            flow = std::make_unique<batch_protocol::FlowControl>(*transport, id, n_servers, batch_tuples, flow_options, &traffic);
         }
+        ReceiveEngine receive_engine(*transport, n_servers, flow.get(), &traffic);
+        ReceiveThread receive_thread(receive_engine, [&receive_engine, &deliver, &finish_source, id]() {
+            TRACE_THREAD_NAME("node " + std::to_string(id) + " receive");
+            try {
+                receive_engine.run(deliver, finish_source);
+            } catch (const std::exception& e) {
+                std::cerr << "Receive thread error in node " << id << ": " << e.what() << std::endl;
+            }
+        });
 
-        // Send R data to other nodes
+        // Outgoing batches of every other node
+        std::unordered_map<int, batch_protocol::BatchSender> batches;
+        for (int i = 0; i < n_servers; ++i) {
+            if (i != id) {
+                batches.emplace(i, batch_protocol::BatchSender(*transport, i, id, batch_tuples, flow.get(), &traffic));
+            }
+        }
+        auto send_end_of_stream = [&](char relation) {
+            for (auto& [target_server, batch] : batches) {
+                batch.end_of_stream(relation);
+            }
+        };
+
+        // Send R data to other nodes first, so that the pipelined join can build while S is in flight
+        TRACE_NEXT_PHASE("send R");
         int num_r_tuples_sent = 0;
+        size_t n_r_broadcast = 0;
+        std::vector<joined_row> r_local;
         for (const auto& t : r_data_send.tuples) {
             if (heavy_hitters.find(t.join_val) != heavy_hitters.end()) {
-                for (int i = 0; i < n_servers; ++i) {
-                    if (i != id) {
-                        zmq::message_t message(sizeof(joined_row) + sizeof(char));
-                        char header = 'R';
-                        memcpy(message.data(), &header, sizeof(char));
-                        memcpy(static_cast<char*>(message.data()) + sizeof(char), &t, sizeof(joined_row));
-                        senders[i].send(message, zmq::send_flags::none);
-                        num_r_tuples_sent++;
-                    }
+                // Keep the local copy of the broadcast tuple
+                r_local.push_back(t);
+                n_r_broadcast++;
+                for (auto& [target_server, batch] : batches) {
+                    batch.add('R', t);
+                    num_r_tuples_sent++;
                 }
             } else {
-                int target_server = t.row_S - 1;
-                if (target_server != id) {
-                    zmq::message_t message(sizeof(joined_row) + sizeof(char));
-                    char header = 'R';
-                    memcpy(message.data(), &header, sizeof(char));
-                    memcpy(static_cast<char*>(message.data()) + sizeof(char), &t, sizeof(joined_row));
-                    if (senders.find(target_server) != senders.end()) {
-                        senders[target_server].send(message, zmq::send_flags::none);
-                        num_r_tuples_sent++;
-                    } else {
-                        std::cerr << "Invalid target server: " << target_server << " in node " << id << std::endl;
-                    }
+                int target_server = partition(t.join_val);
+                if (target_server == id) {
+                    // Tuple belongs to this server
+                    r_local.push_back(t);
+                } else {
+                    batches.at(target_server).add('R', t);
+                    num_r_tuples_sent++;
                 }
             }
         }
+        for (const auto& [target_server, batch] : batches) {
+            traffic.broadcast(target_server, 'R', n_r_broadcast);
+        }
+        traffic.kept('R', r_local.size());
+        deliver('R', r_local.data(), r_local.size());
+        send_end_of_stream('R');
+        finish_source('R');
 
-        std::cout << "Node " << id << " sent " << num_s_tuples_sent << " S tuples and " << num_r_tuples_sent << " R tuples." << std::endl;
-
-        // Thread to handle receiving messages
-        std::thread receive_thread([&receiver, &s_data_receive_total, &r_data_receive_total, &r_mutex, &s_mutex, id, &done]() {
-            try {
-                while (!done.load()) {
-                    zmq::message_t message;
-                    auto result = receiver.recv(message, zmq::recv_flags::dontwait);
-                    if (result) {
-                        char header = *static_cast<char*>(message.data());
-                        auto received_data = reinterpret_cast<joined_row*>(static_cast<char*>(message.data()) + sizeof(char));
-                        if (header == 'R') {
-                            std::lock_guard<std::mutex> lock(r_mutex);
-                            r_data_receive_total.tuples[r_data_receive_total.filled_rows++] = *received_data;
-                        } else if (header == 'S') {
-                            std::lock_guard<std::mutex> lock(s_mutex);
-                            s_data_receive_total.tuples[s_data_receive_total.filled_rows++] = *received_data;
-                        } else {
-                            std::cerr << "Invalid message header: " << header << " in node " << id << std::endl;
-                        }
-
-                        std::cout << "Node " << id << " received a tuple." << std::endl;
-                    } else {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(100));  // Sleep to avoid busy-waiting
-                    }
+        // Send S data to other nodes
+        TRACE_NEXT_PHASE("send S");
+        int num_s_tuples_sent = 0;
+        std::vector<joined_row> s_local;
+        for (const auto& t : s_data_send.tuples) {
+            if (heavy_hitters.find(t.join_val) == heavy_hitters.end()) {
+                int target_server = partition(t.join_val);
+                if (target_server == id) {
+                    // Tuple belongs to this server
+                    s_local.push_back(t);
+                } else {
+                    batches.at(target_server).add('S', t);
+                    num_s_tuples_sent++;
                 }
-            } catch (const zmq::error_t& e) {
-                std::cerr << "Receive thread error in node " << id << ": " << e.what() << std::endl;
+            } else {
+                // Heavy hitter stays on this server
+                s_local.push_back(t);
             }
-        });
+        }
+        traffic.kept('S', s_local.size());
+        deliver('S', s_local.data(), s_local.size());
+        send_end_of_stream('S');
+        finish_source('S');
+
+        size_t bytes_copied = 0, batches_queued = 0, batches_spilled = 0;
+        for (const auto& [target_server, batch] : batches) {
+            bytes_copied += batch.bytes_copied();
+            batches_queued += batch.batches_queued();
+            batches_spilled += batch.batches_spilled();
+        }
+        std::cout << "Node " << id << " sent " << num_s_tuples_sent << " S tuples and " << num_r_tuples_sent << " R tuples, "
+                  << bytes_copied << " bytes copied on the send path." << std::endl;
 
+        if (flow) {
+            std::cout << "Node " << id << " flow control: " << batches_queued << " batches waited for credits, " << batches_spilled << " spilled to disk, "
+                      << flow->credit_waits() << " waits, " << flow->credit_frames() << " credit frames sent." << std::endl;
+            flow->finish_sending();
+        }
+        TRACE_NEXT_PHASE("wait for receive");
         receive_thread.join();
-    } catch (const zmq::error_t& e) {
+        auto join_start = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> shuffle_elapsed = join_start - shuffle_start;
+        std::cout << "Node " << id << " received " << receive_engine.tuples_received() << " tuples in " << receive_engine.batches_received()
+                  << " batches (" << receive_engine.wakeups() << " wakeups)." << std::endl;
+
+        // Local join of this node, without waiting for the others
+        node_statistics mine = {shuffle_elapsed.count(), 0, static_cast<uint64_t>(num_r_tuples_sent + num_s_tuples_sent), 0, 0, 0, load_elapsed.count()};
+        if (pipeline) {
+            join_result.swap(pipeline->get_result());
+            mine.r_tuples = pipeline->r_tuples();
+            mine.s_tuples = pipeline->s_tuples();
+        } else {
+            TRACE_NEXT_PHASE("join");
+            join_result = inner_join(r_data_receive, s_data_receive);
+            std::chrono::duration<double> join_elapsed = std::chrono::high_resolution_clock::now() - join_start;
+            mine.join_seconds = join_elapsed.count();
+            mine.r_tuples = r_data_receive.filled_rows;
+            mine.s_tuples = s_data_receive.filled_rows;
+        }
+        mine.rows = join_result.size();
+
+        // Statistics of all nodes for the report of node 0
+        TRACE_NEXT_PHASE("exchange statistics");
+        auto all_statistics = coordinator.all_gather_value(id, mine);
+        auto all_links = coordinator.all_gather_values(id, traffic.links());
+        if (statistics) {
+            *statistics = all_statistics;
+            *traffic_links = all_links;
+        }
+    } catch (const std::exception& e) {
         std::cerr << "Error in node " << id << ": " << e.what() << std::endl;
+        coordinator.leave(id); // The other nodes stop instead of waiting for this one
     }
 }
 
 int main(int argc, char* argv[]) {
     try {
-        if (argc != 6) {
-            std::cerr << "Usage: ./server <n_servers> <num_r_tuples> <num_s_tuples> <R_folder> <S_folder>\n";
+        const char* usage = "Usage: ./flow_join_distributed <n_servers> <num_r_tuples> <num_s_tuples> <R_folder> <S_folder> [result_folder] [partition=modulo|multiplicative|crc32|radix] [pipeline=on|off] [batch=<tuples per message>] [transport=tcp|inproc|shm] [hwm=<tuples in flight per destination, 0: off>] [queue=<tuples>] [spill=<directory>] [traffic=<file prefix>] [io=uring|pread] [direct=on|off] [trace=<file>] [config=<cluster config> node=<id>]\n";
+        if (argc < 6 || argc > 20) {
+            std::cerr << usage;
             return 1;
         }
 
         int n_servers = std::stoi(argv[1]);
-        int num_r_tuples = std::stoi(argv[2]);
-        int num_s_tuples = std::stoi(argv[3]);
+        // <num_r_tuples> and <num_s_tuples> are not needed anymore, receive buffers are sized by the count exchange
         std::string r_folder = argv[4];
         std::string s_folder = argv[5];
+        std::string result_folder; // Join results are only kept if given
+        PartitionFunction::Method partitioning = PartitionFunction::Modulo;
+        bool pipelined = false; // Build and probe while the shuffle is in flight
+        size_t batch_tuples = batch_protocol::DEFAULT_BATCH_TUPLES; // 1 sends every tuple as its own message
+        batch_protocol::flow_control_options flow_options;
+        loader_options load_options; // Binary partitions are read through io_uring, buffered
+        std::string trace_file; // Chrome trace of all phases, if compiled with -DJOIN_TRACE; one file per process in cluster mode
+        std::string traffic_prefix; // Traffic matrix written to <prefix>.csv and <prefix>.json if given
+        Transport::Kind transport_kind = Transport::Tcp;
+        std::string config_file; // Cluster mode: this process runs node node_id only
+        int node_id = -1;
+        for (int a = 6; a < argc; ++a) {
+            std::string arg = argv[a];
+            if (arg.rfind("partition=", 0) == 0) {
+                partitioning = PartitionFunction::parse(arg.substr(10));
+            } else if (arg.rfind("transport=", 0) == 0) {
+                transport_kind = Transport::parse(arg.substr(10));
+            } else if (arg.rfind("batch=", 0) == 0) {
+                batch_tuples = std::max(1, std::stoi(arg.substr(6)));
+            } else if (arg.rfind("hwm=", 0) == 0) {
+                flow_options.window_tuples = std::stoul(arg.substr(4));
+            } else if (arg.rfind("queue=", 0) == 0) {
+                flow_options.queue_tuples = std::stoul(arg.substr(6));
+            } else if (arg.rfind("spill=", 0) == 0) {
+                flow_options.spill_directory = arg.substr(6);
+            } else if (arg.rfind("traffic=", 0) == 0) {
+                traffic_prefix = arg.substr(8);
+            } else if (arg.rfind("trace=", 0) == 0) {
+                trace_file = arg.substr(6);
+            } else if (arg == "io=uring" || arg == "io=pread") {
+                load_options.use_uring = arg == "io=uring";
+            } else if (arg == "direct=on" || arg == "direct=off") {
+                load_options.direct = arg == "direct=on";
+            } else if (arg.rfind("config=", 0) == 0) {
+                config_file = arg.substr(7);
+            } else if (arg.rfind("node=", 0) == 0) {
+                node_id = std::stoi(arg.substr(5));
+            } else if (arg == "pipeline=on" || arg == "pipeline=off") {
+                pipelined = arg == "pipeline=on";
+            } else if (arg.find('=') != std::string::npos) {
+                std::cerr << "Unknown option " << arg << ".\n" << usage;
+                return 1;
+            } else {
+                result_folder = arg;
+            }
+        }
+        // A frame may take at most half of a shared memory ring, larger batches would fail in the middle of the shuffle
+        size_t max_shm_batch = SharedMemoryRings::max_rows(sizeof(batch_protocol::batch_header));
+        if (transport_kind == Transport::SharedMemory && batch_tuples > max_shm_batch) {
+            std::cerr << "batch=" << batch_tuples << " does not fit into the shared memory rings, transport=shm allows at most " << max_shm_batch << " tuples per message.\n";
+            return 1;
+        }
+        PartitionFunction partition(partitioning, n_servers); // Routes a join key to its server
 
         auto r_files = get_all_files_in_directory(r_folder);
         auto s_files = get_all_files_in_directory(s_folder);
 
         // Ensure there are enough files for the number of servers
-        if (r_files.size() < n_servers || s_files.size() < n_servers) {
+        if (r_files.size() < static_cast<size_t>(n_servers) || s_files.size() < static_cast<size_t>(n_servers)) {
             std::cerr << "Not enough R or S files for the number of servers.\n";
             return 1;
         }
 
-        // Allocate memory for total receive buffers
-        tuples_data r_data_receive_total, s_data_receive_total;
-        allocate_mem(r_data_receive_total, num_r_tuples * n_servers);
-        allocate_mem(s_data_receive_total, num_s_tuples * n_servers);
+        // Nodes run by this process, with the coordinator and transports connecting them
+        std::vector<int> local_nodes;
+        std::unique_ptr<Coordinator> coordinator;
+        std::unique_ptr<TransportFactory> transports;
+        std::string shm_name;
+        if (config_file.empty()) {
+            for (int i = 0; i < n_servers; ++i) {
+                local_nodes.push_back(i);
+            }
+            coordinator = std::make_unique<LocalCoordinator>(n_servers);
+            transports = std::make_unique<TransportFactory>(transport_kind, n_servers);
+        } else {
+            auto config = read_cluster_config(config_file);
+            if (static_cast<int>(config.nodes.size()) != n_servers || node_id < 0 || node_id >= n_servers) {
+                std::cerr << "Cluster config " << config_file << " has " << config.nodes.size() << " nodes, need " << n_servers << " and node=<0.." << n_servers - 1 << ">.\n";
+                return 1;
+            }
+            local_nodes.push_back(node_id);
+            coordinator = std::make_unique<ClusterCoordinator>(node_id, n_servers, config.coordinator);
+            if (transport_kind == Transport::SharedMemory) {
+                // Node 0 removes rings left over by an earlier run before anybody attaches
+                shm_name = "/flow_join_" + config.coordinator.substr(config.coordinator.rfind(':') + 1);
+                if (node_id == 0) {
+                    SharedMemoryRings::remove(shm_name);
+                }
+                coordinator->barrier(node_id);
+            }
+            transports = std::make_unique<TransportFactory>(transport_kind, config.nodes, shm_name);
+        }
 
-        // Mutexes for synchronizing access to the receive buffers
-        std::mutex r_mutex, s_mutex;
+        // Partition files of the local nodes, resolved before any node starts
+        std::vector<std::string> r_paths(n_servers), s_paths(n_servers);
+        for (int i : local_nodes) {
+            std::string r_file = find_file_with_prefix(r_files, std::to_string(i + 1) + "_");
+            std::string s_file = find_file_with_prefix(s_files, std::to_string(i + 1) + "_");
+            if (r_file.empty() || s_file.empty()) {
+                std::cerr << "No " << (r_file.empty() ? "R" : "S") << " partition " << i + 1 << "_* in " << (r_file.empty() ? r_folder : s_folder) << " for server " << i << ".\n";
+                return 1;
+            }
+            r_paths[i] = r_folder + '/' + r_file;
+            s_paths[i] = s_folder + '/' + s_file;
+        }
 
-        // Atomic flag to signal threads to stop
-        std::atomic<bool> done(false);
+        // Join result of every local node
+        std::vector<std::vector<joined_row>> join_results(n_servers);
 
-        // Synchronization barrier to ensure all nodes are ready before proceeding
-        std::barrier sync_point(n_servers);
+        // Pipelined mode: every node joins its own tuples while they arrive
+        std::vector<std::unique_ptr<PipelinedJoin>> pipelines(n_servers);
+        if (pipelined) {
+            for (int i : local_nodes) {
+                pipelines[i] = std::make_unique<PipelinedJoin>(n_servers);
+            }
+        }
+        std::vector<node_statistics> statistics; // Of all nodes, filled by the first local node
+        std::vector<std::vector<link_traffic>> traffic_links;
 
         // Start a thread for each node
         std::vector<std::thread> nodes;
-        for (int i = 0; i < n_servers; ++i) {
-            nodes.emplace_back(node_thread, i, n_servers, r_files, s_files, r_folder, s_folder,
-                               std::ref(r_data_receive_total), std::ref(s_data_receive_total), std::ref(r_mutex), std::ref(s_mutex), std::ref(sync_point), std::ref(done));
+        for (int i : local_nodes) {
+            nodes.emplace_back(node_thread, i, n_servers, std::ref(*coordinator), std::ref(*transports), std::cref(partition), r_paths[i], s_paths[i],
+                               std::ref(join_results[i]), pipelines[i].get(), batch_tuples, std::cref(flow_options), std::cref(load_options),
+                               i == local_nodes[0] ? &statistics : nullptr, i == local_nodes[0] ? &traffic_links : nullptr);
         }
 
         for (auto& node : nodes) {
             node.join();
         }
-
-        // Signal threads to stop
-        done.store(true);
-
-        // Wait for a moment to ensure all threads have stopped
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-
-        // Perform the join operation on the received data
-        // Create a hash table for R
-        std::unordered_multimap<int, joined_row> r_hash_table;
-        {
-            std::lock_guard<std::mutex> lock(r_mutex);
-            for (const auto& row : r_data_receive_total.tuples) {
-                r_hash_table.insert({row.join_val, row});
-            }
+        if (statistics.size() != static_cast<size_t>(n_servers)) {
+            std::cerr << "A node failed.\n";
+            return 1;
+        }
+        if (!shm_name.empty() && node_id == 0) {
+            SharedMemoryRings::remove(shm_name);
+        }
+        trace::write_requested(config_file.empty() || trace_file.empty() ? trace_file : trace_file + ".node" + std::to_string(node_id));
+        double shuffle_time = 0; // Slowest node
+        double end_to_end_time = 0;
+        size_t total_sent = 0;
+        size_t n_joined = 0;
+        for (const auto& node : statistics) {
+            shuffle_time = std::max(shuffle_time, node.shuffle_seconds);
+            end_to_end_time = std::max(end_to_end_time, node.shuffle_seconds + node.join_seconds);
+            total_sent += node.tuples_sent;
+            n_joined += node.rows;
         }
 
-        // Iterate through S and join with R
-        std::vector<joined_row> join_result;
-        {
-            std::lock_guard<std::mutex> lock(s_mutex);
-            for (const auto& row : s_data_receive_total.tuples) {
-                auto range = r_hash_table.equal_range(row.join_val);
-                for (auto it = range.first; it != range.second; ++it) {
-                    joined_row joined;
-                    joined.join_val = row.join_val;
-                    joined.row_R = it->second.row_R;
-                    joined.row_S = row.row_S;
-                    join_result.push_back(joined);
-                }
+        // Every node has its own result
+        for (int i : local_nodes) {
+            std::cout << "Node " << i << " load took " << statistics[i].load_seconds << " seconds, shuffle" << (pipelined ? " and join" : "") << " " << statistics[i].shuffle_seconds << " seconds";
+            if (!pipelined) {
+                std::cout << ", join " << statistics[i].join_seconds << " seconds";
+            }
+            std::cout << " (" << statistics[i].r_tuples << " R, " << statistics[i].s_tuples << " S tuples, " << statistics[i].rows << " rows).\n";
+            if (!result_folder.empty()) {
+                fs::create_directories(result_folder);
+                ResultWriter writer(result_file_name(result_folder, i));
+                writer.write(join_results[i]);
+                writer.close();
             }
         }
 
-        // Output the join result
-        for (const auto& row : join_result) {
-            std::cout << "Joined Row: Key=" << row.join_val << ", Value_R=" << row.row_R << ", Value_S=" << row.row_S << std::endl;
+        // Only node 0 reports the totals in cluster mode
+        if (local_nodes[0] == 0) {
+            std::cout << "Shuffle throughput: " << total_sent / shuffle_time << " tuples/s (" << total_sent << " tuples sent, " << batch_tuples << " tuples per message, " << Transport::name(transport_kind) << ").\n";
+            std::cout << "Joined " << n_joined << " rows." << std::endl;
+            TrafficMatrix traffic(traffic_links);
+            traffic.print_summary(std::cout);
+            if (!traffic_prefix.empty()) {
+                traffic.write_csv(traffic_prefix + ".csv");
+                traffic.write_json(traffic_prefix + ".json", "flow_join", Transport::name(transport_kind));
+                std::cout << "Traffic matrix written to " << traffic_prefix << ".csv and " << traffic_prefix << ".json" << std::endl;
+            }
+            std::cout << "End-to-end shuffle and join took " << end_to_end_time << " seconds (" << (pipelined ? "pipelined" : "join after the shuffle of each node") << ").\n";
         }
 
     } catch (const std::exception& e) {
         std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
     }
 
     return 0;
@@ -3,191 +3,121 @@
 #include <vector>
 #include <algorithm>
 #include <filesystem>
-#include <fstream>
 #include <chrono>
+#include <numeric>
 #include "./utils/helper_functions.h"
-#include "./utils/SpaceSaving.h"
-
-int copy_local_data_to_s_receive_buffers(
-        int my_id,
-        const tuples_data& s_data_send,
-        std::vector<tuples_data>& s_data_receive,
-        const std::unordered_map<int, float>& heavy_hitters) {
-
-    int n_tuples_copied = 0;
-
-    // Copy/send only, if it is not a heavy hitter
-    // Iterate over tuples to process them
-    for(const auto& t : s_data_send.tuples) {
-        // Check if the tuple is not a heavy hitter
-        if (heavy_hitters.find(t.join_val) == heavy_hitters.end()) {
-            // Copy to the receive buffer corresponding to the target row
-            s_data_receive[t.row_S - 1].tuples[s_data_receive[t.row_S - 1].filled_rows] = t;
-            s_data_receive[t.row_S - 1].filled_rows++;
-            if((t.row_S - 1) != my_id){ // Only count if not sent/copied to other servers
-                n_tuples_copied++;
-            }
-        }
-        // If it is a heavy hitter, it stays on this server
-        else {
-            s_data_receive[my_id].tuples[s_data_receive[my_id].filled_rows] = t;
-            s_data_receive[my_id].filled_rows++;
-        }
-    }
-
-    return n_tuples_copied;
-}
-
-int copy_local_data_to_r_receive_buffers(
-        int my_id,
-        const tuples_data& r_data_send,
-        std::vector<tuples_data>& r_data_receive,
-        const std::unordered_map<int, float>& heavy_hitters) {
-
-    int n_tuples_copied = 0;
-
-    // Iterate over tuples to process them
-    for (const auto& t : r_data_send.tuples) {
-        // Check if the tuple is a heavy hitter
-        if (heavy_hitters.find(t.join_val) != heavy_hitters.end()) {
-            // If it's a heavy hitter, copy to all other servers
-            for (int i = 0; i < r_data_receive.size(); ++i) {
-                    r_data_receive[i].tuples[r_data_receive[i].filled_rows] = t;
-                    r_data_receive[i].filled_rows++;
-                if (i != my_id) { // Increment only when actually sent
-                    n_tuples_copied++;
-                }
-            }
-        // Otherwise, copy to the corresponding server
-        } else {
-            r_data_receive[t.row_S - 1].tuples[r_data_receive[t.row_S - 1].filled_rows] = t;
-            r_data_receive[t.row_S - 1].filled_rows++;
-            n_tuples_copied++;
-        }
-    }
-
-    return n_tuples_copied;
-}
-
-// Function to allocate memory for a vector of vectors
-void allocate_mem_dual_vec(std::vector<tuples_data>& vec, size_t outer_size, size_t inner_size) {
-    // Resize the outer vector to the required size
-    vec.resize(outer_size);
-
-    // Resize each inner vector to the required size
-    for (size_t i = 0; i < outer_size; ++i) {
-        vec[i].tuples.resize(inner_size);
-        vec[i].filled_rows = 0;
-    }
-}
+#include "./utils/local_joins.h"
+#include "./utils/async_loader.h"
+#include "./utils/trace.h"
 
 int main(int argc, char* argv[]) {
     try {
+        const char* usage = "Usage: ./flow_join_local <n_servers> <num_r_tuples> <num_s_tuples> <R_folder> <S_folder> [result_folder] [partition=modulo|multiplicative|crc32|radix]\n"
+                            "       [imbalance=<target imbalance, default 0.1>] [network_cost=<cost of shipping a tuple relative to processing it, default 2>] [balance=on|off] [io=uring|pread] [direct=on|off] [counters=on|off] [trace=<file>]\n";
         // Check if the number of arguments is correct
-        if (argc != 6) {
-            std::cerr << "Usage: ./flow_join_local <n_servers> <num_r_tuples> <num_s_tuples> <R_folder> <S_folder>\n";
+        if (argc < 6) {
+            std::cerr << usage;
             return 1;
         }
 
         // Get arguments
         int n_servers = std::atoi(argv[1]);
-        int num_r_tuples = std::atoi(argv[2]);
-        int num_s_tuples = std::atoi(argv[3]);
+        size_t num_r_tuples = std::atoll(argv[2]);
+        size_t num_s_tuples = std::atoll(argv[3]);
         std::string r_folder = argv[4];
         std::string s_folder = argv[5];
+        LocalJoin::options join_options;
+        loader_options load_options; // Binary partitions are read through io_uring, buffered
+        std::string trace_file; // Chrome trace of all phases, if compiled with -DJOIN_TRACE
+        bool counters = false; // Hardware counters of every phase
+        for (int a = 6; a < argc; ++a) {
+            std::string arg = argv[a];
+            if (arg.rfind("partition=", 0) == 0) {
+                join_options.partitioning = PartitionFunction::parse(arg.substr(10));
+            } else if (arg.rfind("trace=", 0) == 0) {
+                trace_file = arg.substr(6);
+            } else if (arg == "counters=on" || arg == "counters=off") {
+                counters = arg == "counters=on";
+            } else if (arg == "io=uring" || arg == "io=pread") {
+                load_options.use_uring = arg == "io=uring";
+            } else if (arg == "direct=on" || arg == "direct=off") {
+                load_options.direct = arg == "direct=on";
+            } else if (arg == "balance=on" || arg == "balance=off") {
+                join_options.balance = arg == "balance=on";
+            } else if (arg.rfind("imbalance=", 0) == 0) {
+                join_options.planner.target_imbalance = std::stod(arg.substr(10));
+            } else if (arg.rfind("network_cost=", 0) == 0) {
+                join_options.planner.network_cost = std::stod(arg.substr(13));
+            } else if (arg.find('=') != std::string::npos) {
+                std::cerr << "Unknown option " << arg << ".\n" << usage;
+                return 1;
+            } else {
+                join_options.result_folder = arg;
+            }
+        }
 
-        // Initialize vectors
-        std::vector<tuples_data> r_data_send;
-        allocate_mem_dual_vec(r_data_send, n_servers, num_r_tuples);
-        std::vector<tuples_data> s_data_send;
-        allocate_mem_dual_vec(s_data_send, n_servers, num_s_tuples);
-        std::vector<tuples_data> r_data_receive;
-        allocate_mem_dual_vec(r_data_receive, n_servers, num_r_tuples);
-        std::vector<tuples_data> s_data_receive;
-        allocate_mem_dual_vec(s_data_receive, n_servers, num_s_tuples);
-
-        uint32_t num_s_tuples_sent = 0;
-        uint32_t num_r_tuples_sent = 0;
-
-        std::vector<int> sample_stream;
-
-        // Loop over each server to process local data
+        // Find the partition files of every server before the servers start
+        auto r_files = get_all_files_in_directory(r_folder);
+        auto s_files = get_all_files_in_directory(s_folder);
+        std::vector<std::string> r_file(n_servers), s_file(n_servers);
         for(int i = 0; i < n_servers; i++ ) {
-            // Get and find files
-            auto r_files = get_all_files_in_directory(r_folder);
-            auto s_files = get_all_files_in_directory(s_folder);
-            
-            // Find files for this server
-            std::string r_file = find_file_with_prefix(r_files, std::to_string(i + 1));
-            std::string s_file = find_file_with_prefix(s_files, std::to_string(i + 1));
-
-            // Read local data to this server
-            auto r_data_send_tmp = read_data(r_folder + '/' + r_file);
-            auto s_data_send_tmp = read_data(s_folder + '/' + s_file);
-            
-            // Store data in vectors
-            r_data_send[i].tuples = r_data_send_tmp;
-            r_data_send[i].filled_rows = r_data_send_tmp.size();
-            s_data_send[i].tuples = s_data_send_tmp;
-            s_data_send[i].filled_rows = s_data_send_tmp.size();
-
-            // Sample 1% of r_data_send_tmp to estimate heavy hitters
-            for (size_t j = 0; j < s_data_send_tmp.size(); j += 100) { // Previously j += 1
-                sample_stream.push_back(s_data_send_tmp[j].join_val);
+            r_file[i] = find_file_with_prefix(r_files, std::to_string(i + 1) + "_");
+            s_file[i] = find_file_with_prefix(s_files, std::to_string(i + 1) + "_");
+            if (r_file[i].empty() || s_file[i].empty()) {
+                std::cerr << "No " << (r_file[i].empty() ? "R" : "S") << " partition " << i + 1 << "_* in "
+                          << (r_file[i].empty() ? r_folder : s_folder) << " for server " << i << ".\n";
+                return 1;
             }
         }
 
-        auto start = std::chrono::high_resolution_clock::now(); // Start time
-        // Estimate heavy hitters using SpaceSaving algorithm
-        SpaceSaving::DataStructure ds = SpaceSaving::SortedArray; // Define here data structure to be use
-        int k = 128;  // Capacity of the histogram for heavy hitter detection
-        SpaceSaving ss(k, ds);
-        
-        ss.process(sample_stream);
-
-        float threshold = 0.01;  // Define a threshold
-        auto heavy_hitters = ss.get_heavy_hitters(threshold);
-
-        auto end_time = std::chrono::high_resolution_clock::now(); // End time
+        // Every simulated server runs on its own thread, the phases are separated by barriers
+        LocalFlowJoin flow_join(n_servers, join_options);
+        LocalEngine engine(n_servers);
+        if (counters) {
+            engine.enable_counters();
+        }
+        flow_join.run(engine, [&](int i, tuples_data& r, tuples_data& s) {
+            // Both files through one ring of this server, the servers load concurrently
+            auto local_data = load_partitions({r_folder + '/' + r_file[i], s_folder + '/' + s_file[i]}, load_options);
+            r.tuples = std::move(local_data[0]);
+            s.tuples = std::move(local_data[1]);
+        });
+
+        size_t total_r_tuples = flow_join.r_tuples(), total_s_tuples = flow_join.s_tuples();
+        if (total_r_tuples != num_r_tuples || total_s_tuples != num_s_tuples) {
+            std::cerr << "Warning: Read " << total_r_tuples << " R and " << total_s_tuples << " S tuples, expected "
+                      << num_r_tuples << " and " << num_s_tuples << ".\n";
+        }
 
-        // Calculate and print execution time
-        std::chrono::duration<double> elapsed = end_time - start;
-        std::cout << "Heavy hitter detection took " << elapsed.count() << " seconds.\n";
+        std::cout << "Heavy hitter detection took " << engine.phase_makespan(LocalEngine::Detect) << " seconds (sample of " << flow_join.sample_tuples()
+                  << " tuples, threshold " << flow_join.threshold() << ", k = " << flow_join.capacity() << ").\n";
 
-        // Print detected heavy hitters
+        // Print detected heavy hitters and the strategy chosen for them
         std::cout << "Heavy Hitters:" << std::endl;
-        for (const auto& [element, frequency] : heavy_hitters) {
+        for (const auto& [element, frequency] : flow_join.detected_heavy_hitters()) {
             std::cout << "Element: " << element << ", Frequency: " << frequency * 100 << "%" << std::endl;
         }
+        const SkewPlanner& planner = flow_join.skew_planner();
+        planner.print_plan(std::cout);
+        planner.print_load(std::cout, planner.predicted_load(flow_join.partition_function()), flow_join.received());
 
-        // Process local data
-        for(int i = 0; i < n_servers; i++ ) {
-            calculate_receiver_and_store(s_data_send[i].tuples, n_servers); // Stores server id in third col
-            calculate_receiver_and_store(r_data_send[i].tuples, n_servers); // Stores server id in third col
-            num_s_tuples_sent += copy_local_data_to_s_receive_buffers(i, s_data_send[i], s_data_receive, heavy_hitters);
-            num_r_tuples_sent += copy_local_data_to_r_receive_buffers(i, r_data_send[i], r_data_receive, heavy_hitters); 
-        }
+        size_t n_scattered = total_r_tuples + total_s_tuples;
+        double shuffle_time = engine.phase_makespan(LocalEngine::Shuffle);
+        std::cout << "Shuffle of " << n_scattered << " tuples took " << shuffle_time << " seconds ("
+                  << n_scattered / shuffle_time << " tuples/s, fan-out " << n_servers << ").\n";
+        std::cout << "Sent " << flow_join.s_sent() << " S tuples and " << flow_join.r_sent() << " R tuples to other servers.\n";
 
-        // Open a file to save execution times
-        std::ofstream output_file("execution_times.txt");
-        if (!output_file.is_open()) {
-            std::cerr << "Failed to open file for writing execution times.\n";
-            return 1;
-        }
         for(int i = 0; i < n_servers; i++){
-            auto start = std::chrono::high_resolution_clock::now(); // Start time
-            auto r_join_s = inner_join(r_data_receive[i], s_data_receive[i]);
-            auto end_time = std::chrono::high_resolution_clock::now(); // End time
-
-            // Calculate and print execution time
-            std::chrono::duration<double> elapsed = end_time - start;
-            std::cout << "Server " << i << " inner join took " << elapsed.count() << " seconds.\n";
-
-            // Save the execution time to the file
-            output_file << "Server " << i << ": " << elapsed.count() << " seconds\n";
-        }       
+            double elapsed = engine.time(i, LocalEngine::Join);
+            std::cout << "Server " << i << " inner join took " << elapsed << " seconds (" << flow_join.join_size(i) << " rows).\n";
+        }
+        engine.print_times(std::cout);
+        engine.print_counters(std::cout, total_r_tuples + total_s_tuples);
+        trace::write_requested(trace_file);
+        flow_join.print_balance_report(std::cout, engine);
     } catch (std::exception& e) {
         std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
     }
 
     return 0;
@@ -2,146 +2,419 @@
 #include <thread>
 #include <string>
 #include <vector>
-#include <zmq.hpp>
 #include <algorithm>
 #include <tuple>
-#include <mutex>
-#include <barrier>
 #include <unordered_map>
+#include <numeric>
+#include <memory>
+#include <chrono>
 #include "./utils/helper_functions.h"
+#include "./utils/radix_scatter.h"
+#include "./utils/partition_function.h"
+#include "./utils/pipelined_join.h"
+#include "./utils/transport.h"
+#include "./utils/batch_protocol.h"
+#include "./utils/receive_engine.h"
+#include "./utils/coordinator.h"
+#include "./utils/traffic_matrix.h"
+#include "./utils/async_loader.h"
+#include "./utils/trace.h"
+#include "./utils/result_writer.h"
 
-// Function to allocate memory for tuples_data
+// Function to allocate memory for tuples_data (uninitialized, pre-faulted)
 void allocate_mem(tuples_data& data, size_t size) {
     data.tuples.resize(size);
     data.filled_rows = 0;
 }
 
-void node_thread(int id, int n_servers, const std::vector<std::string>& r_files, const std::vector<std::string>& s_files, const std::string& r_folder, const std::string& s_folder,
-                 tuples_data& r_data_receive_total, tuples_data& s_data_receive_total, std::mutex& r_mutex, std::mutex& s_mutex, std::barrier<>& sync_point) {
+// Runs node id. All nodes synchronize and exchange counts through the coordinator. Every node joins
+// the tuples it received into join_result, while receiving if pipeline is given, otherwise as soon
+// as its own shuffle is complete. statistics and traffic_links, if given, receive the statistics and
+// traffic of all nodes at the end.
+void node_thread(int id, int n_servers, Coordinator& coordinator, TransportFactory& transports, const PartitionFunction& partition, const std::string& r_path, const std::string& s_path,
+                 std::vector<joined_row>& join_result, PipelinedJoin* pipeline, size_t batch_tuples, const batch_protocol::flow_control_options& flow_options, const loader_options& load_options,
+                 std::vector<node_statistics>* statistics,
+                 std::vector<std::vector<link_traffic>>* traffic_links) {
     try {
-        zmq::context_t context(1);
-        zmq::socket_t receiver(context, zmq::socket_type::pull);
-        receiver.bind("tcp://*:" + std::to_string(5550 + id));
+        // Bound here, connected to the other nodes once all of them are bound
+        TRACE_THREAD_NAME("node " + std::to_string(id));
+        auto transport = transports.create(id);
 
-        std::unordered_map<int, zmq::socket_t> senders;
-        for (int i = 0; i < n_servers; ++i) {
-            if (i != id) {
-                zmq::socket_t sender(context, zmq::socket_type::push);
-                sender.connect("tcp://localhost:" + std::to_string(5550 + i));
-                senders[i] = std::move(sender);
-            }
-        }
+        TRACE_PHASES("load");
 
-        // Read local files
-        auto r_data_send_tmp = read_data(r_folder + '/' + r_files[id]);
-        auto s_data_send_tmp = read_data(s_folder + '/' + s_files[id]);
+        // Read local files, both through one ring of the loader
+        auto load_start = std::chrono::high_resolution_clock::now();
+        load_statistics loaded;
+        auto local_data = load_partitions({r_path, s_path}, load_options, &loaded);
+        auto r_data_send_tmp = std::move(local_data[0]);
+        auto s_data_send_tmp = std::move(local_data[1]);
+        std::chrono::duration<double> load_elapsed = std::chrono::high_resolution_clock::now() - load_start;
+        std::cout << "Node " << id << " loaded " << loaded.bytes << " bytes of binary partitions in " << load_elapsed.count() << " seconds ("
+                  << (loaded.uring ? "io_uring" : "pread") << ", " << loaded.direct_files << " files with O_DIRECT)." << std::endl;
 
         // Prepare data for sending
-        tuples_data r_data_send = {r_data_send_tmp, static_cast<int>(r_data_send_tmp.size())};
-        tuples_data s_data_send = {s_data_send_tmp, static_cast<int>(s_data_send_tmp.size())};
+        tuples_data r_data_send = {std::move(r_data_send_tmp), 0};
+        r_data_send.filled_rows = r_data_send.tuples.size();
+        tuples_data s_data_send = {std::move(s_data_send_tmp), 0};
+        s_data_send.filled_rows = s_data_send.tuples.size();
+
+        // Process local data: group R and S by target server
+        TRACE_NEXT_PHASE("group by destination");
+        auto destination = [&partition](const joined_row& t) { return static_cast<int>(partition(t.join_val)); };
+        auto r_memory_locations = radix_scatter::counting_sort(r_data_send.tuples, r_data_send.filled_rows, n_servers, destination);
+        auto s_memory_locations = radix_scatter::counting_sort(s_data_send.tuples, s_data_send.filled_rows, n_servers, destination);
+
+        // Count exchange: tuples for every destination, R in [0, n_servers), S in [n_servers, 2 n_servers)
+        std::vector<size_t> destination_counts(2 * n_servers, 0);
+        for (const auto& [server_id, offset, count] : r_memory_locations) {
+            destination_counts[server_id - 1] += count;
+        }
+        for (const auto& [server_id, offset, count] : s_memory_locations) {
+            destination_counts[n_servers + server_id - 1] += count;
+        }
+        TRACE_NEXT_PHASE("exchange counts");
+        auto counts = coordinator.all_gather_values(id, destination_counts);
+        transport->connect();
 
-        // Process local data
-        calculate_receiver_and_store(s_data_send.tuples, n_servers);  // Assumes this function modifies the third column to store server ids
-        std::sort(s_data_send.tuples.begin(), s_data_send.tuples.end(), compare_by_row_S);
-        auto memory_locations = get_first_occurrence_and_count(s_data_send.tuples);
+        // Receive buffers of this node, sized exactly; the pipelined join needs none
+        tuples_data r_data_receive = {{}, 0};
+        tuples_data s_data_receive = {{}, 0};
+        if (!pipeline) {
+            size_t n_r = 0, n_s = 0;
+            for (const auto& c : counts) {
+                n_r += c[id];
+                n_s += c[n_servers + id];
+            }
+            allocate_mem(r_data_receive, n_r);
+            allocate_mem(s_data_receive, n_s);
+        }
 
         // Synchronize before sending data
-        sync_point.arrive_and_wait();
-
-        // Send data to other nodes
-        for (const auto& [server_id, offset, count] : memory_locations) {
-            int sender_index = server_id - 1;
-            if (sender_index != id) {
-                std::vector<joined_row> data_to_send(s_data_send.tuples.begin() + offset, s_data_send.tuples.begin() + offset + count);
-                zmq::message_t message(data_to_send.size() * sizeof(joined_row));
-                memcpy(message.data(), data_to_send.data(), data_to_send.size() * sizeof(joined_row));
-                if (senders.find(sender_index) != senders.end()) {
-                    std::cout << "Node " << id << " sending data to node " << sender_index << std::endl;
-                    senders[sender_index].send(message, zmq::send_flags::none);
+        TRACE_NEXT_PHASE("barrier");
+        coordinator.barrier(id);
+        auto shuffle_start = std::chrono::high_resolution_clock::now();
+
+        // Hands received tuples to the pipelined join or appends them to the receive buffers
+        auto deliver = [&](char relation, const joined_row* rows, size_t n) {
+            if (pipeline) {
+                if (relation == 'R') {
+                    pipeline->add_r(rows, n);
                 } else {
-                    std::cerr << "Invalid sender index: " << sender_index << " in node " << id << std::endl;
+                    pipeline->add_s(rows, n);
                 }
+            } else {
+                append_batch(relation == 'R' ? r_data_receive : s_data_receive, rows, n);
             }
-        }
+        };
+        auto finish_source = [&](char relation) {
+            if (pipeline) {
+                if (relation == 'R') {
+                    pipeline->finish_r_source();
+                } else {
+                    pipeline->finish_s_source();
+                }
+            }
+        };
 
-        // Thread to handle receiving messages
-        std::thread receive_thread([&receiver, &s_data_receive_total, &s_mutex, id]() {
+        // Thread to handle receiving messages, started before sending so that no sender blocks on a full queue.
+        // Every message is a batch of one relation (utils/batch_protocol.h), appended as a whole.
+        // Credits bound the tuples in flight per destination (hwm=0: no flow control)
+        NodeTraffic traffic(id, n_servers);
+        std::unique_ptr<batch_protocol::FlowControl> flow;
+        if (flow_options.window_tuples > 0) {
+            flow = std::make_unique<batch_protocol::FlowControl>(*transport, id, n_servers, batch_tuples, flow_options, &traffic);
+        }
+        ReceiveEngine receive_engine(*transport, n_servers, flow.get(), &traffic);
+        ReceiveThread receive_thread(receive_engine, [&receive_engine, &deliver, &finish_source, id]() {
+            TRACE_THREAD_NAME("node " + std::to_string(id) + " receive");
             try {
-                while (true) {
-                    zmq::message_t message;
-                    auto result = receiver.recv(message, zmq::recv_flags::none);
-                    if (result) {
-                        auto received_data = static_cast<joined_row*>(message.data());
-                        size_t count = message.size() / sizeof(joined_row);
-
-                        // Lock the mutex before modifying the receive buffer
-                        std::lock_guard<std::mutex> lock(s_mutex);
-                        s_data_receive_total.tuples.insert(s_data_receive_total.tuples.end(), received_data, received_data + count);
-                        s_data_receive_total.filled_rows += count;
-
-                        std::cout << "Node " << id << " received " << count << " tuples." << std::endl;
-                    }
-                }
-            } catch (const zmq::error_t& e) {
+                receive_engine.run(deliver, finish_source);
+            } catch (const std::exception& e) {
                 std::cerr << "Receive thread error in node " << id << ": " << e.what() << std::endl;
             }
         });
 
+        // Outgoing batches of every other node. Slices are sent as views of the sorted send buffers,
+        // in_flight keeps r_data_send and s_data_send alive until ZMQ released all of them.
+        batch_protocol::InFlight in_flight;
+        std::unordered_map<int, batch_protocol::BatchSender> batches;
+        for (int i = 0; i < n_servers; ++i) {
+            if (i != id) {
+                batches.emplace(i, batch_protocol::BatchSender(*transport, i, id, batch_tuples, flow.get(), &traffic));
+            }
+        }
+
+        size_t tuples_sent = 0;
+        // Send the slices of one relation to the other nodes, R first so that the pipelined join can build while S is in flight
+        auto send_relation = [&](char relation, const tuples_data& data_send, const std::vector<std::tuple<uint32_t, size_t, size_t>>& memory_locations) {
+            for (const auto& [server_id, offset, count] : memory_locations) {
+                int sender_index = server_id - 1;
+                if (count == 0) {
+                    continue;
+                }
+                if (sender_index == id) {
+                    // Slice of this node stays local
+                    traffic.kept(relation, count);
+                    deliver(relation, data_send.tuples.data() + offset, count);
+                } else if (batches.find(sender_index) != batches.end()) {
+                    batches.at(sender_index).send_view(relation, data_send.tuples.data() + offset, count, in_flight);
+                    tuples_sent += count;
+                } else {
+                    std::cerr << "Invalid sender index: " << sender_index << " in node " << id << std::endl;
+                }
+            }
+            for (auto& [target_server, batch] : batches) {
+                batch.end_of_stream(relation);
+            }
+            finish_source(relation);
+        };
+        TRACE_NEXT_PHASE("send R");
+        send_relation('R', r_data_send, r_memory_locations);
+        TRACE_NEXT_PHASE("send S");
+        send_relation('S', s_data_send, s_memory_locations);
+        size_t bytes_copied = 0, batches_queued = 0, batches_spilled = 0;
+        for (const auto& [target_server, batch] : batches) {
+            bytes_copied += batch.bytes_copied();
+            batches_queued += batch.batches_queued();
+            batches_spilled += batch.batches_spilled();
+        }
+        std::cout << "Node " << id << " sent " << tuples_sent << " tuples, " << bytes_copied << " bytes copied on the send path." << std::endl;
+
+        if (flow) {
+            std::cout << "Node " << id << " flow control: " << batches_queued << " batches waited for credits, " << batches_spilled << " spilled to disk, "
+                      << flow->credit_waits() << " waits, " << flow->credit_frames() << " credit frames sent." << std::endl;
+            flow->finish_sending();
+        }
+        TRACE_NEXT_PHASE("wait for receive");
         receive_thread.join();
-    } catch (const zmq::error_t& e) {
+        auto join_start = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> shuffle_elapsed = join_start - shuffle_start;
+        std::cout << "Node " << id << " received " << receive_engine.tuples_received() << " tuples in " << receive_engine.batches_received()
+                  << " batches (" << receive_engine.wakeups() << " wakeups)." << std::endl;
+
+        // Local join of this node, without waiting for the others
+        node_statistics mine = {shuffle_elapsed.count(), 0, static_cast<uint64_t>(tuples_sent), 0, 0, 0, load_elapsed.count()};
+        if (pipeline) {
+            join_result.swap(pipeline->get_result());
+            mine.r_tuples = pipeline->r_tuples();
+            mine.s_tuples = pipeline->s_tuples();
+        } else {
+            TRACE_NEXT_PHASE("join");
+            join_result = inner_join(r_data_receive, s_data_receive);
+            std::chrono::duration<double> join_elapsed = std::chrono::high_resolution_clock::now() - join_start;
+            mine.join_seconds = join_elapsed.count();
+            mine.r_tuples = r_data_receive.filled_rows;
+            mine.s_tuples = s_data_receive.filled_rows;
+        }
+        mine.rows = join_result.size();
+
+        // Statistics of all nodes for the report of node 0
+        TRACE_NEXT_PHASE("exchange statistics");
+        auto all_statistics = coordinator.all_gather_value(id, mine);
+        auto all_links = coordinator.all_gather_values(id, traffic.links());
+        if (statistics) {
+            *statistics = all_statistics;
+            *traffic_links = all_links;
+        }
+    } catch (const std::exception& e) {
         std::cerr << "Error in node " << id << ": " << e.what() << std::endl;
+        coordinator.leave(id); // The other nodes stop instead of waiting for this one
     }
 }
 
 int main(int argc, char* argv[]) {
     try {
-        if (argc != 6) {
-            std::cerr << "Usage: ./server <n_servers> <num_r_tuples> <num_s_tuples> <R_folder> <S_folder>\n";
+        const char* usage = "Usage: ./hash_join_distributed <n_servers> <num_r_tuples> <num_s_tuples> <R_folder> <S_folder> [result_folder] [partition=modulo|multiplicative|crc32|radix] [pipeline=on|off] [batch=<tuples per message>] [transport=tcp|inproc|shm] [hwm=<tuples in flight per destination, 0: off>] [queue=<tuples>] [spill=<directory>] [traffic=<file prefix>] [io=uring|pread] [direct=on|off] [trace=<file>] [config=<cluster config> node=<id>]\n";
+        if (argc < 6 || argc > 20) {
+            std::cerr << usage;
             return 1;
         }
 
         int n_servers = std::stoi(argv[1]);
-        int num_r_tuples = std::stoi(argv[2]);
-        int num_s_tuples = std::stoi(argv[3]);
+        // <num_r_tuples> and <num_s_tuples> are not needed anymore, receive buffers are sized by the count exchange
         std::string r_folder = argv[4];
         std::string s_folder = argv[5];
+        std::string result_folder; // Join results are only kept if given
+        PartitionFunction::Method partitioning = PartitionFunction::Modulo;
+        bool pipelined = false; // Build and probe while the shuffle is in flight
+        size_t batch_tuples = batch_protocol::DEFAULT_BATCH_TUPLES; // 1 sends every tuple as its own message
+        batch_protocol::flow_control_options flow_options;
+        loader_options load_options; // Binary partitions are read through io_uring, buffered
+        std::string trace_file; // Chrome trace of all phases, if compiled with -DJOIN_TRACE; one file per process in cluster mode
+        std::string traffic_prefix; // Traffic matrix written to <prefix>.csv and <prefix>.json if given
+        Transport::Kind transport_kind = Transport::Tcp;
+        std::string config_file; // Cluster mode: this process runs node node_id only
+        int node_id = -1;
+        for (int a = 6; a < argc; ++a) {
+            std::string arg = argv[a];
+            if (arg.rfind("partition=", 0) == 0) {
+                partitioning = PartitionFunction::parse(arg.substr(10));
+            } else if (arg.rfind("transport=", 0) == 0) {
+                transport_kind = Transport::parse(arg.substr(10));
+            } else if (arg.rfind("batch=", 0) == 0) {
+                batch_tuples = std::max(1, std::stoi(arg.substr(6)));
+            } else if (arg.rfind("hwm=", 0) == 0) {
+                flow_options.window_tuples = std::stoul(arg.substr(4));
+            } else if (arg.rfind("queue=", 0) == 0) {
+                flow_options.queue_tuples = std::stoul(arg.substr(6));
+            } else if (arg.rfind("spill=", 0) == 0) {
+                flow_options.spill_directory = arg.substr(6);
+            } else if (arg.rfind("traffic=", 0) == 0) {
+                traffic_prefix = arg.substr(8);
+            } else if (arg.rfind("trace=", 0) == 0) {
+                trace_file = arg.substr(6);
+            } else if (arg == "io=uring" || arg == "io=pread") {
+                load_options.use_uring = arg == "io=uring";
+            } else if (arg == "direct=on" || arg == "direct=off") {
+                load_options.direct = arg == "direct=on";
+            } else if (arg.rfind("config=", 0) == 0) {
+                config_file = arg.substr(7);
+            } else if (arg.rfind("node=", 0) == 0) {
+                node_id = std::stoi(arg.substr(5));
+            } else if (arg == "pipeline=on" || arg == "pipeline=off") {
+                pipelined = arg == "pipeline=on";
+            } else if (arg.find('=') != std::string::npos) {
+                std::cerr << "Unknown option " << arg << ".\n" << usage;
+                return 1;
+            } else {
+                result_folder = arg;
+            }
+        }
+        // A frame may take at most half of a shared memory ring, larger batches would fail in the middle of the shuffle
+        size_t max_shm_batch = SharedMemoryRings::max_rows(sizeof(batch_protocol::batch_header));
+        if (transport_kind == Transport::SharedMemory && batch_tuples > max_shm_batch) {
+            std::cerr << "batch=" << batch_tuples << " does not fit into the shared memory rings, transport=shm allows at most " << max_shm_batch << " tuples per message.\n";
+            return 1;
+        }
+        PartitionFunction partition(partitioning, n_servers); // Routes a join key to its server
 
         auto r_files = get_all_files_in_directory(r_folder);
         auto s_files = get_all_files_in_directory(s_folder);
 
         // Ensure there are enough files for the number of servers
-        if (r_files.size() < n_servers || s_files.size() < n_servers) {
+        if (r_files.size() < static_cast<size_t>(n_servers) || s_files.size() < static_cast<size_t>(n_servers)) {
             std::cerr << "Not enough R or S files for the number of servers.\n";
             return 1;
         }
 
-        // Allocate memory for total receive buffers
-        tuples_data r_data_receive_total, s_data_receive_total;
-        allocate_mem(r_data_receive_total, num_r_tuples * n_servers);
-        allocate_mem(s_data_receive_total, num_s_tuples * n_servers);
+        // Nodes run by this process, with the coordinator and transports connecting them
+        std::vector<int> local_nodes;
+        std::unique_ptr<Coordinator> coordinator;
+        std::unique_ptr<TransportFactory> transports;
+        std::string shm_name;
+        if (config_file.empty()) {
+            for (int i = 0; i < n_servers; ++i) {
+                local_nodes.push_back(i);
+            }
+            coordinator = std::make_unique<LocalCoordinator>(n_servers);
+            transports = std::make_unique<TransportFactory>(transport_kind, n_servers);
+        } else {
+            auto config = read_cluster_config(config_file);
+            if (static_cast<int>(config.nodes.size()) != n_servers || node_id < 0 || node_id >= n_servers) {
+                std::cerr << "Cluster config " << config_file << " has " << config.nodes.size() << " nodes, need " << n_servers << " and node=<0.." << n_servers - 1 << ">.\n";
+                return 1;
+            }
+            local_nodes.push_back(node_id);
+            coordinator = std::make_unique<ClusterCoordinator>(node_id, n_servers, config.coordinator);
+            if (transport_kind == Transport::SharedMemory) {
+                // Node 0 removes rings left over by an earlier run before anybody attaches
+                shm_name = "/hash_join_" + config.coordinator.substr(config.coordinator.rfind(':') + 1);
+                if (node_id == 0) {
+                    SharedMemoryRings::remove(shm_name);
+                }
+                coordinator->barrier(node_id);
+            }
+            transports = std::make_unique<TransportFactory>(transport_kind, config.nodes, shm_name);
+        }
 
-        // Mutexes for synchronizing access to the receive buffers
-        std::mutex r_mutex, s_mutex;
+        // Partition files of the local nodes, resolved before any node starts
+        std::vector<std::string> r_paths(n_servers), s_paths(n_servers);
+        for (int i : local_nodes) {
+            std::string r_file = find_file_with_prefix(r_files, std::to_string(i + 1) + "_");
+            std::string s_file = find_file_with_prefix(s_files, std::to_string(i + 1) + "_");
+            if (r_file.empty() || s_file.empty()) {
+                std::cerr << "No " << (r_file.empty() ? "R" : "S") << " partition " << i + 1 << "_* in " << (r_file.empty() ? r_folder : s_folder) << " for server " << i << ".\n";
+                return 1;
+            }
+            r_paths[i] = r_folder + '/' + r_file;
+            s_paths[i] = s_folder + '/' + s_file;
+        }
+
+        // Join result of every local node
+        std::vector<std::vector<joined_row>> join_results(n_servers);
 
-        // Synchronization barrier to ensure all nodes are ready before proceeding
-        std::barrier sync_point(n_servers);
+        // Pipelined mode: every node joins its own tuples while they arrive
+        std::vector<std::unique_ptr<PipelinedJoin>> pipelines(n_servers);
+        if (pipelined) {
+            for (int i : local_nodes) {
+                pipelines[i] = std::make_unique<PipelinedJoin>(n_servers);
+            }
+        }
+        std::vector<node_statistics> statistics; // Of all nodes, filled by the first local node
+        std::vector<std::vector<link_traffic>> traffic_links;
 
         // Start a thread for each node
         std::vector<std::thread> nodes;
-        for (int i = 0; i < n_servers; ++i) {
-            nodes.emplace_back(node_thread, i, n_servers, r_files, s_files, r_folder, s_folder,
-                               std::ref(r_data_receive_total), std::ref(s_data_receive_total), std::ref(r_mutex), std::ref(s_mutex), std::ref(sync_point));
+        for (int i : local_nodes) {
+            nodes.emplace_back(node_thread, i, n_servers, std::ref(*coordinator), std::ref(*transports), std::cref(partition), r_paths[i], s_paths[i],
+                               std::ref(join_results[i]), pipelines[i].get(), batch_tuples, std::cref(flow_options), std::cref(load_options),
+                               i == local_nodes[0] ? &statistics : nullptr, i == local_nodes[0] ? &traffic_links : nullptr);
         }
 
         for (auto& node : nodes) {
             node.join();
         }
+        if (statistics.size() != static_cast<size_t>(n_servers)) {
+            std::cerr << "A node failed.\n";
+            return 1;
+        }
+        if (!shm_name.empty() && node_id == 0) {
+            SharedMemoryRings::remove(shm_name);
+        }
+        trace::write_requested(config_file.empty() || trace_file.empty() ? trace_file : trace_file + ".node" + std::to_string(node_id));
+        double shuffle_time = 0; // Slowest node
+        double end_to_end_time = 0;
+        size_t total_sent = 0;
+        size_t n_joined = 0;
+        for (const auto& node : statistics) {
+            shuffle_time = std::max(shuffle_time, node.shuffle_seconds);
+            end_to_end_time = std::max(end_to_end_time, node.shuffle_seconds + node.join_seconds);
+            total_sent += node.tuples_sent;
+            n_joined += node.rows;
+        }
 
-        // Perform the join operation on the received data
-        // TODO: Implement the join logic using r_data_receive_total and s_data_receive_total
+        // Every node has its own result
+        for (int i : local_nodes) {
+            std::cout << "Node " << i << " load took " << statistics[i].load_seconds << " seconds, shuffle" << (pipelined ? " and join" : "") << " " << statistics[i].shuffle_seconds << " seconds";
+            if (!pipelined) {
+                std::cout << ", join " << statistics[i].join_seconds << " seconds";
+            }
+            std::cout << " (" << statistics[i].r_tuples << " R, " << statistics[i].s_tuples << " S tuples, " << statistics[i].rows << " rows).\n";
+            if (!result_folder.empty()) {
+                fs::create_directories(result_folder);
+                ResultWriter writer(result_file_name(result_folder, i));
+                writer.write(join_results[i]);
+                writer.close();
+            }
+        }
+
+        // Only node 0 reports the totals in cluster mode
+        if (local_nodes[0] == 0) {
+            std::cout << "Shuffle throughput: " << total_sent / shuffle_time << " tuples/s (" << total_sent << " tuples sent, " << batch_tuples << " tuples per message, " << Transport::name(transport_kind) << ").\n";
+            std::cout << "Joined " << n_joined << " rows." << std::endl;
+            TrafficMatrix traffic(traffic_links);
+            traffic.print_summary(std::cout);
+            if (!traffic_prefix.empty()) {
+                traffic.write_csv(traffic_prefix + ".csv");
+                traffic.write_json(traffic_prefix + ".json", "hash_join", Transport::name(transport_kind));
+                std::cout << "Traffic matrix written to " << traffic_prefix << ".csv and " << traffic_prefix << ".json" << std::endl;
+            }
+            std::cout << "End-to-end shuffle and join took " << end_to_end_time << " seconds (" << (pipelined ? "pipelined" : "join after the shuffle of each node") << ").\n";
+        }
 
     } catch (const std::exception& e) {
         std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
     }
 
     return 0;
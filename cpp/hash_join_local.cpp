@@ -2,145 +2,100 @@
 #include <thread>
 #include <string>
 #include <utility>
-#include <fstream>
 #include <vector>
 #include <filesystem>
 #include "./utils/helper_functions.h"
+#include "./utils/local_joins.h"
+#include "./utils/async_loader.h"
+#include "./utils/trace.h"
+#include <numeric>
 #include <algorithm>
 
-int copy_local_data_s_to_receive_buffers(int my_id, const tuples_data& s_data_send, vector<tuples_data>& s_data_receive, const vector<tuple<uint32_t, size_t, size_t>>& memory_locations) {
-
-    int i = 0;
-    int n_tuples_copied = 0;
-
-    // Iterate over memory locations to copy data
-    for (const auto& [server_id, offset, count] : memory_locations) {
-        // Check if offset and count are within the bounds of s_data_send
-        if (offset + count > s_data_send.tuples.size()) {
-            throw out_of_range("Offset and count exceed the size of s_data_send");
-        }
-        // Copy the data from s_data_send to the beginning of s_data_receive
-        copy(s_data_send.tuples.begin() + offset, s_data_send.tuples.begin() + offset + count, s_data_receive[i].tuples.begin() + s_data_receive[i].filled_rows);
-        s_data_receive[i].filled_rows += count;
-        if(my_id != i){ // Increment counter only if the data is sent to a different server
-            n_tuples_copied += count;
-        }
-        i++;
-    }
-
-    return n_tuples_copied;
-}
-
-int copy_local_data_r_to_receive_buffers(int my_id, const tuples_data& r_data_send, vector<tuples_data>& r_data_receive) {
-
-    int i = 0;
-    int n_tuples_copied = 0;
-
-    int length = r_data_send.filled_rows;
-
-    for(int i = 0; i < r_data_send.filled_rows; i++){
-        int server_idx = r_data_send.tuples[i].row_S - 1; // Determine target server index
-        int pos = r_data_receive[server_idx].filled_rows; // Determine position in target buffer
-        r_data_receive[server_idx].tuples[pos] = r_data_send.tuples[i];
-        r_data_receive[server_idx].filled_rows++;
-        if(my_id != server_idx){
-            n_tuples_copied;
-        }
-    }
-
-    return n_tuples_copied;
-}
-
-// Function to allocate memory for a vector of vectors
-void allocate_mem_dual_vec(vector<tuples_data>& vec, size_t outer_size, size_t inner_size) {
-    // Resize the outer vector to the required size
-    vec.resize(outer_size);
-
-    // Resize each inner vector to the required size
-    for (size_t i = 0; i < outer_size; ++i) {
-        vec[i].tuples.resize(inner_size);
-        vec[i].filled_rows = 0;
-    }
-}
-
 int main(int argc, char* argv[]) {
     try {
-        if (argc != 6) {
-            cerr << "Usage: ./server <n_servers> <num_r_tuples> <num_s_tuples> <R_folder> <S_folder>\n";
+        const char* usage = "Usage: ./hash_join_local <n_servers> <num_r_tuples> <num_s_tuples> <R_folder> <S_folder> [result_folder] [partition=modulo|multiplicative|crc32|radix] [balance=on|off] [io=uring|pread] [direct=on|off] [counters=on|off] [trace=<file>]\n";
+        if (argc < 6 || argc > 13) {
+            cerr << usage;
             return 1;
         }
 
         // Get Arguments
         int n_servers = atoi(argv[1]);
-        int num_r_tuples = atoi(argv[2]);
-        int num_s_tuples = atoi(argv[3]);
+        size_t num_r_tuples = atoll(argv[2]);
+        size_t num_s_tuples = atoll(argv[3]);
         string r_folder = argv[4];
         string s_folder = argv[5];
+        LocalJoin::options join_options;
+        loader_options load_options; // Binary partitions are read through io_uring, buffered
+        std::string trace_file; // Chrome trace of all phases, if compiled with -DJOIN_TRACE
+        bool counters = false; // Hardware counters of every phase
+        for (int a = 6; a < argc; ++a) {
+            std::string arg = argv[a];
+            if (arg.rfind("partition=", 0) == 0) {
+                join_options.partitioning = PartitionFunction::parse(arg.substr(10));
+            } else if (arg.rfind("trace=", 0) == 0) {
+                trace_file = arg.substr(6);
+            } else if (arg == "counters=on" || arg == "counters=off") {
+                counters = arg == "counters=on";
+            } else if (arg == "io=uring" || arg == "io=pread") {
+                load_options.use_uring = arg == "io=uring";
+            } else if (arg == "direct=on" || arg == "direct=off") {
+                load_options.direct = arg == "direct=on";
+            } else if (arg == "balance=on" || arg == "balance=off") {
+                join_options.balance = arg == "balance=on";
+            } else if (arg.find('=') != std::string::npos) {
+                cerr << "Unknown option " << arg << ".\n" << usage;
+                return 1;
+            } else {
+                join_options.result_folder = arg;
+            }
+        }
 
-        vector<tuples_data> r_data_send;
-        allocate_mem_dual_vec(r_data_send, n_servers, num_r_tuples);
-        vector<tuples_data> s_data_send;
-        allocate_mem_dual_vec(s_data_send, n_servers, num_s_tuples);
-        vector<tuples_data> r_data_receive;
-        allocate_mem_dual_vec(r_data_receive, n_servers, num_r_tuples);
-        vector<tuples_data> s_data_receive;
-        allocate_mem_dual_vec(s_data_receive, n_servers, num_s_tuples);
-
-        uint32_t num_s_tuples_sent = 0;
-        uint32_t num_r_tuples_sent = 0;
-
-        // Process each server
+        // Find the partition files of every server before the servers start
+        auto r_files = get_all_files_in_directory(r_folder);
+        auto s_files = get_all_files_in_directory(s_folder);
+        vector<string> r_file(n_servers), s_file(n_servers);
         for(int i = 0; i < n_servers; i++ ){
-
-            // Get and find files
-            auto r_files = get_all_files_in_directory(r_folder);
-            auto s_files = get_all_files_in_directory(s_folder);
-
-            string r_file = find_file_with_prefix(r_files, to_string(i + 1));
-            string s_file = find_file_with_prefix(s_files, to_string(i + 1));
-
-            // Read local data to this server
-            auto r_data_send_tmp = read_data(r_folder + '/' + r_file);
-            auto s_data_send_tmp = read_data(s_folder + '/' + s_file);
-
-            r_data_send[i].tuples = r_data_send_tmp;
-            r_data_send[i].filled_rows = r_data_send_tmp.size();
-            r_data_send[i].filled_rows = r_data_send_tmp.size();
-            s_data_send[i].tuples = s_data_send_tmp;
-            s_data_send[i].filled_rows = s_data_send_tmp.size();
-
-            // Process local data
-            calculate_receiver_and_store(s_data_send[i].tuples, n_servers); // Stores server id in third col
-            sort(s_data_send[i].tuples.begin(), s_data_send[i].tuples.end(), compare_by_row_S); // Sort by third col
-            // Get memory locations and lengths of specific server data
-            auto  memory_locations = get_first_occurrence_and_count(s_data_send[i].tuples);
-
-            calculate_receiver_and_store(r_data_send[i].tuples, n_servers); // Stores server id in third col
-            num_s_tuples_sent += copy_local_data_s_to_receive_buffers(i, s_data_send[i], s_data_receive, memory_locations);
-            num_r_tuples_sent += copy_local_data_r_to_receive_buffers(i, r_data_send[i], r_data_receive);
+            r_file[i] = find_file_with_prefix(r_files, to_string(i + 1) + "_");
+            s_file[i] = find_file_with_prefix(s_files, to_string(i + 1) + "_");
+            if (r_file[i].empty() || s_file[i].empty()) {
+                cerr << "No " << (r_file[i].empty() ? "R" : "S") << " partition " << i + 1 << "_* in "
+                     << (r_file[i].empty() ? r_folder : s_folder) << " for server " << i << ".\n";
+                return 1;
+            }
         }
 
-        // Open a file to save execution times
-        std::ofstream output_file("execution_times.txt");
-        if (!output_file.is_open()) {
-            std::cerr << "Failed to open file for writing execution times.\n";
-            return 1;
+        // Every simulated server runs on its own thread, the phases are separated by barriers
+        LocalHashJoin hash_join(n_servers, join_options);
+        LocalEngine engine(n_servers);
+        if (counters) {
+            engine.enable_counters();
         }
-        for(int i = 0; i < n_servers; i++){
-            auto start = std::chrono::high_resolution_clock::now(); // Start time
-            auto r_join_s = inner_join(r_data_receive[i], s_data_receive[i]);
-            auto finish = std::chrono::high_resolution_clock::now(); // End time
-
-            // Calculate and print execution time
-            std::chrono::duration<double> elapsed = finish - start;
-            std::cout << "Server " << i << " inner join took " << elapsed.count() << " seconds.\n";
+        hash_join.run(engine, [&](int i, tuples_data& r, tuples_data& s) {
+            // Both files through one ring of this server, the servers load concurrently
+            auto local_data = load_partitions({r_folder + '/' + r_file[i], s_folder + '/' + s_file[i]}, load_options);
+            r.tuples = std::move(local_data[0]);
+            s.tuples = std::move(local_data[1]);
+        });
+
+        size_t total_r_tuples = hash_join.r_tuples(), total_s_tuples = hash_join.s_tuples();
+        if (total_r_tuples != num_r_tuples || total_s_tuples != num_s_tuples) {
+            cerr << "Warning: Read " << total_r_tuples << " R and " << total_s_tuples << " S tuples, expected "
+                 << num_r_tuples << " and " << num_s_tuples << ".\n";
+        }
+        cout << "Sent " << hash_join.s_sent() << " S tuples and " << hash_join.r_sent() << " R tuples to other servers.\n";
 
-            // Save the execution time to the file
-            output_file << "Server " << i << ": " << elapsed.count() << " seconds\n";
-        }  
-    
+        for(int i = 0; i < n_servers; i++){
+            double elapsed = engine.time(i, LocalEngine::Join);
+            std::cout << "Server " << i << " inner join took " << elapsed << " seconds (" << hash_join.join_size(i) << " rows).\n";
+        }
+        engine.print_times(std::cout);
+        engine.print_counters(std::cout, total_r_tuples + total_s_tuples);
+        trace::write_requested(trace_file);
+        hash_join.print_balance_report(std::cout, engine);
     } catch (exception& e) {
         cerr << "Exception: " << e.what() << "\n";
+        return 1;
     }
 
     return 0;
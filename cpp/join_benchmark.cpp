@@ -0,0 +1,346 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <numeric>
+#include <memory>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "./utils/helper_functions.h"
+#include "./utils/SpaceSaving.h"
+#include "./utils/partition_function.h"
+#include "./utils/radix_scatter.h"
+#include "./utils/skew_planner.h"
+#include "./utils/zipf_generator.h"
+#include "./utils/partitioned_writer.h"
+#include "./utils/async_loader.h"
+#include "./utils/benchmark.h"
+
+extern char** environ;
+
+// Micro-benchmarks of the join components and macro-benchmarks of the local joins, swept over
+// n_servers, |R|, |S| and the Zipf exponent of S. R holds every key 1..|R| once, S is drawn with
+// the generator of gen_R_S (seed 9), so the inputs match the generated data sets.
+
+const uint64_t SEED = 9;
+
+// In-memory R and S of one (|R|, |S|, alpha), shared by all benchmarks of that combination
+struct dataset {
+    tuples_data r;
+    tuples_data s;
+};
+
+// Input files of the benchmarks, removed at the end of the run
+class Workspace {
+public:
+    Workspace() : root(fs::temp_directory_path() / ("join_benchmark_" + std::to_string(getpid()))) { fs::create_directories(root); }
+    ~Workspace() {
+        std::error_code ignored;
+        fs::remove_all(root, ignored);
+    }
+
+    const dataset& data(const benchmark::parameters& p) {
+        auto key = std::make_tuple(p.r_tuples, p.s_tuples, p.alpha);
+        auto& entry = datasets[key];
+        if (!entry) {
+            entry = std::make_unique<dataset>();
+            ZipfGenerator zipf(SEED, p.alpha, p.r_tuples);
+            entry->r.tuples.resize(p.r_tuples);
+            for (uint64_t i = 0; i < p.r_tuples; ++i) {
+                entry->r.tuples[i] = {static_cast<uint32_t>(i + 1), static_cast<uint32_t>(i + 1), 0};
+            }
+            entry->s.tuples.resize(p.s_tuples);
+            for (uint64_t i = 0; i < p.s_tuples; ++i) {
+                entry->s.tuples[i] = {zipf(i), static_cast<uint32_t>(i + 1), 0};
+            }
+            entry->r.filled_rows = entry->r.tuples.size();
+            entry->s.filled_rows = entry->s.tuples.size();
+        }
+        return *entry;
+    }
+
+    // R and S partitioned for n_servers (n_servers 1 for a single file) in the layout of gen_R_S;
+    // returns the R and S folders
+    std::pair<std::string, std::string> partitions(const benchmark::parameters& p, int n_servers, bool binary) {
+        std::ostringstream name;
+        name << p.r_tuples << '_' << p.s_tuples << '_' << p.alpha << '_' << n_servers << (binary ? "_bin" : "_txt");
+        fs::path dir = root / name.str();
+        std::string r_dir = (dir / ("R_" + std::to_string(p.r_tuples))).string();
+        std::string s_dir = (dir / ("S_" + std::to_string(p.s_tuples))).string();
+        if (!fs::exists(dir)) {
+            const auto& d = data(p);
+            unsigned n_threads = std::max(1u, std::thread::hardware_concurrency());
+            partitioned_writer::write_partitioned(r_dir, p.r_tuples, n_servers, binary, n_threads, [&](uint64_t i) { return d.r.tuples[i].join_val; });
+            partitioned_writer::write_partitioned(s_dir, p.s_tuples, n_servers, binary, n_threads, [&](uint64_t i) { return d.s.tuples[i].join_val; });
+        }
+        return {r_dir, s_dir};
+    }
+
+    std::string file(const std::string& folder, int partition, bool binary) const { return partitioned_writer::partition_file_name(folder, partition, binary); }
+
+private:
+    fs::path root;
+    std::map<std::tuple<uint64_t, uint64_t, double>, std::unique_ptr<dataset>> datasets;
+};
+
+// Runs binary with args (output discarded) and throws if it fails
+void run_process(const std::string& binary, const std::vector<std::string>& args) {
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(binary.c_str()));
+    for (const auto& a : args) {
+        argv.push_back(const_cast<char*>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid;
+    int error = posix_spawn(&pid, binary.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        throw std::runtime_error("Could not start " + binary + ": " + strerror(error));
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error(binary + " failed");
+    }
+}
+
+void register_benchmarks(benchmark::Registry& registry, Workspace& workspace, const std::string& bin_dir) {
+    using benchmark::parameters;
+
+    registry.add("inner_join", "Build on R, probe S (helper_functions inner_join); items: R + S tuples", benchmark::Sizes | benchmark::Alpha,
+                 [&](const parameters& p) -> benchmark::body {
+                     const auto& d = workspace.data(p);
+                     return [&d]() {
+                         auto rows = inner_join(d.r, d.s);
+                         return static_cast<uint64_t>(d.r.filled_rows + d.s.filled_rows);
+                     };
+                 });
+
+    // Routing as calculate_receiver_and_store of test/cpp/helper_functions.cpp: destination server of every S tuple
+    for (auto method : {PartitionFunction::Modulo, PartitionFunction::Multiplicative, PartitionFunction::Crc32, PartitionFunction::Radix}) {
+        registry.add("route_" + PartitionFunction::name(method), "Destination of every S tuple, stored in row_S; items: S tuples", benchmark::All,
+                     [&, method](const parameters& p) -> benchmark::body {
+                         auto s = std::make_shared<tuple_buffer>(workspace.data(p).s.tuples);
+                         PartitionFunction partition(method, p.n_servers);
+                         return [s, partition]() {
+                             for (auto& row : *s) {
+                                 row.row_S = partition(row.join_val) + 1;
+                             }
+                             return static_cast<uint64_t>(s->size());
+                         };
+                     });
+    }
+
+    registry.add("histogram", "Tuples of S per destination (radix_scatter); items: S tuples", benchmark::All, [&](const parameters& p) -> benchmark::body {
+        const auto& d = workspace.data(p);
+        PartitionFunction partition(PartitionFunction::Modulo, p.n_servers);
+        return [&d, partition, n = p.n_servers]() {
+            auto counts = radix_scatter::histogram(d.s.tuples, d.s.tuples.size(), n, [&](const joined_row& t) { return static_cast<int>(partition(t.join_val)); });
+            return std::accumulate(counts.begin(), counts.end(), uint64_t(0));
+        };
+    });
+
+    registry.add("counting_sort", "Group S by destination: histograms, prefix sums and scatter (radix_scatter); items: S tuples", benchmark::All,
+                 [&](const parameters& p) -> benchmark::body {
+                     // Sorts in place, every run starts again from the unsorted input
+                     const auto& input = workspace.data(p).s.tuples;
+                     auto s = std::make_shared<tuple_buffer>(input);
+                     PartitionFunction partition(PartitionFunction::Modulo, p.n_servers);
+                     auto sort = [s, partition, n = p.n_servers]() {
+                         radix_scatter::counting_sort(*s, s->size(), n, [&](const joined_row& t) { return static_cast<int>(partition(t.join_val)); });
+                         return static_cast<uint64_t>(s->size());
+                     };
+                     return {sort, [s, &input]() { std::copy(input.begin(), input.end(), s->begin()); }};
+                 });
+
+    registry.add("detect_heavy_hitters", "SpaceSaving (sorted array) on a 1% sample of S, sized by the skew planner as in flow_join_local; items: sampled keys",
+                 benchmark::All, [&](const parameters& p) -> benchmark::body {
+                     auto sample = std::make_shared<std::vector<int>>();
+                     const auto& s = workspace.data(p).s.tuples;
+                     for (size_t j = 0; j < s.size(); j += 100) {
+                         sample->push_back(s[j].join_val);
+                     }
+                     SkewPlanner planner(p.n_servers, SkewPlanner::parameters());
+                     return [sample, planner]() {
+                         SpaceSaving ss(planner.capacity(sample->size()), SpaceSaving::SortedArray);
+                         ss.process(*sample);
+                         auto heavy_hitters = ss.get_heavy_hitters(planner.threshold(sample->size()));
+                         return static_cast<uint64_t>(sample->size());
+                     };
+                 });
+
+    // Former SpaceSaving_update_rates: update rate of the data structures with k = 128 on all keys of S
+    const std::pair<const char*, SpaceSaving::DataStructure> structures[] = {
+        {"spacesaving_hash_table", SpaceSaving::HashTableOnly}, {"spacesaving_heap", SpaceSaving::Heap}, {"spacesaving_sorted_array", SpaceSaving::SortedArray}};
+    for (const auto& [name, structure] : structures) {
+        registry.add(name, "SpaceSaving updates with k = 128 over the keys of S; items: updates", benchmark::Sizes | benchmark::Alpha,
+                     [&, structure](const parameters& p) -> benchmark::body {
+                         auto stream = std::make_shared<std::vector<int>>();
+                         for (const auto& t : workspace.data(p).s.tuples) {
+                             stream->push_back(t.join_val);
+                         }
+                         return [stream, structure]() {
+                             SpaceSaving ss(128, structure);
+                             ss.process(*stream);
+                             return static_cast<uint64_t>(stream->size());
+                         };
+                     });
+    }
+
+    // Parsing of one S file with all rows
+    registry.add("parse_text", "read_data of a text partition; items: tuples", benchmark::Sizes | benchmark::Alpha, [&](const parameters& p) -> benchmark::body {
+        std::string file = workspace.file(workspace.partitions(p, 1, false).second, 1, false);
+        return [file]() { return static_cast<uint64_t>(read_data(file).size()); };
+    });
+    registry.add("parse_binary", "read_data of a binary partition; items: tuples", benchmark::Sizes | benchmark::Alpha, [&](const parameters& p) -> benchmark::body {
+        std::string file = workspace.file(workspace.partitions(p, 1, true).second, 1, true);
+        return [file]() { return static_cast<uint64_t>(read_data(file).size()); };
+    });
+    for (bool uring : {true, false}) {
+        registry.add(uring ? "load_uring" : "load_pread", "load_partitions of a binary partition (async_loader); items: tuples", benchmark::Sizes | benchmark::Alpha,
+                     [&, uring](const parameters& p) -> benchmark::body {
+                         std::string file = workspace.file(workspace.partitions(p, 1, true).second, 1, true);
+                         loader_options options;
+                         options.use_uring = uring;
+                         return [file, options]() { return static_cast<uint64_t>(load_partitions({file}, options)[0].size()); };
+                     });
+    }
+
+    // End to end: the local join binaries on binary partitions, including process start and load
+    for (const char* join : {"flow_join_local", "hash_join_local"}) {
+        registry.add(join, "End-to-end run of ./" + std::string(join) + " (from bin=<dir>); items: R + S tuples", benchmark::All,
+                     [&, join](const parameters& p) -> benchmark::body {
+                         std::string binary = (fs::path(bin_dir) / join).string();
+                         if (access(binary.c_str(), X_OK) != 0) {
+                             throw std::runtime_error(binary + " not found, build it or pass bin=<dir>");
+                         }
+                         auto [r_dir, s_dir] = workspace.partitions(p, p.n_servers, true);
+                         std::vector<std::string> args = {std::to_string(p.n_servers), std::to_string(p.r_tuples), std::to_string(p.s_tuples), r_dir, s_dir};
+                         return [binary, args, n = p.r_tuples + p.s_tuples]() {
+                             run_process(binary, args);
+                             return n;
+                         };
+                     });
+    }
+}
+
+template <typename T>
+std::vector<T> parse_list(const std::string& values, T (*convert)(const std::string&)) {
+    std::vector<T> result;
+    std::stringstream stream(values);
+    std::string value;
+    while (std::getline(stream, value, ',')) {
+        result.push_back(convert(value));
+    }
+    if (result.empty()) {
+        throw std::invalid_argument("Empty list: " + values);
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        benchmark::sweep grid;
+        std::string filter;
+        std::string csv_file; // CSV goes to stdout if not given
+        std::string bin_dir = fs::path(argv[0]).parent_path().string();
+        bool list = false;
+        for (int a = 1; a < argc; ++a) {
+            std::string arg = argv[a];
+            if (arg.rfind("filter=", 0) == 0) {
+                filter = arg.substr(7);
+            } else if (arg.rfind("servers=", 0) == 0) {
+                grid.n_servers = parse_list<int>(arg.substr(8), [](const std::string& v) { return std::stoi(v); });
+            } else if (arg.rfind("r=", 0) == 0) {
+                grid.r_tuples = parse_list<uint64_t>(arg.substr(2), [](const std::string& v) { return static_cast<uint64_t>(std::stoull(v)); });
+            } else if (arg.rfind("s=", 0) == 0) {
+                grid.s_tuples = parse_list<uint64_t>(arg.substr(2), [](const std::string& v) { return static_cast<uint64_t>(std::stoull(v)); });
+            } else if (arg.rfind("alpha=", 0) == 0) {
+                grid.alpha = parse_list<double>(arg.substr(6), [](const std::string& v) { return std::stod(v); });
+            } else if (arg.rfind("warmup=", 0) == 0) {
+                grid.warmups = std::stoi(arg.substr(7));
+            } else if (arg.rfind("repetitions=", 0) == 0) {
+                grid.repetitions = std::stoi(arg.substr(12));
+            } else if (arg == "counters=on" || arg == "counters=off") {
+                grid.counters = arg == "counters=on";
+            } else if (arg.rfind("csv=", 0) == 0) {
+                csv_file = arg.substr(4);
+            } else if (arg.rfind("bin=", 0) == 0) {
+                bin_dir = arg.substr(4);
+            } else if (arg == "list") {
+                list = true;
+            } else {
+                std::cerr << "Usage: ./join_benchmark [list] [filter=<name part>] [servers=<n,...>] [r=<tuples,...>] [s=<tuples,...>] [alpha=<exponent,...>]\n"
+                          << "       [warmup=<runs, default 1>] [repetitions=<runs, default 5>] [counters=on|off] [csv=<file>]\n"
+                          << "       [bin=<directory of the join binaries>]\n";
+                return 1;
+            }
+        }
+        if (bin_dir.empty()) {
+            bin_dir = ".";
+        }
+
+        Workspace workspace;
+        benchmark::Registry registry;
+        register_benchmarks(registry, workspace, bin_dir);
+        if (list) {
+            for (const auto& b : registry.all()) {
+                std::cout << b.name << ": " << b.description << "\n";
+            }
+            return 0;
+        }
+
+        auto selected = registry.matching(filter);
+        if (selected.empty()) {
+            std::cerr << "No benchmark matches " << filter << ".\n";
+            return 1;
+        }
+        std::ofstream csv;
+        if (!csv_file.empty()) {
+            csv.open(csv_file);
+            if (!csv.is_open()) {
+                std::cerr << "Could not open " << csv_file << ".\n";
+                return 1;
+            }
+        }
+        std::ostream& out = csv_file.empty() ? std::cout : csv;
+        benchmark::write_csv_header(out);
+        int failed = 0;
+        for (const auto* b : selected) {
+            try {
+                benchmark::run(*b, grid, [&](const benchmark::result& r) {
+                    benchmark::write_csv_row(out, r);
+                    out.flush();
+                    if (!csv_file.empty()) {
+                        std::cout << r.name << " (" << r.params.n_servers << " servers, |R| " << r.params.r_tuples << ", |S| " << r.params.s_tuples
+                                  << ", alpha " << r.params.alpha << "): median " << r.seconds.median << " s, p90 " << r.seconds.p90 << " s, "
+                                  << r.items / r.seconds.median << " items/s";
+                        if (grid.counters) {
+                            std::cout << ", ";
+                            r.counters.print(std::cout, r.items);
+                        }
+                        std::cout << std::endl;
+                    }
+                });
+            } catch (const std::exception& e) {
+                std::cerr << b->name << " skipped: " << e.what() << "\n";
+                failed++;
+            }
+        }
+        return failed == 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+}
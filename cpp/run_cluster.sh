@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# Starts one process per node of a cluster config on this host and waits for all of them.
+# The output of every node is prefixed with its id, the exit code is that of the first failed node.
+
+if [ "$#" -lt 3 ]; then
+    echo "Usage: $0 <cluster config> <binary> <arguments of the binary...>"
+    echo "Example: $0 cluster_local.cfg ./flow_join_distributed 4 1000 100003 R_1000 S_zipf_9_1p25_1000_100003 result"
+    exit 1
+fi
+
+config=$1
+binary=$2
+shift 2
+
+# Nodes are the lines that are neither comments nor the coordinator
+n_nodes=$(sed -e 's/#.*//' "$config" | awk 'NF > 0 && $1 != "coordinator"' | wc -l)
+if [ "$n_nodes" -eq 0 ]; then
+    echo "No nodes in $config"
+    exit 1
+fi
+
+pids=()
+for ((id = 0; id < n_nodes; id++)); do
+    # Process substitution instead of a pipe, so that $! is the node and not sed
+    "$binary" "$@" config="$config" node=$id > >(sed -u "s/^/[node $id] /") 2>&1 &
+    pids+=($!)
+done
+
+status=0
+for pid in "${pids[@]}"; do
+    wait "$pid"
+    code=$?
+    if [ "$status" -eq 0 ]; then
+        status=$code
+    fi
+done
+wait # Let sed print the last lines
+exit $status
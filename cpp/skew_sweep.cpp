@@ -0,0 +1,353 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <type_traits>
+#include <sstream>
+#include <tuple>
+#include <algorithm>
+#include <unordered_map>
+#include "./utils/helper_functions.h"
+#include "./utils/local_joins.h"
+#include "./utils/zipf_generator.h"
+#include "./utils/partitioned_writer.h"
+#include "./utils/async_loader.h"
+
+// Skew sweep: runs the flow join and the hash join in this process over a grid of Zipf exponent x
+// n_servers x |R| x |S| and writes one CSV row per join and configuration: the makespan and the
+// phase makespans, the load of every server and its imbalance, the tuples shipped and the recall of
+// the heavy hitter detection. R holds every key 1..|R| once and S is drawn with the generator of
+// gen_R_S (seed 9), or both are loaded from the partitions gen_R_S wrote to data=<dir>.
+
+const uint64_t SEED = 9;
+
+struct configuration {
+    int n_servers;
+    uint64_t r_tuples;
+    uint64_t s_tuples;
+    std::string alpha; // As given, also names the S folder of gen_R_S
+};
+
+// Metrics of one run of a join
+struct run_result {
+    double makespan = 0; // Detect, shuffle and join phases, i.e. without loading
+    double phase_seconds[LocalEngine::N_PHASES] = {};
+    std::vector<size_t> server_load; // R and S tuples every server joins
+    double load_imbalance = 0;       // Max / average of server_load
+    double join_time_imbalance = 0;  // Max / average join phase time
+    size_t r_shipped = 0;
+    size_t s_shipped = 0;
+    size_t join_rows = 0;
+    bool detects = false; // Flow join: heavy hitter columns are filled
+    size_t true_heavy_hitters = 0;
+    size_t detected_heavy_hitters = 0;
+    double recall = 0;
+};
+
+template <typename T>
+double imbalance(const std::vector<T>& values) {
+    double sum = 0, max_value = 0;
+    for (auto v : values) {
+        sum += v;
+        max_value = std::max<double>(max_value, v);
+    }
+    return sum > 0 ? max_value * values.size() / sum : 1.0;
+}
+
+// Inputs of every configuration: generated in memory once per (|R|, |S|, alpha), or the partition
+// files of gen_R_S under data_dir
+class Inputs {
+public:
+    explicit Inputs(const std::string& data_dir) : data_dir(data_dir) {}
+
+    partition_loader loader(const configuration& c, const loader_options& load_options) {
+        if (!data_dir.empty()) {
+            return file_loader(c, load_options);
+        }
+        auto key = std::make_tuple(c.r_tuples, c.s_tuples, c.alpha);
+        if (key != generated_key) {
+            generate(c);
+            generated_key = key;
+        }
+        int n_servers = c.n_servers;
+        return [this, n_servers](int i, tuples_data& r, tuples_data& s) {
+            copy_partition(r_data, n_servers, i, r);
+            copy_partition(s_data, n_servers, i, s);
+        };
+    }
+
+private:
+    std::string data_dir;
+    std::tuple<uint64_t, uint64_t, std::string> generated_key;
+    tuple_buffer r_data, s_data;
+
+    void generate(const configuration& c) {
+        ZipfGenerator zipf(SEED, std::stod(c.alpha), c.r_tuples);
+        r_data.resize(c.r_tuples);
+        for (uint64_t i = 0; i < c.r_tuples; ++i) {
+            r_data[i] = {static_cast<uint32_t>(i + 1), static_cast<uint32_t>(i + 1), 0};
+        }
+        s_data.resize(c.s_tuples);
+        for (uint64_t i = 0; i < c.s_tuples; ++i) {
+            s_data[i] = {zipf(i), static_cast<uint32_t>(i + 1), 0};
+        }
+    }
+
+    // Rows of partition i as gen_R_S splits them
+    static void copy_partition(const tuple_buffer& data, int n_servers, int i, tuples_data& out) {
+        auto [begin, end] = partitioned_writer::partition_range(data.size(), n_servers, i);
+        out.tuples.assign(data.begin() + begin, data.begin() + end);
+    }
+
+    partition_loader file_loader(const configuration& c, const loader_options& load_options) {
+        std::string alpha = c.alpha;
+        std::replace(alpha.begin(), alpha.end(), '.', 'p');
+        std::string r_folder = data_dir + "/R_" + std::to_string(c.r_tuples);
+        std::string s_folder = data_dir + "/S_zipf_" + std::to_string(SEED) + '_' + alpha + '_' + std::to_string(c.r_tuples) + '_' + std::to_string(c.s_tuples);
+        auto r_files = get_all_files_in_directory(r_folder);
+        auto s_files = get_all_files_in_directory(s_folder);
+        if (r_files.size() != static_cast<size_t>(c.n_servers) || s_files.size() != static_cast<size_t>(c.n_servers)) {
+            throw std::runtime_error(r_folder + " and " + s_folder + " need " + std::to_string(c.n_servers) + " partitions each");
+        }
+        std::vector<std::string> paths;
+        for (int i = 0; i < c.n_servers; ++i) {
+            std::string r_file = find_file_with_prefix(r_files, std::to_string(i + 1) + "_");
+            std::string s_file = find_file_with_prefix(s_files, std::to_string(i + 1) + "_");
+            if (r_file.empty() || s_file.empty()) {
+                throw std::runtime_error("Partition " + std::to_string(i + 1) + " missing in " + r_folder + " or " + s_folder);
+            }
+            paths.push_back(r_folder + '/' + r_file);
+            paths.push_back(s_folder + '/' + s_file);
+        }
+        return [paths, load_options](int i, tuples_data& r, tuples_data& s) {
+            auto local_data = load_partitions({paths[2 * i], paths[2 * i + 1]}, load_options);
+            r.tuples = std::move(local_data[0]);
+            s.tuples = std::move(local_data[1]);
+        };
+    }
+};
+
+// Keys whose exact S frequency reaches the detection threshold, and how many of them were detected
+void heavy_hitter_recall(const LocalFlowJoin& join, int n_servers, run_result& result) {
+    std::unordered_map<int, size_t> counts;
+    for (int i = 0; i < n_servers; ++i) {
+        const auto& s = join.s_partition(i);
+        for (int j = 0; j < s.filled_rows; ++j) {
+            counts[s.tuples[j].join_val]++;
+        }
+    }
+    double min_count = join.threshold() * join.s_tuples();
+    const auto& detected = join.detected_heavy_hitters();
+    size_t found = 0;
+    for (const auto& [key, count] : counts) {
+        if (count >= min_count) {
+            result.true_heavy_hitters++;
+            found += detected.count(key);
+        }
+    }
+    result.detects = true;
+    result.detected_heavy_hitters = detected.size();
+    result.recall = result.true_heavy_hitters > 0 ? static_cast<double>(found) / result.true_heavy_hitters : 1.0;
+}
+
+template <typename Join>
+run_result run_join(const configuration& c, const LocalJoin::options& join_options, const partition_loader& loader) {
+    Join join(c.n_servers, join_options);
+    LocalEngine engine(c.n_servers);
+    join.run(engine, loader);
+
+    run_result result;
+    for (int p = 0; p < LocalEngine::N_PHASES; ++p) {
+        result.phase_seconds[p] = engine.phase_makespan(static_cast<LocalEngine::Phase>(p));
+        result.makespan += p == LocalEngine::Load ? 0 : result.phase_seconds[p];
+    }
+    std::vector<double> join_times(c.n_servers);
+    for (int i = 0; i < c.n_servers; ++i) {
+        join_times[i] = engine.time(i, LocalEngine::Join);
+    }
+    result.server_load = join.received();
+    result.load_imbalance = imbalance(result.server_load);
+    result.join_time_imbalance = imbalance(join_times);
+    result.r_shipped = join.r_sent();
+    result.s_shipped = join.s_sent();
+    result.join_rows = join.join_size();
+    if constexpr (std::is_same_v<Join, LocalFlowJoin>) {
+        heavy_hitter_recall(join, c.n_servers, result);
+    }
+    return result;
+}
+
+void write_csv_header(std::ostream& out) {
+    out << "join,n_servers,r_tuples,s_tuples,alpha,repetitions,makespan_seconds,load_seconds,detect_seconds,shuffle_seconds,join_seconds,"
+           "max_load,avg_load,load_imbalance,join_time_imbalance,r_shipped,s_shipped,tuples_shipped,join_rows,"
+           "true_heavy_hitters,detected_heavy_hitters,heavy_hitter_recall,server_load\n";
+}
+
+// server_load is a ';' separated list, the heavy hitter columns are empty for the hash join
+void write_csv_row(std::ostream& out, const std::string& join, const configuration& c, int repetitions, const run_result& r) {
+    size_t max_load = *std::max_element(r.server_load.begin(), r.server_load.end());
+    double avg_load = 0;
+    for (size_t l : r.server_load) {
+        avg_load += static_cast<double>(l) / r.server_load.size();
+    }
+    out << join << ',' << c.n_servers << ',' << c.r_tuples << ',' << c.s_tuples << ',' << c.alpha << ',' << repetitions << ',' << r.makespan;
+    for (double seconds : r.phase_seconds) {
+        out << ',' << seconds;
+    }
+    out << ',' << max_load << ',' << avg_load << ',' << r.load_imbalance << ',' << r.join_time_imbalance << ',' << r.r_shipped << ',' << r.s_shipped << ','
+        << r.r_shipped + r.s_shipped << ',' << r.join_rows << ',';
+    if (r.detects) {
+        out << r.true_heavy_hitters << ',' << r.detected_heavy_hitters << ',' << r.recall;
+    } else {
+        out << ",,";
+    }
+    out << ',';
+    for (size_t i = 0; i < r.server_load.size(); ++i) {
+        out << (i > 0 ? ";" : "") << r.server_load[i];
+    }
+    out << '\n';
+}
+
+std::vector<std::string> split_list(const std::string& values) {
+    std::vector<std::string> result;
+    std::stringstream stream(values);
+    std::string value;
+    while (std::getline(stream, value, ',')) {
+        if (!value.empty()) {
+            result.push_back(value);
+        }
+    }
+    if (result.empty()) {
+        throw std::invalid_argument("Empty list: " + values);
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::vector<int> n_servers = {4};
+        std::vector<uint64_t> r_tuples = {100000};
+        std::vector<uint64_t> s_tuples = {1000000};
+        std::vector<std::string> alphas = {"0", "0.5", "1.0", "1.25"};
+        std::vector<std::string> joins = {"flow", "hash"};
+        int repetitions = 3;
+        LocalJoin::options join_options;
+        loader_options load_options;
+        std::string data_dir;   // Generated in memory if not given
+        std::string csv_file;   // CSV goes to stdout if not given
+        double max_imbalance = 0; // Regression gate on the load imbalance of the flow join, off if 0
+        for (int a = 1; a < argc; ++a) {
+            std::string arg = argv[a];
+            if (arg.rfind("servers=", 0) == 0) {
+                n_servers.clear();
+                for (const auto& v : split_list(arg.substr(8))) {
+                    n_servers.push_back(std::stoi(v));
+                }
+            } else if (arg.rfind("r=", 0) == 0 || arg.rfind("s=", 0) == 0) {
+                auto& sizes = arg[0] == 'r' ? r_tuples : s_tuples;
+                sizes.clear();
+                for (const auto& v : split_list(arg.substr(2))) {
+                    sizes.push_back(std::stoull(v));
+                }
+            } else if (arg.rfind("alpha=", 0) == 0) {
+                alphas = split_list(arg.substr(6));
+            } else if (arg.rfind("joins=", 0) == 0) {
+                joins = split_list(arg.substr(6));
+            } else if (arg.rfind("repetitions=", 0) == 0) {
+                repetitions = std::max(1, std::stoi(arg.substr(12)));
+            } else if (arg.rfind("partition=", 0) == 0) {
+                join_options.partitioning = PartitionFunction::parse(arg.substr(10));
+            } else if (arg == "balance=on" || arg == "balance=off") {
+                join_options.balance = arg == "balance=on";
+            } else if (arg.rfind("imbalance=", 0) == 0) {
+                join_options.planner.target_imbalance = std::stod(arg.substr(10));
+            } else if (arg.rfind("network_cost=", 0) == 0) {
+                join_options.planner.network_cost = std::stod(arg.substr(13));
+            } else if (arg.rfind("data=", 0) == 0) {
+                data_dir = arg.substr(5);
+            } else if (arg.rfind("csv=", 0) == 0) {
+                csv_file = arg.substr(4);
+            } else if (arg.rfind("max_imbalance=", 0) == 0) {
+                max_imbalance = std::stod(arg.substr(14));
+            } else {
+                std::cerr << "Usage: ./skew_sweep [servers=<n,...>] [r=<tuples,...>] [s=<tuples,...>] [alpha=<exponent,...>] [joins=flow,hash] [repetitions=<runs, default 3>]\n"
+                          << "       [partition=modulo|multiplicative|crc32|radix] [balance=on|off] [imbalance=<target imbalance>] [network_cost=<cost>]\n"
+                          << "       [data=<directory of gen_R_S partitions>] [csv=<file>] [max_imbalance=<fail above this flow join load imbalance>]\n";
+                return 1;
+            }
+        }
+        for (const auto& join : joins) {
+            if (join != "flow" && join != "hash") {
+                std::cerr << "Unknown join " << join << ", expected flow or hash.\n";
+                return 1;
+            }
+        }
+
+        std::ofstream csv;
+        if (!csv_file.empty()) {
+            csv.open(csv_file);
+            if (!csv.is_open()) {
+                std::cerr << "Could not open " << csv_file << ".\n";
+                return 1;
+            }
+        }
+        std::ostream& out = csv_file.empty() ? std::cout : csv;
+        write_csv_header(out);
+
+        // Data of one (|R|, |S|, alpha) is generated once for all server counts
+        Inputs inputs(data_dir);
+        int failed = 0;
+        for (uint64_t r : r_tuples) {
+            for (uint64_t s : s_tuples) {
+                for (const auto& alpha : alphas) {
+                    for (int n : n_servers) {
+                        configuration c{n, r, s, alpha};
+                        std::map<std::string, size_t> join_rows;
+                        for (const auto& join : joins) {
+                            try {
+                                // Metrics of the run with the median makespan
+                                std::vector<run_result> runs;
+                                for (int rep = 0; rep < repetitions; ++rep) {
+                                    auto loader = inputs.loader(c, load_options);
+                                    runs.push_back(join == "flow" ? run_join<LocalFlowJoin>(c, join_options, loader) : run_join<LocalHashJoin>(c, join_options, loader));
+                                }
+                                std::sort(runs.begin(), runs.end(), [](const run_result& a, const run_result& b) { return a.makespan < b.makespan; });
+                                const run_result& median = runs[runs.size() / 2];
+                                write_csv_row(out, join, c, repetitions, median);
+                                out.flush();
+                                join_rows[join] = median.join_rows;
+
+                                if (!csv_file.empty()) {
+                                    std::cout << join << " join (" << n << " servers, |R| " << r << ", |S| " << s << ", alpha " << alpha << "): makespan "
+                                              << median.makespan << " s, load imbalance " << median.load_imbalance << ", shipped " << median.r_shipped + median.s_shipped;
+                                    if (median.detects) {
+                                        std::cout << ", heavy hitter recall " << median.recall;
+                                    }
+                                    std::cout << std::endl;
+                                }
+                                if (join == "flow" && max_imbalance > 0 && median.load_imbalance > max_imbalance) {
+                                    std::cerr << "Flow join load imbalance " << median.load_imbalance << " above " << max_imbalance << " (" << n << " servers, |R| " << r
+                                              << ", |S| " << s << ", alpha " << alpha << ").\n";
+                                    failed++;
+                                }
+                            } catch (const std::exception& e) {
+                                std::cerr << join << " join (" << n << " servers, |R| " << r << ", |S| " << s << ", alpha " << alpha << ") skipped: " << e.what() << "\n";
+                                failed++;
+                            }
+                        }
+                        if (join_rows.size() == 2 && join_rows["flow"] != join_rows["hash"]) {
+                            std::cerr << "Flow join produced " << join_rows["flow"] << " rows, hash join " << join_rows["hash"] << " (" << n << " servers, |R| " << r
+                                      << ", |S| " << s << ", alpha " << alpha << ").\n";
+                            failed++;
+                        }
+                    }
+                }
+            }
+        }
+        return failed == 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+}
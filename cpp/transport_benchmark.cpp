@@ -0,0 +1,166 @@
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <string>
+#include <vector>
+#include <barrier>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <unordered_map>
+#include "./utils/helper_functions.h"
+#include "./utils/transport.h"
+#include "./utils/batch_protocol.h"
+#include "./utils/receive_engine.h"
+
+// Shuffle bandwidth of the transports of the distributed joins: every node sends the same number
+// of tuples to every other node (all-to-all, as in a uniform shuffle) while receiving from all of
+// them, using the batch protocol of the joins. Receivers read every tuple once.
+
+struct benchmark_result {
+    double seconds;    // Slowest node, from the start barrier until all its streams ended
+    size_t tuples;     // Tuples received by all nodes
+    uint64_t checksum; // Sum of the received join values, checked against the values sent
+};
+
+benchmark_result run_shuffle(Transport::Kind kind, int n_nodes, size_t tuples_per_pair, size_t batch_tuples) {
+    TransportFactory transports(kind, n_nodes);
+    std::barrier sync_point(n_nodes);
+    std::vector<double> seconds(n_nodes, 0);
+    std::vector<size_t> received(n_nodes, 0);
+    std::vector<uint64_t> checksums(n_nodes, 0);
+    std::mutex error_mutex;
+    std::exception_ptr error; // First error of a node, rethrown once all nodes are done
+
+    auto node = [&](int id) {
+        try {
+            auto transport = transports.create(id);
+            // The send buffer of a node: tuples_per_pair tuples for every destination
+            std::vector<joined_row> send_buffer(tuples_per_pair);
+            for (size_t i = 0; i < tuples_per_pair; ++i) {
+                send_buffer[i] = {static_cast<uint32_t>(i), static_cast<uint32_t>(id), static_cast<uint32_t>(i)};
+            }
+            sync_point.arrive_and_wait();
+            transport->connect();
+            sync_point.arrive_and_wait();
+
+            auto start = std::chrono::high_resolution_clock::now();
+            ReceiveEngine receive_engine(*transport, n_nodes);
+            ReceiveThread receive_thread(receive_engine, [&]() {
+                try {
+                    receive_engine.run(
+                        [&](char, const joined_row* rows, size_t n) {
+                            for (size_t i = 0; i < n; ++i) {
+                                checksums[id] += rows[i].join_val;
+                            }
+                        },
+                        [](char) {});
+                } catch (const std::exception& e) {
+                    std::cerr << "Receive thread error in node " << id << ": " << e.what() << std::endl;
+                }
+            });
+
+            {
+                batch_protocol::InFlight in_flight;
+                std::unordered_map<int, batch_protocol::BatchSender> batches;
+                for (int i = 0; i < n_nodes; ++i) {
+                    if (i != id) {
+                        batches.emplace(i, batch_protocol::BatchSender(*transport, i, id, batch_tuples));
+                    }
+                }
+                // Start with the next node, so that not all nodes send to node 0 first
+                for (int k = 1; k < n_nodes; ++k) {
+                    auto& batch = batches.at((id + k) % n_nodes);
+                    batch.end_of_stream('R');
+                    batch.send_view('S', send_buffer.data(), send_buffer.size(), in_flight);
+                    batch.end_of_stream('S');
+                }
+                receive_thread.join();
+            }
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+            seconds[id] = elapsed.count();
+            received[id] = receive_engine.tuples_received();
+        } catch (...) {
+            // Leave the barrier so the other nodes do not wait for this one before they start
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            sync_point.arrive_and_drop();
+        }
+    };
+
+    std::vector<std::thread> nodes;
+    for (int id = 0; id < n_nodes; ++id) {
+        nodes.emplace_back(node, id);
+    }
+    for (auto& t : nodes) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    benchmark_result result = {*std::max_element(seconds.begin(), seconds.end()), 0, 0};
+    for (int id = 0; id < n_nodes; ++id) {
+        result.tuples += received[id];
+        result.checksum += checksums[id];
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || argc > 5) {
+        std::cerr << "Usage: ./transport_benchmark <n_nodes> <MiB per node pair> [batch_tuples] [repetitions]\n";
+        return 1;
+    }
+
+    try {
+        int n_nodes = std::stoi(argv[1]);
+        size_t tuples_per_pair = (std::stoull(argv[2]) << 20) / sizeof(joined_row);
+        size_t batch_tuples = argc > 3 ? std::stoull(argv[3]) : batch_protocol::DEFAULT_BATCH_TUPLES;
+        int repetitions = argc > 4 ? std::stoi(argv[4]) : 3;
+        if (n_nodes < 2) {
+            std::cerr << "At least 2 nodes are needed.\n";
+            return 1;
+        }
+        // Every transport is measured, the batches must fit into the shared memory rings
+        size_t max_shm_batch = SharedMemoryRings::max_rows(sizeof(batch_protocol::batch_header));
+        if (batch_tuples == 0 || batch_tuples > max_shm_batch) {
+            std::cerr << "batch_tuples must be between 1 and " << max_shm_batch << " (half a shared memory ring).\n";
+            return 1;
+        }
+
+        std::cout << "transport,n_nodes,batch_tuples,tuples,best_seconds,tuples_per_second,gib_per_second\n";
+        for (auto kind : {Transport::Tcp, Transport::Inproc, Transport::SharedMemory}) {
+            benchmark_result best = {0, 0, 0};
+            for (int r = 0; r < repetitions; ++r) {
+                auto result = run_shuffle(kind, n_nodes, tuples_per_pair, batch_tuples);
+                if (r == 0 || result.seconds < best.seconds) {
+                    best = result;
+                }
+            }
+            size_t expected = static_cast<size_t>(n_nodes) * (n_nodes - 1) * tuples_per_pair;
+            if (best.tuples != expected) {
+                std::cerr << Transport::name(kind) << ": received " << best.tuples << " tuples, expected " << expected << "\n";
+                return 1;
+            }
+            // Every node sends the join values 0 .. tuples_per_pair - 1 to every other node
+            uint64_t expected_checksum = static_cast<uint64_t>(n_nodes) * (n_nodes - 1) * (tuples_per_pair * (tuples_per_pair - 1) / 2);
+            if (best.checksum != expected_checksum) {
+                std::cerr << Transport::name(kind) << ": checksum of the received tuples is " << best.checksum << ", expected " << expected_checksum << "\n";
+                return 1;
+            }
+            std::cout << Transport::name(kind) << "," << n_nodes << "," << batch_tuples << "," << best.tuples << "," << best.seconds << ","
+                      << best.tuples / best.seconds << "," << best.tuples * sizeof(joined_row) / best.seconds / (1 << 30) << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
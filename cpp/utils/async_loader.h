@@ -0,0 +1,395 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "helper_functions.h"
+#include "trace.h"
+
+// Minimal io_uring on the raw system calls (no liburing): one submission and one completion ring
+// mapped from the kernel, reads into registered (fixed) buffers. Only used by the submitting thread.
+class IoUring {
+public:
+    // Setting up the ring or registering buffers failed (old kernel, seccomp, memory limits), the
+    // caller reads without io_uring
+    struct unavailable : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    explicit IoUring(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(SYS_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            throw unavailable(std::string("io_uring_setup failed: ") + strerror(errno));
+        }
+        sq_bytes = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_bytes = cq_bytes = std::max(sq_bytes, cq_bytes);
+        }
+        sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+        try {
+            sq_ring = map(sq_bytes, IORING_OFF_SQ_RING);
+            cq_ring = single_mmap ? sq_ring : map(cq_bytes, IORING_OFF_CQ_RING);
+            sqes = reinterpret_cast<io_uring_sqe*>(map(sqes_bytes, IORING_OFF_SQES));
+        } catch (const unavailable&) {
+            // The destructor does not run, release what was mapped
+            if (cq_ring && !single_mmap) {
+                munmap(cq_ring, cq_bytes);
+            }
+            if (sq_ring) {
+                munmap(sq_ring, sq_bytes);
+            }
+            close(fd);
+            throw;
+        }
+
+        sq_tail = reinterpret_cast<uint32_t*>(sq_ring + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<uint32_t*>(sq_ring + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<uint32_t*>(sq_ring + params.sq_off.array);
+        cq_head = reinterpret_cast<uint32_t*>(cq_ring + params.cq_off.head);
+        cq_tail = reinterpret_cast<uint32_t*>(cq_ring + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<uint32_t*>(cq_ring + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+    }
+
+    ~IoUring() {
+        munmap(sqes, sqes_bytes);
+        if (!single_mmap) {
+            munmap(cq_ring, cq_bytes);
+        }
+        munmap(sq_ring, sq_bytes);
+        close(fd);
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    void register_buffers(const std::vector<iovec>& buffers) {
+        if (syscall(SYS_io_uring_register, fd, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) < 0) {
+            throw unavailable(std::string("Registering io_uring buffers failed: ") + strerror(errno));
+        }
+    }
+
+    // Queues a read of length bytes at offset into registered buffer buffer_index (data points into it)
+    void prepare_read_fixed(int file, void* data, uint32_t length, uint64_t offset, uint16_t buffer_index, uint64_t user_data) {
+        uint32_t tail = *sq_tail;
+        uint32_t index = tail & sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ_FIXED;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uint64_t>(data);
+        sqe.len = length;
+        sqe.off = offset;
+        sqe.buf_index = buffer_index;
+        sqe.user_data = user_data;
+        sq_array[index] = index;
+        std::atomic_ref<uint32_t>(*sq_tail).store(tail + 1, std::memory_order_release);
+        n_prepared++;
+    }
+
+    // Submits the prepared reads and waits until at least wait_for completions are ready
+    void submit_and_wait(unsigned wait_for) {
+        while (true) {
+            long r = syscall(SYS_io_uring_enter, fd, n_prepared, wait_for, wait_for > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (r >= 0) {
+                n_prepared -= static_cast<unsigned>(r);
+                return;
+            }
+            if (errno != EINTR) {
+                throw std::runtime_error(std::string("io_uring_enter failed: ") + strerror(errno));
+            }
+        }
+    }
+
+    bool pop_completion(io_uring_cqe& completion) {
+        uint32_t head = *cq_head;
+        if (head == std::atomic_ref<uint32_t>(*cq_tail).load(std::memory_order_acquire)) {
+            return false;
+        }
+        completion = cqes[head & cq_mask];
+        std::atomic_ref<uint32_t>(*cq_head).store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    int fd;
+    bool single_mmap;
+    size_t sq_bytes, cq_bytes, sqes_bytes;
+    char* sq_ring = nullptr;
+    char* cq_ring = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    uint32_t* sq_tail;
+    uint32_t sq_mask;
+    uint32_t* sq_array;
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    uint32_t cq_mask;
+    io_uring_cqe* cqes;
+    unsigned n_prepared = 0;
+
+    char* map(size_t bytes, off_t offset) {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        if (p == MAP_FAILED) {
+            throw unavailable(std::string("Mapping the io_uring rings failed: ") + strerror(errno));
+        }
+        return static_cast<char*>(p);
+    }
+};
+
+struct loader_options {
+    size_t chunk_bytes = 1 << 20; // Bytes per read, rounded to 4 KiB
+    unsigned queue_depth = 32;    // Reads in flight
+    bool direct = false;          // O_DIRECT: bypass the page cache (files on file systems without it are read buffered)
+    bool use_uring = true;        // false: pread, one chunk at a time
+};
+
+struct load_statistics {
+    uint64_t bytes = 0;
+    double seconds = 0;
+    bool uring = false;  // io_uring was used (not available: pread)
+    size_t direct_files = 0; // Files read with O_DIRECT
+};
+
+// Reads files in chunks with up to queue_depth reads in flight on one io_uring and calls
+// on_chunk(file, offset, data, bytes) for every chunk as it completes, so the chunks can be parsed
+// or routed while the other reads are in flight. Chunks start at multiples of chunk_bytes; they
+// complete in any order. Falls back to pread if io_uring is not available (e.g. seccomp).
+class AsyncLoader {
+public:
+    static constexpr size_t ALIGNMENT = 4096; // O_DIRECT: buffers, offsets and lengths
+
+    explicit AsyncLoader(loader_options options = loader_options()) : options(options) {
+        this->options.chunk_bytes = std::max(ALIGNMENT, (options.chunk_bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+        this->options.queue_depth = std::clamp(options.queue_depth, 1u, 1024u);
+    }
+
+    template <typename ChunkFn>
+    load_statistics read(const std::vector<std::string>& files, ChunkFn on_chunk) {
+        auto start = std::chrono::steady_clock::now();
+        load_statistics statistics;
+        std::vector<open_file> opened;
+        for (const auto& name : files) {
+            opened.push_back(open_file(name, options.direct));
+            statistics.bytes += opened.back().size;
+            statistics.direct_files += opened.back().direct;
+        }
+        std::vector<chunk> chunks;
+        for (size_t f = 0; f < opened.size(); ++f) {
+            for (uint64_t offset = 0; offset < opened[f].size; offset += options.chunk_bytes) {
+                chunks.push_back({f, offset, std::min<uint64_t>(options.chunk_bytes, opened[f].size - offset)});
+            }
+        }
+
+        statistics.uring = false;
+        if (options.use_uring) {
+            try {
+                IoUring ring(options.queue_depth);
+                read_uring(ring, opened, chunks, on_chunk);
+                statistics.uring = true;
+            } catch (const IoUring::unavailable&) {
+            }
+        }
+        if (!statistics.uring) {
+            read_pread(opened, chunks, on_chunk);
+        }
+        statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return statistics;
+    }
+
+private:
+    loader_options options;
+
+    struct chunk {
+        size_t file;
+        uint64_t offset;
+        uint64_t bytes;
+    };
+
+    // Owns the descriptor of one file
+    struct open_file {
+        int fd = -1;
+        uint64_t size = 0;
+        bool direct = false;
+
+        open_file(const std::string& name, bool try_direct) {
+            if (try_direct) {
+                fd = open(name.c_str(), O_RDONLY | O_DIRECT);
+                direct = fd >= 0;
+            }
+            if (fd < 0) {
+                fd = open(name.c_str(), O_RDONLY);
+            }
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0) {
+                throw std::runtime_error("Could not open file: " + name);
+            }
+            size = st.st_size;
+        }
+        open_file(open_file&& other) noexcept : fd(std::exchange(other.fd, -1)), size(other.size), direct(other.direct) {}
+        open_file& operator=(const open_file&) = delete;
+        ~open_file() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    };
+
+    // Aligned buffers of chunk_bytes, freed on destruction
+    struct buffer_pool {
+        std::vector<char*> buffers;
+
+        buffer_pool(size_t n, size_t bytes) {
+            for (size_t i = 0; i < n; ++i) {
+                buffers.push_back(static_cast<char*>(std::aligned_alloc(ALIGNMENT, bytes)));
+                if (!buffers.back()) {
+                    throw std::bad_alloc();
+                }
+            }
+        }
+        ~buffer_pool() {
+            for (char* b : buffers) {
+                std::free(b);
+            }
+        }
+    };
+
+    // A chunk is read into one buffer; a short read (before the end of the file) continues at
+    // the byte it stopped, the chunk is handed on once complete
+    template <typename ChunkFn>
+    void read_uring(IoUring& ring, const std::vector<open_file>& files, const std::vector<chunk>& chunks, ChunkFn& on_chunk) {
+        size_t n_buffers = std::min<size_t>(options.queue_depth, std::max<size_t>(chunks.size(), 1));
+        buffer_pool pool(n_buffers, options.chunk_bytes);
+        std::vector<iovec> iovecs;
+        for (char* b : pool.buffers) {
+            iovecs.push_back({b, options.chunk_bytes});
+        }
+        ring.register_buffers(iovecs); // Throws IoUring::unavailable, read() falls back to pread
+
+        std::vector<size_t> chunk_of(n_buffers);  // Chunk being read into a buffer
+        std::vector<uint64_t> filled(n_buffers); // Bytes of the chunk read so far
+        std::vector<uint16_t> free_buffers;
+        for (size_t b = n_buffers; b-- > 0;) {
+            free_buffers.push_back(static_cast<uint16_t>(b));
+        }
+        auto submit = [&](uint16_t b) {
+            const chunk& c = chunks[chunk_of[b]];
+            const open_file& file = files[c.file];
+            uint64_t length = c.bytes - filled[b];
+            if (file.direct) {
+                length = (length + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; // Reads past the end are short
+            }
+            ring.prepare_read_fixed(file.fd, pool.buffers[b] + filled[b], static_cast<uint32_t>(length), c.offset + filled[b], b, b);
+        };
+
+        size_t next_chunk = 0;
+        size_t in_flight = 0;
+        while (next_chunk < chunks.size() || in_flight > 0) {
+            while (next_chunk < chunks.size() && !free_buffers.empty()) {
+                uint16_t b = free_buffers.back();
+                free_buffers.pop_back();
+                chunk_of[b] = next_chunk++;
+                filled[b] = 0;
+                submit(b);
+                in_flight++;
+            }
+            ring.submit_and_wait(1);
+            io_uring_cqe completion;
+            while (ring.pop_completion(completion)) {
+                uint16_t b = static_cast<uint16_t>(completion.user_data);
+                const chunk& c = chunks[chunk_of[b]];
+                if (completion.res < 0) {
+                    throw std::runtime_error(std::string("Read failed: ") + strerror(-completion.res));
+                }
+                if (completion.res == 0 && filled[b] < c.bytes) {
+                    throw std::runtime_error("File shrank while reading");
+                }
+                filled[b] += completion.res;
+                if (filled[b] < c.bytes) {
+                    submit(b); // Short read
+                    continue;
+                }
+                on_chunk(c.file, c.offset, pool.buffers[b], c.bytes);
+                free_buffers.push_back(b);
+                in_flight--;
+            }
+        }
+    }
+
+    template <typename ChunkFn>
+    void read_pread(const std::vector<open_file>& files, const std::vector<chunk>& chunks, ChunkFn& on_chunk) {
+        buffer_pool pool(1, options.chunk_bytes);
+        for (const auto& c : chunks) {
+            const open_file& file = files[c.file];
+            for (uint64_t filled = 0; filled < c.bytes;) {
+                uint64_t length = c.bytes - filled;
+                if (file.direct) {
+                    length = (length + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+                }
+                ssize_t r = pread(file.fd, pool.buffers[0] + filled, length, c.offset + filled);
+                if (r < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (r <= 0) {
+                    throw std::runtime_error(std::string("Read failed: ") + (r < 0 ? strerror(errno) : "file shrank while reading"));
+                }
+                filled += r;
+            }
+            on_chunk(c.file, c.offset, pool.buffers[0], c.bytes);
+        }
+    }
+};
+
+// Reads partition files into tuple buffers. Binary partitions ((value, row number) as two uint32_t
+// per row, see gen_R_S) are loaded by the AsyncLoader and parsed chunk by chunk as the reads
+// complete; text partitions are read with read_data.
+inline std::vector<tuple_buffer> load_partitions(const std::vector<std::string>& files, const loader_options& options = loader_options(),
+                                                 load_statistics* statistics = nullptr) {
+    TRACE_SCOPE("load partitions");
+    std::vector<tuple_buffer> data(files.size());
+    std::vector<std::string> binary_files;
+    std::vector<size_t> binary_index;
+    for (size_t f = 0; f < files.size(); ++f) {
+        if (fs::path(files[f]).extension() == ".bin") {
+            binary_files.push_back(files[f]);
+            binary_index.push_back(f);
+            data[f].resize(fs::file_size(files[f]) / (2 * sizeof(uint32_t)));
+        } else {
+            data[f] = read_data(files[f]);
+        }
+    }
+
+    AsyncLoader loader(options);
+    auto loaded = loader.read(binary_files, [&](size_t file, uint64_t offset, const char* bytes, uint64_t n_bytes) {
+        TRACE_SCOPE("parse chunk");
+        auto& rows = data[binary_index[file]];
+        size_t first = offset / (2 * sizeof(uint32_t)); // Chunks start at multiples of 4 KiB, so rows never straddle two
+        size_t n = std::min<size_t>(n_bytes / (2 * sizeof(uint32_t)), rows.size() - first);
+        const auto* pairs = reinterpret_cast<const uint32_t*>(bytes);
+        for (size_t i = 0; i < n; ++i) {
+            rows[first + i] = {pairs[2 * i], pairs[2 * i + 1], 0};
+        }
+    });
+    if (statistics) {
+        *statistics = loaded;
+    }
+    return data;
+}
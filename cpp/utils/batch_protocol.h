@@ -0,0 +1,485 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include "helper_functions.h"
+#include "transport.h"
+#include "traffic_matrix.h"
+#include "trace.h"
+
+// Wire protocol of the distributed joins. Tuples are not sent one by one: every node keeps an
+// outgoing buffer per destination and relation, which is sent as one message once it holds
+// batch_tuples tuples. A batch is a transport frame: a batch_header followed by count joined_rows.
+// The tuples are handed to the transport without copying: they either take over the outgoing
+// buffer, or are a view of a send buffer that stays alive until the transport released it
+// (send_view, tracked by InFlight). ZMQ sends them as a frame of their own, the shared memory
+// rings copy them once.
+// After its last batch of a relation a sender sends an end-of-stream frame (type EndOfStream,
+// count = number of data batches of that relation), so the receiver knows when a peer is done
+// and can check that no batch is missing. Sequence numbers count the batches of one sender and
+// relation from 0; every transport keeps the order of one sender, so a gap is an error.
+// With flow control (FlowControl) every data batch takes a credit of its destination, which the
+// destination returns in a Credit frame (count = batches) once it has consumed the batch. The
+// window and the queue are given in tuples, so they bound the same amount of data for any batch size.
+namespace batch_protocol {
+
+enum Type : uint8_t {
+    Data = 0,
+    EndOfStream = 1,
+    Credit = 2
+};
+
+struct batch_header {
+    uint8_t type;
+    char relation;     // 'R' or 'S'
+    uint16_t sender;   // Node id of the sender
+    uint32_t sequence; // Batch number of this sender and relation
+    uint32_t count;    // Data: tuples in the batch, EndOfStream: batches sent, Credit: batches consumed
+};
+
+static_assert(sizeof(batch_header) == 12, "batch_header is sent as raw bytes");
+
+constexpr size_t DEFAULT_BATCH_TUPLES = 4096; // 48 KiB of tuples per message
+constexpr size_t DEFAULT_WINDOW_TUPLES = 32 * DEFAULT_BATCH_TUPLES; // Unconsumed tuples per destination (high-water mark)
+constexpr size_t DEFAULT_QUEUE_TUPLES = 64 * DEFAULT_BATCH_TUPLES;  // Tuples per destination waiting for credits in memory
+
+// Counts zero-copy frames that still point into a send buffer. The transport calls release() once
+// it does not need a frame anymore (ZMQ from its I/O thread after writing it to the socket); the destructor waits for all of them, so an
+// InFlight declared after the send buffers keeps them alive long enough.
+class InFlight {
+public:
+    InFlight() = default;
+    InFlight(const InFlight&) = delete;
+    InFlight& operator=(const InFlight&) = delete;
+    ~InFlight() { wait(); }
+
+    void acquire() { n_frames.fetch_add(1, std::memory_order_relaxed); }
+
+    static void release(void*, void* hint) {
+        auto* self = static_cast<InFlight*>(hint);
+        if (self->n_frames.fetch_sub(1, std::memory_order_release) == 1) {
+            self->n_frames.notify_all();
+        }
+    }
+
+    void wait() {
+        for (size_t n = n_frames.load(std::memory_order_acquire); n != 0; n = n_frames.load(std::memory_order_acquire)) {
+            n_frames.wait(n);
+        }
+    }
+
+private:
+    std::atomic<size_t> n_frames{0};
+};
+
+// Settings of the flow control, window_tuples = 0 turns it off
+struct flow_control_options {
+    size_t window_tuples = DEFAULT_WINDOW_TUPLES;
+    size_t queue_tuples = DEFAULT_QUEUE_TUPLES;
+    std::string spill_directory = std::filesystem::temp_directory_path().string();
+};
+
+// Credit-based flow control between the nodes. A sender starts with window credits per
+// destination (window_tuples in batches of batch_tuples, at least one) and spends one per data batch; the receive thread counts the batches it consumed
+// per source and the send thread returns them in Credit frames, once half a window has been
+// consumed. So at most window batches per (sender, receiver) pair are in the transport, however
+// hot a destination is. The transport is only used by the send thread: it returns credits while
+// sending, while waiting for credits and, after its last batch, until the receive side is done.
+// The receive side keeps reading credits until the send side is done (ReceiveEngine).
+class FlowControl {
+public:
+    FlowControl(Transport& transport, int id, int n_servers, size_t batch_tuples, const flow_control_options& options = flow_control_options(), NodeTraffic* traffic = nullptr)
+        : transport(transport), traffic(traffic), id(id), window(batches(options.window_tuples, batch_tuples)), return_threshold(std::max<uint32_t>(window / 2, 1)),
+          queue_batches(options.queue_tuples == 0 ? 0 : batches(options.queue_tuples, batch_tuples)), spill_directory(options.spill_directory),
+          credits(n_servers), consumed(n_servers) {
+        for (auto& c : credits) {
+            c.store(this->window, std::memory_order_relaxed);
+        }
+    }
+
+    FlowControl(const FlowControl&) = delete;
+    FlowControl& operator=(const FlowControl&) = delete;
+
+    // Send thread: takes a credit of destination if there is one
+    bool try_acquire(int destination) {
+        if (credits[destination].load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+        credits[destination].fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Send thread: waits until destination has a credit, returning the credits of the other nodes meanwhile
+    void wait_for_credit(int destination) {
+        TRACE_SCOPE("wait for credit");
+        n_waits++;
+        while (true) {
+            uint32_t seen = events.load(std::memory_order_acquire);
+            return_credits();
+            if (credits[destination].load(std::memory_order_acquire) > 0) {
+                return;
+            }
+            if (receiving_done.load(std::memory_order_acquire)) {
+                throw std::runtime_error("Receive side stopped while waiting for credits of node " + std::to_string(destination));
+            }
+            events.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    // Send thread: sends a Credit frame to every source that has consumed enough batches
+    void return_credits() {
+        for (int source = 0; source < static_cast<int>(consumed.size()); ++source) {
+            uint32_t n = consumed[source].load(std::memory_order_acquire);
+            if (source == id || n < return_threshold) {
+                continue;
+            }
+            consumed[source].fetch_sub(n, std::memory_order_relaxed);
+            batch_header header = {Credit, 0, static_cast<uint16_t>(id), 0, n};
+            transport.send(source, &header, sizeof(batch_header), nullptr, 0, nullptr, nullptr);
+            n_credit_frames++;
+            if (traffic) {
+                traffic->sent_control(source, sizeof(batch_header));
+            }
+        }
+    }
+
+    // Send thread, after its last frame: returns credits until the receive side is done
+    void finish_sending() {
+        sending_done.store(true, std::memory_order_release);
+        while (true) {
+            uint32_t seen = events.load(std::memory_order_acquire);
+            return_credits();
+            if (receiving_done.load(std::memory_order_acquire)) {
+                return;
+            }
+            events.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    // Receive thread
+    void grant(int destination, uint32_t n) {
+        credits.at(destination).fetch_add(n, std::memory_order_release);
+        notify();
+    }
+
+    void consume(int source) {
+        if (consumed.at(source).fetch_add(1, std::memory_order_release) + 1 >= return_threshold) {
+            notify();
+        }
+    }
+
+    void finish_receiving() {
+        receiving_done.store(true, std::memory_order_release);
+        notify();
+    }
+
+    bool sending_finished() const { return sending_done.load(std::memory_order_acquire); }
+
+    uint32_t window_batches() const { return window; }
+    size_t max_queued_batches() const { return queue_batches; }
+    const std::string& spill_path() const { return spill_directory; }
+    size_t credit_waits() const { return n_waits; }
+    size_t credit_frames() const { return n_credit_frames; }
+
+private:
+    Transport& transport;
+    NodeTraffic* traffic;
+    int id;
+    uint32_t window;
+    uint32_t return_threshold;
+    size_t queue_batches;
+    std::string spill_directory;
+    std::vector<std::atomic<uint32_t>> credits;  // Batches this node may still send to a destination
+    std::vector<std::atomic<uint32_t>> consumed; // Batches of a source consumed, not yet returned
+    std::atomic<uint32_t> events{0};             // Incremented on credits, consumed batches and the end of receiving
+    std::atomic<bool> sending_done{false};
+    std::atomic<bool> receiving_done{false};
+    size_t n_waits = 0;
+    size_t n_credit_frames = 0;
+
+    void notify() {
+        events.fetch_add(1, std::memory_order_release);
+        events.notify_all();
+    }
+
+    // Batches of batch_tuples holding tuples, rounded up
+    static uint32_t batches(size_t tuples, size_t batch_tuples) {
+        size_t n = (tuples + batch_tuples - 1) / std::max<size_t>(batch_tuples, 1);
+        return static_cast<uint32_t>(std::clamp<size_t>(n, 1, UINT32_MAX / 2));
+    }
+};
+
+// Batches of one destination that did not fit into the queue: an unlinked temporary file,
+// written and read back in order. The file is rewound whenever it has been read completely.
+class SpillFile {
+public:
+    SpillFile() = default;
+    SpillFile(SpillFile&& other) noexcept
+        : fd(std::exchange(other.fd, -1)), write_offset(other.write_offset), read_offset(other.read_offset) {}
+    SpillFile& operator=(const SpillFile&) = delete;
+    ~SpillFile() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void write(const std::string& directory, const joined_row* rows, size_t n) {
+        if (fd < 0) {
+            std::string path = (std::filesystem::path(directory) / "shuffle_spill_XXXXXX").string();
+            fd = mkstemp(path.data());
+            if (fd < 0) {
+                throw std::runtime_error("Cannot create spill file in " + directory + ": " + strerror(errno));
+            }
+            unlink(path.c_str());
+        }
+        transfer(pwrite, const_cast<joined_row*>(rows), n, write_offset);
+    }
+
+    std::vector<joined_row>* read(size_t n) {
+        auto* rows = new std::vector<joined_row>(n);
+        transfer(pread, rows->data(), n, read_offset);
+        if (read_offset == write_offset) {
+            read_offset = write_offset = 0;
+        }
+        return rows;
+    }
+
+private:
+    int fd = -1;
+    off_t write_offset = 0;
+    off_t read_offset = 0;
+
+    template <typename Io>
+    void transfer(Io io, joined_row* rows, size_t n, off_t& offset) {
+        char* data = reinterpret_cast<char*>(rows);
+        for (size_t done = 0, bytes = n * sizeof(joined_row); done < bytes;) {
+            ssize_t r = io(fd, data + done, bytes - done, offset);
+            if (r <= 0) {
+                throw std::runtime_error(std::string("Spill file I/O failed: ") + (r < 0 ? strerror(errno) : "end of file"));
+            }
+            done += r;
+            offset += r;
+        }
+    }
+};
+
+// Outgoing buffers of one destination. With flow control, batches without a credit wait in a
+// queue; owned batches beyond max_queued_batches are spilled to disk (views cost no memory and are
+// always queued). Queued batches are sent in order as credits arrive, end_of_stream waits for all.
+class BatchSender {
+public:
+    // traffic, if given, records the frames sent to destination
+    BatchSender(Transport& transport, int destination, int sender, size_t batch_tuples, FlowControl* flow = nullptr, NodeTraffic* traffic = nullptr)
+        : transport(&transport), destination(destination), sender(sender), batch_tuples(batch_tuples), flow(flow), traffic(traffic) {
+        r_buffer.reserve(batch_tuples);
+        s_buffer.reserve(batch_tuples);
+    }
+
+    void add(char relation, const joined_row& t) {
+        auto& buffer = relation == 'R' ? r_buffer : s_buffer;
+        buffer.push_back(t);
+        n_copied += sizeof(joined_row);
+        if (buffer.size() == batch_tuples) {
+            flush(relation);
+        }
+    }
+
+    // Sends (or queues) the buffered tuples of a relation, if any. The rows frame takes over the buffer.
+    void flush(char relation) {
+        auto& buffer = relation == 'R' ? r_buffer : s_buffer;
+        if (buffer.empty()) {
+            return;
+        }
+        auto* rows = new std::vector<joined_row>(std::move(buffer));
+        buffer = std::vector<joined_row>();
+        buffer.reserve(batch_tuples);
+        send_batch(relation, rows->data(), rows->size(), release_vector, rows, true);
+    }
+
+    // Sends rows without copying them, in batches of at most batch_tuples. The rows must stay
+    // alive and unchanged until in_flight has no frames left.
+    void send_view(char relation, const joined_row* rows, size_t n, InFlight& in_flight) {
+        flush(relation); // Keeps the order of buffered and viewed tuples
+        for (size_t begin = 0; begin < n; begin += batch_tuples) {
+            size_t count = std::min(batch_tuples, n - begin);
+            in_flight.acquire();
+            send_batch(relation, rows + begin, count, InFlight::release, &in_flight, false);
+        }
+    }
+
+    // Flushes the relation, sends all queued batches and tells the destination that no more of
+    // its tuples follow
+    void end_of_stream(char relation) {
+        flush(relation);
+        drain(true);
+        uint32_t sequence = relation == 'R' ? r_sequence : s_sequence;
+        batch_header header = {EndOfStream, relation, static_cast<uint16_t>(sender), sequence, sequence};
+        transport->send(destination, &header, sizeof(batch_header), nullptr, 0, nullptr, nullptr);
+        n_bytes += sizeof(batch_header);
+        if (traffic) {
+            traffic->sent_control(destination, sizeof(batch_header));
+        }
+    }
+
+    size_t tuples_sent() const { return n_tuples; }
+    size_t bytes_sent() const { return n_bytes; }
+    size_t bytes_copied() const { return n_copied; } // Copied into outgoing buffers on the send path
+    size_t batches_queued() const { return n_queued; }  // Had to wait for a credit
+    size_t batches_spilled() const { return n_spilled; }
+
+private:
+    Transport* transport;
+    int destination;
+    int sender;
+    size_t batch_tuples;
+    std::vector<joined_row> r_buffer;
+    std::vector<joined_row> s_buffer;
+    uint32_t r_sequence = 0;
+    uint32_t s_sequence = 0;
+    size_t n_tuples = 0;
+    size_t n_bytes = 0;
+    size_t n_copied = 0;
+    size_t n_queued = 0;
+    size_t n_spilled = 0;
+
+    // Flow control state
+    struct pending_batch {
+        char relation;
+        const joined_row* rows; // nullptr: spilled
+        size_t count;
+        Transport::release_fn* release;
+        void* hint;
+        bool owned;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+    FlowControl* flow;
+    NodeTraffic* traffic;
+    std::deque<pending_batch> pending;
+    size_t n_owned_pending = 0;
+    SpillFile spill;
+
+    static void release_vector(void*, void* hint) {
+        delete static_cast<std::vector<joined_row>*>(hint);
+    }
+
+    // owned: the batch is an outgoing buffer (may be spilled), not a view of a send buffer
+    void send_batch(char relation, const joined_row* rows, size_t count, Transport::release_fn* release, void* hint, bool owned) {
+        if (!flow) {
+            transmit(relation, rows, count, release, hint);
+            return;
+        }
+        flow->return_credits();
+        drain(false);
+        if (pending.empty() && flow->try_acquire(destination)) {
+            transmit(relation, rows, count, release, hint);
+            return;
+        }
+        n_queued++;
+        if (owned && n_owned_pending >= flow->max_queued_batches()) {
+            spill.write(flow->spill_path(), rows, count);
+            release(const_cast<joined_row*>(rows), hint);
+            pending.push_back({relation, nullptr, count, nullptr, nullptr, true, std::chrono::steady_clock::now()});
+            n_spilled++;
+        } else {
+            pending.push_back({relation, rows, count, release, hint, owned, std::chrono::steady_clock::now()});
+            n_owned_pending += owned && rows;
+        }
+    }
+
+    // Sends queued batches while there are credits; block: until the queue is empty
+    void drain(bool block) {
+        while (!pending.empty()) {
+            if (!flow->try_acquire(destination)) {
+                if (!block) {
+                    return;
+                }
+                flow->wait_for_credit(destination);
+                continue;
+            }
+            auto batch = pending.front();
+            pending.pop_front();
+            if (traffic) {
+                traffic->waited(destination, std::chrono::duration<double>(std::chrono::steady_clock::now() - batch.queued_at).count());
+            }
+            if (batch.rows) {
+                n_owned_pending -= batch.owned;
+                transmit(batch.relation, batch.rows, batch.count, batch.release, batch.hint);
+            } else {
+                auto* rows = spill.read(batch.count);
+                transmit(batch.relation, rows->data(), rows->size(), release_vector, rows);
+            }
+        }
+    }
+
+    void transmit(char relation, const joined_row* rows, size_t count, Transport::release_fn* release, void* hint) {
+        uint32_t& sequence = relation == 'R' ? r_sequence : s_sequence;
+        batch_header header = {Data, relation, static_cast<uint16_t>(sender), sequence++, static_cast<uint32_t>(count)};
+        transport->send(destination, &header, sizeof(batch_header), rows, count, release, hint);
+        n_bytes += sizeof(batch_header) + count * sizeof(joined_row);
+        n_tuples += count;
+        if (traffic) {
+            traffic->sent(destination, relation, count, sizeof(batch_header) + count * sizeof(joined_row));
+        }
+    }
+};
+
+// Reads the header of a received frame and checks that the tuples match it
+inline batch_header parse(const Transport::frame& received) {
+    batch_header header;
+    if (received.header_bytes != sizeof(batch_header)) {
+        throw std::runtime_error("Header of " + std::to_string(received.header_bytes) + " bytes, expected " + std::to_string(sizeof(batch_header)));
+    }
+    memcpy(&header, received.header, sizeof(batch_header));
+    if (header.type == Data && received.n_rows != header.count) {
+        throw std::runtime_error("Batch of " + std::to_string(header.count) + " tuples carries " + std::to_string(received.n_rows));
+    }
+    return header;
+}
+
+// Receiver side bookkeeping: counts open streams and checks the sequence numbers of every peer
+class StreamTracker {
+public:
+    explicit StreamTracker(int n_servers)
+        : r_expected(n_servers, 0), s_expected(n_servers, 0), r_open(n_servers - 1), s_open(n_servers - 1) {}
+
+    // Returns true if the header ends a stream
+    bool accept(const batch_header& header) {
+        if (header.relation != 'R' && header.relation != 'S') {
+            throw std::runtime_error(std::string("Invalid relation in batch header: ") + header.relation);
+        }
+        uint32_t& expected = (header.relation == 'R' ? r_expected : s_expected).at(header.sender);
+        if (header.sequence != expected) {
+            throw std::runtime_error("Batch " + std::to_string(header.sequence) + " of node " + std::to_string(header.sender) +
+                                     " arrived, expected " + std::to_string(expected));
+        }
+        if (header.type == EndOfStream) {
+            (header.relation == 'R' ? r_open : s_open)--;
+            return true;
+        }
+        expected++;
+        return false;
+    }
+
+    bool r_done() const { return r_open == 0; }
+    bool done() const { return r_open == 0 && s_open == 0; }
+
+private:
+    std::vector<uint32_t> r_expected;
+    std::vector<uint32_t> s_expected;
+    int r_open;
+    int s_open;
+};
+
+} // namespace batch_protocol
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "perf_counters.h"
+
+// Registration framework of join_benchmark: every benchmark is a name and a setup function that
+// prepares its input for one parameter combination (untimed) and returns the timed body. The
+// runner sweeps the registered benchmarks over the parameter grid, runs warmups and repetitions
+// of the body and reports percentiles of the repetitions as CSV.
+namespace benchmark {
+
+struct parameters {
+    int n_servers;
+    uint64_t r_tuples; // |R|, also the number of distinct join keys
+    uint64_t s_tuples; // |S|, Zipf distributed over the keys of R
+    double alpha;      // Zipf exponent of S, 0: uniform
+};
+
+// run is timed once per repetition and returns the number of items (tuples, keys, rows) it
+// processed. reset, if given, runs untimed before every warmup and repetition, for bodies that
+// modify their input (e.g. sort it in place).
+struct body {
+    std::function<uint64_t()> run;
+    std::function<void()> reset;
+
+    template <typename RunFn>
+        requires std::is_invocable_r_v<uint64_t, RunFn&>
+    body(RunFn run) : run(std::move(run)) {}
+
+    template <typename RunFn, typename ResetFn>
+    body(RunFn run, ResetFn reset) : run(std::move(run)), reset(std::move(reset)) {}
+};
+using setup = std::function<body(const parameters&)>;
+
+// Which parameters change the result of a benchmark; the others are left out of the sweep
+enum Uses { Sizes = 1, Alpha = 2, Servers = 4, All = Sizes | Alpha | Servers };
+
+struct registration {
+    std::string name;
+    std::string description;
+    int uses;
+    setup prepare;
+};
+
+// Percentiles of the repetition times (linear interpolation between the closest ranks)
+struct summary {
+    size_t repetitions;
+    double min, median, p90, p99, max, mean;
+
+    static summary of(std::vector<double> seconds) {
+        if (seconds.empty()) {
+            throw std::invalid_argument("No repetitions to summarize");
+        }
+        std::sort(seconds.begin(), seconds.end());
+        double sum = 0;
+        for (double s : seconds) {
+            sum += s;
+        }
+        return {seconds.size(), seconds.front(), percentile(seconds, 0.5), percentile(seconds, 0.9), percentile(seconds, 0.99), seconds.back(), sum / seconds.size()};
+    }
+
+    // sorted must be sorted ascending, fraction in [0, 1]
+    static double percentile(const std::vector<double>& sorted, double fraction) {
+        double rank = fraction * (sorted.size() - 1);
+        size_t below = static_cast<size_t>(std::floor(rank));
+        size_t above = std::min(below + 1, sorted.size() - 1);
+        return sorted[below] + (rank - below) * (sorted[above] - sorted[below]);
+    }
+};
+
+struct result {
+    std::string name;
+    parameters params;
+    uint64_t items; // Of one repetition
+    summary seconds;
+    perf::sample counters; // Mean of the repetitions, nothing available unless sweep::counters
+};
+
+class Registry {
+public:
+    void add(const std::string& name, const std::string& description, int uses, setup prepare) {
+        for (const auto& b : benchmarks) {
+            if (b.name == name) {
+                throw std::invalid_argument("Benchmark " + name + " registered twice");
+            }
+        }
+        benchmarks.push_back({name, description, uses, std::move(prepare)});
+    }
+
+    const std::vector<registration>& all() const { return benchmarks; }
+
+    // Benchmarks whose name contains filter (all for an empty filter)
+    std::vector<const registration*> matching(const std::string& filter) const {
+        std::vector<const registration*> result;
+        for (const auto& b : benchmarks) {
+            if (b.name.find(filter) != std::string::npos) {
+                result.push_back(&b);
+            }
+        }
+        return result;
+    }
+
+private:
+    std::vector<registration> benchmarks;
+};
+
+// Parameter grid of a sweep
+struct sweep {
+    std::vector<int> n_servers = {4};
+    std::vector<uint64_t> r_tuples = {100000};
+    std::vector<uint64_t> s_tuples = {1000000};
+    std::vector<double> alpha = {0.0, 1.0};
+    int warmups = 1;
+    int repetitions = 5;
+    bool counters = false; // Hardware counters of the repetitions (utils/perf_counters.h)
+
+    // Combinations of the parameters in uses; the other parameters keep their first value
+    std::vector<parameters> grid(int uses) const {
+        std::vector<parameters> result;
+        for (size_t si = 0; si < (uses & Servers ? n_servers.size() : 1); ++si) {
+            for (size_t ri = 0; ri < (uses & Sizes ? r_tuples.size() : 1); ++ri) {
+                for (size_t sj = 0; sj < (uses & Sizes ? s_tuples.size() : 1); ++sj) {
+                    for (size_t ai = 0; ai < (uses & Alpha ? alpha.size() : 1); ++ai) {
+                        result.push_back({n_servers[si], r_tuples[ri], s_tuples[sj], alpha[ai]});
+                    }
+                }
+            }
+        }
+        return result;
+    }
+};
+
+inline void write_csv_header(std::ostream& out) {
+    out << "benchmark,n_servers,r_tuples,s_tuples,alpha,repetitions,items,min_seconds,median_seconds,p90_seconds,p99_seconds,max_seconds,mean_seconds,"
+           "items_per_second";
+    perf::sample::write_csv_header(out);
+    out << '\n';
+}
+
+// items_per_second is taken at the median
+inline void write_csv_row(std::ostream& out, const result& r) {
+    const auto& s = r.seconds;
+    out << r.name << ',' << r.params.n_servers << ',' << r.params.r_tuples << ',' << r.params.s_tuples << ',' << r.params.alpha << ',' << s.repetitions << ','
+        << r.items << ',' << s.min << ',' << s.median << ',' << s.p90 << ',' << s.p99 << ',' << s.max << ',' << s.mean << ','
+        << (s.median > 0 ? r.items / s.median : 0);
+    r.counters.write_csv(out, r.items);
+    out << '\n';
+}
+
+// Sets up b for every parameter combination it uses, runs the warmups and repetitions and calls
+// report(result) once per combination
+template <typename ReportFn>
+void run(const registration& b, const sweep& grid, ReportFn report) {
+    for (const auto& params : grid.grid(b.uses)) {
+        body timed = b.prepare(params);
+        for (int w = 0; w < grid.warmups; ++w) {
+            if (timed.reset) {
+                timed.reset();
+            }
+            timed.run();
+        }
+        std::vector<double> seconds;
+        uint64_t items = 0;
+        perf::sample counters;
+        int repetitions = std::max(1, grid.repetitions);
+        for (int r = 0; r < repetitions; ++r) {
+            if (timed.reset) {
+                timed.reset();
+            }
+            auto start = std::chrono::steady_clock::now();
+            {
+                perf::Scope measure(grid.counters ? &counters : nullptr);
+                items = timed.run();
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            seconds.push_back(elapsed.count());
+        }
+        for (double& value : counters.values) {
+            value /= repetitions;
+        }
+        counters.seconds /= repetitions;
+        report(result{b.name, params, items, summary::of(seconds), counters});
+    }
+}
+
+} // namespace benchmark
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zmq.hpp>
+
+// Node addresses of a cluster run, one "host:port" (or "host port") per line ('#' starts a comment):
+//   coordinator localhost:5549   optional, default: host of node 0, largest node port + 1
+//   localhost:5550               node 0
+//   localhost:5551               node 1
+struct cluster_config {
+    std::vector<std::string> nodes; // host:port of every node, the index is the node id
+    std::string coordinator;        // host:port of the coordinator, run by node 0
+};
+
+inline cluster_config read_cluster_config(const std::string& file_name) {
+    std::ifstream file(file_name);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open cluster config " + file_name);
+    }
+    cluster_config config;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        std::string first, second;
+        std::istringstream fields(line);
+        fields >> first >> second;
+        if (first.empty()) {
+            continue;
+        }
+        if (first == "coordinator") {
+            config.coordinator = second;
+        } else if (!second.empty()) {
+            config.nodes.push_back(first + ":" + second); // "ip port" as read by readServerConfig of the tests
+        } else {
+            config.nodes.push_back(first);
+        }
+    }
+    for (const auto& address : config.nodes) {
+        if (address.find(':') == std::string::npos) {
+            throw std::runtime_error("Node address " + address + " in " + file_name + " is not host:port");
+        }
+    }
+    if (config.nodes.empty()) {
+        throw std::runtime_error("No nodes in cluster config " + file_name);
+    }
+    if (config.coordinator.empty()) {
+        int max_port = 0;
+        for (const auto& address : config.nodes) {
+            max_port = std::max(max_port, std::stoi(address.substr(address.rfind(':') + 1)));
+        }
+        config.coordinator = config.nodes[0].substr(0, config.nodes[0].rfind(':')) + ":" + std::to_string(max_port + 1);
+    }
+    return config;
+}
+
+// What every node reports at the end of a run, gathered so that node 0 can print the totals
+struct node_statistics {
+    double shuffle_seconds; // From the start of the shuffle until all streams ended (and joined, if pipelined)
+    double join_seconds;    // Local join after the shuffle, 0 if pipelined
+    uint64_t tuples_sent;   // Sent to other nodes
+    uint64_t r_tuples;      // Received by the join of the node, including its own
+    uint64_t s_tuples;
+    uint64_t rows;          // Joined rows
+    double load_seconds;    // Reading the local partitions
+};
+
+// Control plane of the distributed joins: barriers and the exchange of small values (samples for
+// heavy hitter detection, tuple counts, statistics) between the phases. Data goes through the
+// Transport.
+class Coordinator {
+public:
+    virtual ~Coordinator() = default;
+
+    // Every node contributes a block of bytes and gets the blocks of all nodes, indexed by node id.
+    // Acts as a barrier.
+    virtual std::vector<std::string> all_gather(int id, const std::string& block) = 0;
+
+    // Node id failed and takes no further part, all_gather throws in the other nodes instead of
+    // waiting for its block
+    virtual void leave(int id) = 0;
+
+    void barrier(int id) { all_gather(id, std::string()); }
+
+    template <typename T>
+    std::vector<std::vector<T>> all_gather_values(int id, const std::vector<T>& values) {
+        std::string block(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+        std::vector<std::vector<T>> result;
+        for (const auto& b : all_gather(id, block)) {
+            result.emplace_back(b.size() / sizeof(T));
+            memcpy(result.back().data(), b.data(), b.size());
+        }
+        return result;
+    }
+
+    template <typename T>
+    std::vector<T> all_gather_value(int id, const T& value) {
+        std::vector<T> result;
+        for (const auto& values : all_gather_values(id, std::vector<T>{value})) {
+            result.push_back(values.at(0));
+        }
+        return result;
+    }
+};
+
+// All nodes are threads of one process
+class LocalCoordinator : public Coordinator {
+public:
+    explicit LocalCoordinator(int n_servers) : sync_point(n_servers), blocks(n_servers) {}
+
+    std::vector<std::string> all_gather(int id, const std::string& block) override {
+        check_aborted(id);
+        blocks[id] = block;
+        sync_point.arrive_and_wait();
+        check_aborted(id);
+        auto result = blocks;
+        sync_point.arrive_and_wait(); // Nobody overwrites a block before all have copied them
+        check_aborted(id);
+        return result;
+    }
+
+    void leave(int) override {
+        aborted = true;
+        sync_point.arrive_and_drop();
+    }
+
+private:
+    std::barrier<> sync_point;
+    std::vector<std::string> blocks;
+    std::atomic<bool> aborted{false}; // A node left, the others stop at their next barrier
+
+    void check_aborted(int id) const {
+        if (aborted) {
+            throw std::runtime_error("Node " + std::to_string(id) + " stopped, another node failed");
+        }
+    }
+};
+
+// Every node is a process. Node 0 runs the coordinator on a thread: it collects one request from
+// every node (ZMQ ROUTER), then answers all of them with the blocks of all nodes. A request is
+// [uint32 node id][uint8 leaving][block]; a reply is [uint8 failed] and [uint32 size][block] per node.
+// A node that left (destructor, also when it failed) is not waited for in later rounds. Once a node
+// left, the rounds of the others fail and all_gather throws instead of returning its missing block.
+// A node leaves when it fails (leave) or at the latest in the destructor. The coordinator stops
+// after the round in which the last node left.
+class ClusterCoordinator : public Coordinator {
+public:
+    ClusterCoordinator(int id, int n_servers, const std::string& address) : id(id), context(1), socket(context, zmq::socket_type::req) {
+        if (id == 0) {
+            zmq::socket_t router(context, zmq::socket_type::router);
+            router.bind("tcp://*:" + address.substr(address.rfind(':') + 1));
+            server = std::thread(serve, std::move(router), n_servers);
+        }
+        socket.connect("tcp://" + address);
+    }
+
+    ~ClusterCoordinator() override {
+        leave(id);
+        if (server.joinable()) {
+            server.join();
+        }
+        socket.close();
+    }
+
+    // Every process runs one node, the node id is the one given to the constructor
+    std::vector<std::string> all_gather(int, const std::string& block) override {
+        return request(block, false);
+    }
+
+    void leave(int) override {
+        if (has_left) {
+            return;
+        }
+        has_left = true;
+        try {
+            request(std::string(), true);
+        } catch (const std::exception& e) {
+            std::cerr << "Node " << id << " could not leave the cluster: " << e.what() << std::endl;
+        }
+    }
+
+private:
+    int id;
+    bool has_left = false;
+    zmq::context_t context;
+    zmq::socket_t socket;
+    std::thread server;
+
+    std::vector<std::string> request(const std::string& block, bool leaving) {
+        std::string payload(sizeof(uint32_t) + 1, '\0');
+        uint32_t node = id;
+        memcpy(payload.data(), &node, sizeof(uint32_t));
+        payload[sizeof(uint32_t)] = leaving;
+        payload += block;
+        socket.send(zmq::buffer(payload), zmq::send_flags::none);
+
+        zmq::message_t reply;
+        if (!socket.recv(reply, zmq::recv_flags::none)) {
+            throw std::runtime_error("No reply from the coordinator");
+        }
+        const char* data = static_cast<const char*>(reply.data());
+        if (data[0] && !leaving) {
+            throw std::runtime_error("Node " + std::to_string(id) + " stopped, another node left the cluster");
+        }
+        std::vector<std::string> blocks;
+        for (size_t offset = 1; offset < reply.size();) {
+            uint32_t size;
+            memcpy(&size, data + offset, sizeof(uint32_t));
+            blocks.emplace_back(data + offset + sizeof(uint32_t), size);
+            offset += sizeof(uint32_t) + size;
+        }
+        return blocks;
+    }
+
+    static void serve(zmq::socket_t router, int n_servers) {
+        try {
+            std::vector<bool> left(n_servers, false);
+            int n_left = 0;
+            while (n_left < n_servers) {
+                // One round: a request of every node that has not left
+                std::vector<zmq::message_t> identities(n_servers);
+                std::vector<std::string> blocks(n_servers);
+                int expected = n_servers - n_left, n_leaving = 0;
+                for (int received = 0; received < expected; ++received) {
+                    zmq::message_t identity, delimiter, payload;
+                    router.recv(identity, zmq::recv_flags::none);
+                    router.recv(delimiter, zmq::recv_flags::none);
+                    router.recv(payload, zmq::recv_flags::none);
+                    uint32_t node;
+                    memcpy(&node, payload.data(), sizeof(uint32_t));
+                    if (node >= static_cast<uint32_t>(n_servers) || left[node] || identities[node].size() > 0) {
+                        throw std::runtime_error("Unexpected request of node " + std::to_string(node));
+                    }
+                    if (static_cast<const char*>(payload.data())[sizeof(uint32_t)]) {
+                        left[node] = true;
+                        ++n_leaving;
+                    }
+                    blocks[node].assign(static_cast<const char*>(payload.data()) + sizeof(uint32_t) + 1, payload.size() - sizeof(uint32_t) - 1);
+                    identities[node] = std::move(identity);
+                }
+                // A node left while others still take part: their round lacks its block
+                bool failed = n_left + n_leaving > 0 && n_leaving < expected;
+                n_left += n_leaving;
+
+                std::string reply(1, failed);
+                for (const auto& block : blocks) {
+                    uint32_t size = block.size();
+                    reply.append(reinterpret_cast<const char*>(&size), sizeof(uint32_t));
+                    reply += block;
+                }
+                for (auto& identity : identities) {
+                    if (identity.size() == 0) {
+                        continue; // Left in an earlier round
+                    }
+                    router.send(identity, zmq::send_flags::sndmore);
+                    router.send(zmq::buffer(std::string()), zmq::send_flags::sndmore);
+                    router.send(zmq::buffer(reply), zmq::send_flags::none);
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Coordinator error: " << e.what() << std::endl;
+        }
+        router.close();
+    }
+};
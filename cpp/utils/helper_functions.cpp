@@ -1,6 +1,7 @@
 #include <iomanip>
 #include <unordered_map>
 #include "helper_functions.h"
+#include "trace.h"
 
 vector<string> get_all_files_in_directory(const string& directory_path) {
     vector<string> file_names;
@@ -30,14 +31,27 @@ string find_file_with_prefix(const vector<string>& file_names, const string& pre
     return ""; // Return an empty string if no file matches the prefix
 }
 
-vector<joined_row> read_data(const string& filename) {
-    vector<joined_row> data;
-    ifstream file(filename);
+tuple_buffer read_data(const string& filename) {
+    TRACE_SCOPE("read_data");
+    tuple_buffer data;
+    bool binary = fs::path(filename).extension() == ".bin";
+    ifstream file(filename, binary ? ios::binary : ios::in);
 
     if (!file.is_open()) {
         throw runtime_error("Could not open file: " + filename);
     }
 
+    // Binary partitions (see gen_R_S) store (value, row number) as two uint32_t per row
+    if (binary) {
+        vector<uint32_t> pairs(fs::file_size(filename) / sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(pairs.data()), pairs.size() * sizeof(uint32_t));
+        data.reserve(pairs.size() / 2);
+        for (size_t i = 0; i + 1 < pairs.size(); i += 2) {
+            data.push_back({pairs[i], pairs[i + 1], 0});
+        }
+        return data;
+    }
+
     uint32_t val, row_idx;
     while (file >> val >> row_idx) {
         joined_row row = {val, row_idx, 0};
@@ -48,7 +62,7 @@ vector<joined_row> read_data(const string& filename) {
     return data;
 }
 
-void print_raw_hex(const vector<joined_row>& v) {
+void print_raw_hex(const tuple_buffer& v) {
     const uint8_t* byte_ptr = reinterpret_cast<const uint8_t*>(v.data()); // Get a pointer to the data
     size_t size = v.size() * sizeof(joined_row);
 
@@ -58,19 +72,13 @@ void print_raw_hex(const vector<joined_row>& v) {
     cout << dec << endl; // Print a newline and reset the format to decimal
 }
 
-void calculate_receiver_and_store(vector<joined_row>& rows, uint32_t n) {
-    for (auto& row : rows) {
-        row.row_S = row.join_val % n + 1; // Compute the row_S value
-    }
-}
-
 // Comparator function to sort by row_S
 bool compare_by_row_S(const joined_row& a, const joined_row& b) {
     return a.row_S < b.row_S; // Compare based on the row_S value
 }
 
 // Function to get the first occurrence and count of each unique join_val in a sorted vector of joined_row structures
-vector<tuple<uint32_t, size_t, size_t>> get_first_occurrence_and_count(const vector<joined_row>& sorted_rows) {
+vector<tuple<uint32_t, size_t, size_t>> get_first_occurrence_and_count(const tuple_buffer& sorted_rows) {
     vector<tuple<uint32_t, size_t, size_t>> result;
 
     if (sorted_rows.empty()) return result;
@@ -100,23 +108,23 @@ vector<tuple<uint32_t, size_t, size_t>> get_first_occurrence_and_count(const vec
     return result;
 }
 
-// Implementation of the inner_join function
-std::vector<joined_row> inner_join(const tuples_data& r_data, const tuples_data& s_data) {
-    std::vector<joined_row> result;
-    std::unordered_map<int, std::vector<joined_row>> hashTable; // Map to store the rows of r_data using the join value as key
-
+// Builds the hash table of r_data with join_val as key
+join_hash_table build_hash_table(const tuples_data& r_data) {
+    TRACE_SCOPE("build");
+    join_hash_table hashTable; // Map to store the rows of r_data using the join value as key
     int r_size = r_data.filled_rows;
-    int s_size = s_data.filled_rows;
-    
-    // Build the table from the data in r_data
     for (int i = 0; i < r_size; ++i) {
         const joined_row& row = r_data.tuples[i];
         hashTable[row.join_val].push_back(row); // Insert row into hash table with join_val as key
     }
+    return hashTable;
+}
 
-    // Process s_data and perform join
-    for (int i = 0; i < s_size; ++i) {
-        const joined_row& row = s_data.tuples[i]; // Get the current row
+// Probes s_rows[0, n) against the hash table and appends the joined rows to result
+void probe_hash_table(const join_hash_table& hashTable, const joined_row* s_rows, size_t n, std::vector<joined_row>& result) {
+    TRACE_SCOPE("probe");
+    for (size_t i = 0; i < n; ++i) {
+        const joined_row& row = s_rows[i]; // Get the current row
         auto it = hashTable.find(row.join_val); // Find the join_val in the hash table
         // If the join_val is found in the hash table
         if (it != hashTable.end()) {
@@ -124,11 +132,17 @@ std::vector<joined_row> inner_join(const tuples_data& r_data, const tuples_data&
                 joined_row joined;
                 joined.join_val = row.join_val;
                 joined.row_R = r_row.row_R;
-                joined.row_S = row.row_S;
+                joined.row_S = row.row_R; // read_data stores the row number of an S tuple in row_R
                 result.push_back(joined); // Add the joined row to the result vector
             }
         }
     }
+}
 
+// Implementation of the inner_join function
+std::vector<joined_row> inner_join(const tuples_data& r_data, const tuples_data& s_data) {
+    std::vector<joined_row> result;
+    auto hashTable = build_hash_table(r_data);
+    probe_hash_table(hashTable, s_data.tuples.data(), s_data.filled_rows, result);
     return result;
-}
\ No newline at end of file
+}
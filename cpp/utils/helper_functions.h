@@ -1,3 +1,5 @@
+#pragma once
+
 #include <iostream>
 #include <thread>
 #include <string>
@@ -5,6 +7,8 @@
 #include <fstream>
 #include <vector>
 #include <filesystem>
+#include <unordered_map>
+#include "huge_page_allocator.h"
 
 using namespace std;
 namespace fs = filesystem;
@@ -15,16 +19,21 @@ struct joined_row{
     uint32_t row_S;
 };
 
+// Tuple storage: uninitialized on resize, huge-page backed and pre-faulted when large
+using tuple_buffer = std::vector<joined_row, HugePageAllocator<joined_row>>;
+
 struct tuples_data {
-    std::vector<joined_row> tuples;
+    tuple_buffer tuples;
     int filled_rows;
 };
 
 vector<string> get_all_files_in_directory(const string& directory_path);
 string find_file_with_prefix(const vector<string>& file_names, const string& prefix);
-vector<joined_row> read_data(const string& filename);
-void print_raw_hex(const vector<joined_row>& v);
+tuple_buffer read_data(const string& filename);
+void print_raw_hex(const tuple_buffer& v);
 bool compare_by_row_S(const joined_row& a, const joined_row& b);
-void calculate_receiver_and_store(vector<joined_row>& rows, uint32_t n);
-vector<tuple<uint32_t, size_t, size_t>> get_first_occurrence_and_count(const vector<joined_row>& sorted_rows);
+vector<tuple<uint32_t, size_t, size_t>> get_first_occurrence_and_count(const tuple_buffer& sorted_rows);
+using join_hash_table = std::unordered_map<int, std::vector<joined_row>>;
+join_hash_table build_hash_table(const tuples_data& r_data);
+void probe_hash_table(const join_hash_table& hashTable, const joined_row* s_rows, size_t n, std::vector<joined_row>& result);
 std::vector<joined_row> inner_join(const tuples_data& r_data, const tuples_data& s_data);
\ No newline at end of file
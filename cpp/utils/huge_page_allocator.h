@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23 // Linux 5.14, older kernels return EINVAL and pages are touched instead
+#endif
+
+// Memory for large tuple buffers.
+// - Large allocations get their own anonymous mapping, backed by explicit huge pages
+//   (MAP_HUGETLB) if some are reserved, otherwise by transparent huge pages (MADV_HUGEPAGE).
+// - The mapping is pre-faulted right away, so page faults are paid at allocation time and
+//   not later inside the shuffle or the join.
+// - Small allocations fall back to malloc.
+namespace huge_pages {
+
+const size_t HUGE_PAGE_SIZE = 2 << 20;
+const size_t MIN_MAPPED_BYTES = 1 << 20;  // Smaller buffers are not worth a mapping
+
+inline size_t mapped_size(size_t bytes) {
+    return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+inline void prefault(void* ptr, size_t bytes) {
+    if (madvise(ptr, bytes, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+    // Touch one byte per page
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    volatile char* p = static_cast<char*>(ptr);
+    for (size_t offset = 0; offset < bytes; offset += page_size) {
+        p[offset] = 0;
+    }
+}
+
+inline void* allocate(size_t bytes) {
+    if (bytes < MIN_MAPPED_BYTES) {
+        void* ptr = std::malloc(bytes == 0 ? 1 : bytes);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    size_t size = mapped_size(bytes);
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (ptr != MAP_FAILED) {
+        return ptr;
+    }
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    madvise(ptr, size, MADV_HUGEPAGE);
+    prefault(ptr, size);
+    return ptr;
+}
+
+inline void deallocate(void* ptr, size_t bytes) {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (bytes < MIN_MAPPED_BYTES) {
+        std::free(ptr);
+    } else {
+        munmap(ptr, mapped_size(bytes));
+    }
+}
+
+}
+
+// STL allocator on top of huge_pages. Elements are default-initialized instead of
+// value-initialized, so resize() on a vector of trivial types leaves memory untouched
+// instead of zeroing it.
+template <typename T>
+class HugePageAllocator {
+public:
+    using value_type = T;
+
+    HugePageAllocator() noexcept = default;
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(huge_pages::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept {
+        huge_pages::deallocate(ptr, n * sizeof(T));
+    }
+
+    template <typename U>
+    void construct(U* ptr) noexcept {
+        ::new (static_cast<void*>(ptr)) U; // Default-initialization, no zeroing
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* ptr, Args&&... args) {
+        ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    bool operator==(const HugePageAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const HugePageAllocator<U>&) const noexcept { return false; }
+};
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "helper_functions.h"
+
+// Residual load balancing after the shuffle. The join cost of server i is modeled as
+//   build_cost * |R_i| + probe_cost * |S_i|
+// A server whose cost exceeds the average by more than max_imbalance has its S partition split
+// into chunks (index ranges), all other servers keep theirs as a single chunk. During the join
+// every server works through its own chunks from the front; once done it steals chunks of the
+// oversized server with the most remaining work from the back, as long as its own cost stays
+// within the tolerated imbalance (a slow owner is not robbed by a thief that then becomes
+// the straggler itself). A thief needs the R partition
+// of its victim: in a cluster it would be replicated once per thief, here the servers share the
+// victim's hash table and the replication is only counted (replicated R tuples, modeled cost).
+class LoadBalancer {
+public:
+    struct parameters {
+        double build_cost = 1.0;          // Cost of inserting one R tuple into the hash table
+        double probe_cost = 1.0;          // Cost of probing one S tuple
+        double max_imbalance = 0.1;       // Tolerated cost above the average, relative to it
+        size_t min_chunk_tuples = 1 << 12; // Smallest chunk worth stealing
+    };
+
+    struct chunk {
+        size_t begin;
+        size_t end;
+    };
+
+    LoadBalancer(const std::vector<size_t>& r_sizes, const std::vector<size_t>& s_sizes, const parameters& params)
+        : n_servers(r_sizes.size()), params(params), r_sizes(r_sizes), s_sizes(s_sizes),
+          chunks(n_servers), front(n_servers, 0), back(n_servers, 0), queue_mutex(n_servers),
+          work(n_servers, 0), split(n_servers, false), replicated(n_servers, std::vector<bool>(n_servers, false)) {
+        for (size_t i = 0; i < n_servers; ++i) {
+            average += cost(i);
+        }
+        average /= std::max<size_t>(n_servers, 1);
+
+        // Chunks of an oversized partition are an eighth of the average probe work
+        size_t chunk_tuples = std::max(params.min_chunk_tuples, static_cast<size_t>(average / params.probe_cost / 8));
+        for (size_t i = 0; i < n_servers; ++i) {
+            bool oversized = cost(i) > (1 + params.max_imbalance) * average;
+            size_t step = oversized ? chunk_tuples : std::max<size_t>(s_sizes[i], 1);
+            for (size_t begin = 0; begin < s_sizes[i]; begin += step) {
+                chunks[i].push_back({begin, std::min(begin + step, s_sizes[i])});
+            }
+            if (chunks[i].empty()) {
+                chunks[i].push_back({0, 0});
+            }
+            back[i] = chunks[i].size();
+            split[i] = oversized;
+            n_split += oversized;
+        }
+    }
+
+    // Modeled join cost of server i without balancing
+    double cost(size_t i) const {
+        return params.build_cost * r_sizes[i] + params.probe_cost * s_sizes[i];
+    }
+
+    size_t n_chunks(int server) const { return chunks[server].size(); }
+    const chunk& get_chunk(int server, size_t index) const { return chunks[server][index]; }
+
+    // Called by every server after building its own hash table: processes its own chunks, then
+    // steals until no chunk is left. process(server, chunk index) joins one chunk.
+    template <typename ProcessFn>
+    void run_tasks(int id, ProcessFn process) {
+        work[id] += params.build_cost * r_sizes[id];
+        size_t index;
+        while (pop_front(id, index)) {
+            process(id, index);
+            work[id] += params.probe_cost * (chunks[id][index].end - chunks[id][index].begin);
+        }
+        int victim;
+        while (steal(id, victim, index)) {
+            if (!replicated[id][victim]) {
+                replicated[id][victim] = true;
+                work[id] += params.build_cost * r_sizes[victim];
+            }
+            process(victim, index);
+            work[id] += params.probe_cost * (chunks[victim][index].end - chunks[victim][index].begin);
+        }
+    }
+
+    // Max / average of the modeled cost, before balancing (per partition) and after (per server)
+    double imbalance_before() const {
+        std::vector<double> costs(n_servers);
+        for (size_t i = 0; i < n_servers; ++i) {
+            costs[i] = cost(i);
+        }
+        return imbalance(costs);
+    }
+
+    double imbalance_after() const { return imbalance(work); }
+
+    size_t replicated_r_tuples() const {
+        size_t n = 0;
+        for (size_t thief = 0; thief < n_servers; ++thief) {
+            for (size_t victim = 0; victim < n_servers; ++victim) {
+                n += replicated[thief][victim] ? r_sizes[victim] : 0;
+            }
+        }
+        return n;
+    }
+
+    static double imbalance(const std::vector<double>& values) {
+        double sum = 0, max_value = 0;
+        for (double v : values) {
+            sum += v;
+            max_value = std::max(max_value, v);
+        }
+        return sum > 0 ? max_value * values.size() / sum : 1.0;
+    }
+
+    // join_times: measured join time of every server
+    void print_report(std::ostream& out, const std::vector<double>& join_times) const {
+        out << "Load balancing: " << n_split << " oversized partitions split, " << stolen << " chunks stolen, "
+            << replicated_r_tuples() << " R tuples replicated.\n";
+        for (size_t i = 0; i < n_servers; ++i) {
+            out << "Server " << i << ": cost before " << cost(i) << ", after " << work[i] << "\n";
+        }
+        out << "Imbalance (max / average cost): before " << imbalance_before() << ", after " << imbalance_after()
+            << ", measured join time " << imbalance(join_times) << "\n";
+    }
+
+private:
+    size_t n_servers;
+    parameters params;
+    std::vector<size_t> r_sizes;
+    std::vector<size_t> s_sizes;
+    std::vector<std::vector<chunk>> chunks;
+    std::vector<size_t> front;           // Next chunk of the owner
+    std::vector<size_t> back;            // One past the next chunk for thieves
+    std::vector<std::mutex> queue_mutex;
+    std::vector<double> work;            // Modeled cost processed by every server
+    std::vector<bool> split;             // Only chunks of split partitions are stolen
+    std::vector<std::vector<bool>> replicated; // replicated[thief][victim]: R of victim shipped to thief
+    double average = 0;                  // Average modeled cost per server
+    size_t n_split = 0;
+    size_t stolen = 0;
+    std::mutex stolen_mutex;
+
+    bool pop_front(int server, size_t& index) {
+        std::lock_guard<std::mutex> lock(queue_mutex[server]);
+        if (front[server] == back[server]) {
+            return false;
+        }
+        index = front[server]++;
+        return true;
+    }
+
+    // Modeled cost for the thief to join chunk index of victim, including the replication of R
+    double steal_cost(int thief, int victim, size_t index) const {
+        const chunk& c = chunks[victim][index];
+        return params.probe_cost * (c.end - c.begin) + (replicated[thief][victim] ? 0 : params.build_cost * r_sizes[victim]);
+    }
+
+    // Takes the last chunk of the split partition with the most remaining chunks
+    bool steal(int thief, int& victim, size_t& index) {
+        const double budget = (1 + params.max_imbalance) * average - work[thief];
+        while (true) {
+            victim = -1;
+            size_t most_remaining = 0;
+            for (size_t i = 0; i < n_servers; ++i) {
+                std::lock_guard<std::mutex> lock(queue_mutex[i]);
+                if (split[i] && static_cast<int>(i) != thief && back[i] - front[i] > most_remaining &&
+                    steal_cost(thief, i, back[i] - 1) <= budget) {
+                    most_remaining = back[i] - front[i];
+                    victim = i;
+                }
+            }
+            if (victim < 0) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(queue_mutex[victim]);
+            if (front[victim] < back[victim] && steal_cost(thief, victim, back[victim] - 1) <= budget) { // The owner may have taken it meanwhile
+                index = --back[victim];
+                std::lock_guard<std::mutex> stolen_lock(stolen_mutex);
+                stolen++;
+                return true;
+            }
+        }
+    }
+};
+
+// Join phase of the local joins on top of LoadBalancer. One server calls prepare(), then every
+// server calls build(), probe() and result() for itself, with a barrier after each of them.
+class BalancedJoin {
+public:
+    BalancedJoin(const std::vector<tuples_data>& r_data, const std::vector<tuples_data>& s_data, const LoadBalancer::parameters& params)
+        : r_data(r_data), s_data(s_data), params(params), tables(r_data.size()), chunk_results(r_data.size()) {}
+
+    void prepare() {
+        std::vector<size_t> r_sizes, s_sizes;
+        for (size_t i = 0; i < r_data.size(); ++i) {
+            r_sizes.push_back(r_data[i].filled_rows);
+            s_sizes.push_back(s_data[i].filled_rows);
+        }
+        balancer = std::make_unique<LoadBalancer>(r_sizes, s_sizes, params);
+        for (size_t i = 0; i < r_data.size(); ++i) {
+            chunk_results[i].resize(balancer->n_chunks(i));
+        }
+    }
+
+    void build(int id) {
+        tables[id] = build_hash_table(r_data[id]);
+    }
+
+    void probe(int id) {
+        balancer->run_tasks(id, [this](int server, size_t index) {
+            const auto& c = balancer->get_chunk(server, index);
+            probe_hash_table(tables[server], s_data[server].tuples.data() + c.begin, c.end - c.begin, chunk_results[server][index]);
+        });
+    }
+
+    // Joined rows of server id, in the same order as without balancing
+    std::vector<joined_row> result(int id) {
+        size_t n = 0;
+        for (const auto& rows : chunk_results[id]) {
+            n += rows.size();
+        }
+        std::vector<joined_row> joined;
+        joined.reserve(n);
+        for (auto& rows : chunk_results[id]) {
+            joined.insert(joined.end(), rows.begin(), rows.end());
+            std::vector<joined_row>().swap(rows);
+        }
+        return joined;
+    }
+
+    const LoadBalancer& get_balancer() const { return *balancer; }
+
+private:
+    const std::vector<tuples_data>& r_data;
+    const std::vector<tuples_data>& s_data;
+    LoadBalancer::parameters params;
+    std::unique_ptr<LoadBalancer> balancer;
+    std::vector<join_hash_table> tables;
+    std::vector<std::vector<std::vector<joined_row>>> chunk_results; // [server][chunk]
+};
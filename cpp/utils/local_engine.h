@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include "trace.h"
+#include "perf_counters.h"
+
+// Runs the simulated servers of the local joins in parallel: one thread per server, pinned
+// to its own core, with private send/receive buffers. Servers exchange tuples through shared
+// memory only between phases, which are separated by a barrier (load, detect, shuffle, join).
+// The time every server spends inside each phase is recorded, so a straggler caused by skew
+// shows up in its own row and in the per-phase maximum (the makespan of that phase).
+class LocalEngine {
+public:
+    enum Phase { Load, Detect, Shuffle, Join, N_PHASES };
+
+    LocalEngine(int n_servers, bool pin_threads = true)
+        : n_servers(n_servers), pin_threads(pin_threads), sync_point(n_servers),
+          times(n_servers, std::array<double, N_PHASES>{}) {}
+
+    // Calls server(id) on n_servers threads and waits for all of them
+    template <typename ServerFn>
+    void run(ServerFn server) {
+        auto start = std::chrono::high_resolution_clock::now();
+        aborted = false;
+        std::vector<std::thread> threads;
+        for (int id = 0; id < n_servers; ++id) {
+            threads.emplace_back([this, id, &server]() {
+                if (pin_threads) {
+                    pin_to_core(id);
+                }
+                TRACE_THREAD_NAME("server " + std::to_string(id));
+                try {
+                    server(id);
+                } catch (...) {
+                    // Leave the barrier so the other servers do not wait forever, rethrown by run().
+                    // The others stop at the next barrier instead of reading the state of this server.
+                    {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                    }
+                    aborted = true;
+                    sync_point.arrive_and_drop();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        wall_time = elapsed.count();
+    }
+
+    // Runs one step of a phase on server id and waits for all servers to finish it. A phase may
+    // consist of several steps (e.g. histogram, allocate, scatter), their times are added up.
+    // Throws once all servers are at the barrier if one of them failed.
+    template <typename StepFn>
+    void step(int id, Phase phase, StepFn body) {
+        auto start = std::chrono::high_resolution_clock::now();
+        {
+            TRACE_SCOPE(phase_name(phase));
+            perf::Scope measure(counters.empty() ? nullptr : &counters[id][phase]);
+            body();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        times[id][phase] += elapsed.count();
+        TRACE_SCOPE("barrier");
+        sync_point.arrive_and_wait();
+        if (aborted) {
+            throw std::runtime_error("Server " + std::to_string(id) + " stopped, another server failed");
+        }
+    }
+
+    double time(int id, Phase phase) const { return times[id][phase]; }
+
+    // Hardware counters of every server and phase (utils/perf_counters.h), call before run()
+    void enable_counters() { counters.assign(n_servers, std::array<perf::sample, N_PHASES>{}); }
+
+    // Sum over all servers
+    perf::sample phase_counters(Phase phase) const {
+        perf::sample sum;
+        for (const auto& server_counters : counters) {
+            sum.add(server_counters[phase]);
+        }
+        return sum;
+    }
+
+    // Slowest server of a phase, all others wait for it at the barrier
+    double phase_makespan(Phase phase) const {
+        double max_time = 0;
+        for (const auto& server_times : times) {
+            max_time = std::max(max_time, server_times[phase]);
+        }
+        return max_time;
+    }
+
+    double total_wall_time() const { return wall_time; }
+
+    static const char* phase_name(Phase phase) {
+        static const char* names[N_PHASES] = {"load", "detect", "shuffle", "join"};
+        return names[phase];
+    }
+
+    void print_times(std::ostream& out) const {
+        out << "Phase times in seconds (" << n_servers << " servers, " << (pin_threads ? "pinned" : "unpinned") << " threads):\n";
+        out << std::setw(8) << "server";
+        for (int p = 0; p < N_PHASES; ++p) {
+            out << std::setw(12) << phase_name(static_cast<Phase>(p));
+        }
+        out << "\n";
+        for (int id = 0; id < n_servers; ++id) {
+            out << std::setw(8) << id;
+            for (int p = 0; p < N_PHASES; ++p) {
+                out << std::setw(12) << times[id][p];
+            }
+            out << "\n";
+        }
+        out << std::setw(8) << "max";
+        for (int p = 0; p < N_PHASES; ++p) {
+            out << std::setw(12) << phase_makespan(static_cast<Phase>(p));
+        }
+        out << "\nTotal wall time: " << wall_time << " seconds.\n";
+    }
+
+    // IPC and counters per tuple (of n_tuples, e.g. |R| + |S|) of every phase, summed over the servers
+    void print_counters(std::ostream& out, size_t n_tuples) const {
+        if (counters.empty()) {
+            return;
+        }
+        out << "Hardware counters per phase (all servers, per input tuple):\n";
+        for (int p = 0; p < N_PHASES; ++p) {
+            out << std::setw(8) << phase_name(static_cast<Phase>(p)) << ": ";
+            phase_counters(static_cast<Phase>(p)).print(out, n_tuples);
+            out << "\n";
+        }
+        if (!phase_counters(Load).has(perf::Cycles)) {
+            out << "Cycles and instructions are not available (no PMU access: VM or perf_event_paranoid).\n";
+        }
+    }
+
+private:
+    int n_servers;
+    bool pin_threads;
+    std::barrier<> sync_point;
+    std::vector<std::array<double, N_PHASES>> times;
+    std::vector<std::array<perf::sample, N_PHASES>> counters; // Empty unless enabled
+    double wall_time = 0;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    std::atomic<bool> aborted{false}; // A server failed, the others leave at their next barrier
+
+    static void pin_to_core(int id) {
+        unsigned n_cores = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(id % n_cores, &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+    }
+};
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "helper_functions.h"
+#include "SpaceSaving.h"
+#include "result_writer.h"
+#include "radix_scatter.h"
+#include "partition_function.h"
+#include "local_engine.h"
+#include "load_balancer.h"
+#include "skew_planner.h"
+#include "trace.h"
+
+// The flow join and the hash join on the simulated servers of a LocalEngine, as run by
+// flow_join_local and hash_join_local and, on generated data in one process, by skew_sweep.
+// Both keep the private and receive buffers of every server and what the shuffle moved, so the
+// caller can report per-server load and traffic after run().
+
+// Fills the R and S partitions of server id, called on its thread in the load phase
+using partition_loader = std::function<void(int id, tuples_data& r, tuples_data& s)>;
+
+class LocalJoin {
+public:
+    struct options {
+        PartitionFunction::Method partitioning = PartitionFunction::Modulo;
+        bool balance = false;              // Residual load balancing of the join phase
+        std::string result_folder;         // Join results are only kept if given
+        SkewPlanner::parameters planner;   // Flow join only
+    };
+
+    LocalJoin(int n_servers, const options& opts)
+        : n_servers(n_servers), opts(opts), partition(opts.partitioning, n_servers),
+          r_data_send(n_servers), s_data_send(n_servers), r_data_receive(n_servers), s_data_receive(n_servers),
+          s_histograms(n_servers), r_histograms(n_servers), num_s_tuples_sent(n_servers, 0), num_r_tuples_sent(n_servers, 0),
+          join_sizes(n_servers, 0), balanced_join(r_data_receive, s_data_receive, LoadBalancer::parameters()) {
+        if (!opts.result_folder.empty()) {
+            fs::create_directories(opts.result_folder);
+        }
+    }
+
+    LocalJoin(const LocalJoin&) = delete;
+    LocalJoin& operator=(const LocalJoin&) = delete;
+
+    const PartitionFunction& partition_function() const { return partition; }
+
+    size_t r_tuples() const { return total(r_data_send); }
+    size_t s_tuples() const { return total(s_data_send); }
+
+    // S as loaded by server id, before the shuffle
+    const tuples_data& s_partition(int id) const { return s_data_send[id]; }
+
+    // R and S tuples server id joins after the shuffle
+    size_t received(int id) const { return r_data_receive[id].filled_rows + s_data_receive[id].filled_rows; }
+    std::vector<size_t> received() const {
+        std::vector<size_t> load(n_servers);
+        for (int i = 0; i < n_servers; ++i) {
+            load[i] = received(i);
+        }
+        return load;
+    }
+
+    // Tuples sent to other servers
+    size_t r_sent() const { return std::accumulate(num_r_tuples_sent.begin(), num_r_tuples_sent.end(), size_t(0)); }
+    size_t s_sent() const { return std::accumulate(num_s_tuples_sent.begin(), num_s_tuples_sent.end(), size_t(0)); }
+
+    size_t join_size(int id) const { return join_sizes[id]; }
+    size_t join_size() const { return std::accumulate(join_sizes.begin(), join_sizes.end(), size_t(0)); }
+
+    // Stolen chunks and join times of the residual load balancing, if it was on
+    void print_balance_report(std::ostream& out, const LocalEngine& engine) const {
+        if (!opts.balance) {
+            return;
+        }
+        std::vector<double> join_times(n_servers);
+        for (int i = 0; i < n_servers; ++i) {
+            join_times[i] = engine.time(i, LocalEngine::Join);
+        }
+        balanced_join.get_balancer().print_report(out, join_times);
+    }
+
+protected:
+    int n_servers;
+    options opts;
+    PartitionFunction partition; // Routes a join key to its server
+
+    // Private buffers of every server, receive buffers are allocated once their exact sizes are known
+    std::vector<tuples_data> r_data_send;
+    std::vector<tuples_data> s_data_send;
+    std::vector<tuples_data> r_data_receive;
+    std::vector<tuples_data> s_data_receive;
+    std::vector<std::vector<size_t>> s_histograms;
+    std::vector<std::vector<size_t>> r_histograms;
+    std::vector<std::vector<size_t>> s_offsets, r_offsets;
+    std::vector<size_t> s_receive_sizes, r_receive_sizes;
+    std::vector<size_t> num_s_tuples_sent;
+    std::vector<size_t> num_r_tuples_sent;
+    std::vector<size_t> join_sizes;
+    BalancedJoin balanced_join;
+
+    static size_t total(const std::vector<tuples_data>& data) {
+        size_t n = 0;
+        for (const auto& d : data) {
+            n += d.filled_rows;
+        }
+        return n;
+    }
+
+    // Read local data to server i
+    void load(int i, const partition_loader& loader) {
+        loader(i, r_data_send[i], s_data_send[i]);
+        r_data_send[i].filled_rows = r_data_send[i].tuples.size();
+        s_data_send[i].filled_rows = s_data_send[i].tuples.size();
+    }
+
+    // Count exchange, then every server allocates its own receive buffers with their exact sizes
+    void allocate_receive_buffers(LocalEngine& engine, int i) {
+        engine.step(i, LocalEngine::Shuffle, [&]() {
+            if (i == 0) {
+                TRACE_SCOPE("prefix sums");
+                s_offsets = radix_scatter::prefix_offsets(s_histograms, s_receive_sizes);
+                r_offsets = radix_scatter::prefix_offsets(r_histograms, r_receive_sizes);
+            }
+        });
+        engine.step(i, LocalEngine::Shuffle, [&]() {
+            TRACE_SCOPE("allocate");
+            s_data_receive[i].tuples.resize(s_receive_sizes[i]);
+            s_data_receive[i].filled_rows = s_receive_sizes[i];
+            r_data_receive[i].tuples.resize(r_receive_sizes[i]);
+            r_data_receive[i].filled_rows = r_receive_sizes[i];
+        });
+    }
+
+    // Scatters the tuples of server my_id into its ranges [offsets[d], offsets[d] + histogram[d]) of the receive buffers
+    template <typename DestFn>
+    size_t scatter_to_receive_buffers(int my_id, const tuples_data& data_send, std::vector<tuples_data>& data_receive, const std::vector<size_t>& histogram,
+                                      const std::vector<size_t>& offsets, DestFn dest) {
+        std::vector<joined_row*> out(data_receive.size());
+        for (size_t d = 0; d < data_receive.size(); ++d) {
+            out[d] = data_receive[d].tuples.data() + offsets[d];
+        }
+        radix_scatter::scatter(data_send.tuples, data_send.filled_rows, dest, out);
+
+        // Only count tuples sent/copied to other servers
+        size_t n_tuples_copied = 0;
+        for (size_t d = 0; d < histogram.size(); ++d) {
+            if (static_cast<int>(d) != my_id) {
+                n_tuples_copied += histogram[d];
+            }
+        }
+        return n_tuples_copied;
+    }
+
+    // Join, optionally with residual load balancing: oversized S partitions are split into
+    // chunks which idle servers steal once their own partition is joined
+    void join(LocalEngine& engine, int i) {
+        if (opts.balance) {
+            engine.step(i, LocalEngine::Join, [&]() {
+                if (i == 0) {
+                    balanced_join.prepare();
+                }
+            });
+            engine.step(i, LocalEngine::Join, [&]() { balanced_join.build(i); });
+            engine.step(i, LocalEngine::Join, [&]() { balanced_join.probe(i); });
+        }
+        engine.step(i, LocalEngine::Join, [&]() {
+            auto r_join_s = opts.balance ? balanced_join.result(i) : inner_join(r_data_receive[i], s_data_receive[i]);
+            join_sizes[i] = r_join_s.size();
+
+            // Spool the join result of this server to its own file
+            if (!opts.result_folder.empty()) {
+                TRACE_SCOPE("write result");
+                ResultWriter writer(result_file_name(opts.result_folder, i));
+                writer.write(r_join_s);
+                writer.close();
+            }
+        });
+    }
+};
+
+// Destination of an S tuple: hashed keys go to their target server, skewed keys stay on this server
+// if their R tuples are broadcast, and are broadcast themselves if their R tuples stay
+inline auto s_destination(int my_id, const PartitionFunction& partition, const std::unordered_map<int, SkewPlanner::Strategy>& skewed_keys) {
+    return [my_id, &partition, &skewed_keys](const joined_row& t) {
+        auto it = skewed_keys.find(t.join_val);
+        if (it == skewed_keys.end()) {
+            return static_cast<int>(partition(t.join_val));
+        }
+        return it->second == SkewPlanner::BroadcastR ? my_id : radix_scatter::BROADCAST;
+    };
+}
+
+// Destination of an R tuple, the counterpart of s_destination
+inline auto r_destination(int my_id, const PartitionFunction& partition, const std::unordered_map<int, SkewPlanner::Strategy>& skewed_keys) {
+    return [my_id, &partition, &skewed_keys](const joined_row& t) {
+        auto it = skewed_keys.find(t.join_val);
+        if (it == skewed_keys.end()) {
+            return static_cast<int>(partition(t.join_val));
+        }
+        return it->second == SkewPlanner::BroadcastR ? radix_scatter::BROADCAST : my_id;
+    };
+}
+
+// Samples S, detects heavy hitters with SpaceSaving, plans a strategy per heavy hitter
+// (SkewPlanner) and shuffles accordingly
+class LocalFlowJoin : public LocalJoin {
+public:
+    LocalFlowJoin(int n_servers, const options& opts)
+        : LocalJoin(n_servers, opts), sample_streams(n_servers), r_candidate_counts(n_servers), planner(n_servers, opts.planner) {}
+
+    void run(LocalEngine& engine, const partition_loader& loader) {
+        engine.run([&](int i) {
+            // Read local data to this server and sample 1% of S to estimate heavy hitters
+            engine.step(i, LocalEngine::Load, [&]() {
+                load(i, loader);
+                TRACE_SCOPE("sample");
+                for (int j = 0; j < s_data_send[i].filled_rows; j += 100) { // Previously j += 1
+                    sample_streams[i].push_back(s_data_send[i].tuples[j].join_val);
+                }
+            });
+
+            // Estimate heavy hitters using SpaceSaving algorithm on the samples of all servers,
+            // threshold and capacity are derived from n_servers, the sample size and the target imbalance
+            engine.step(i, LocalEngine::Detect, [&]() {
+                if (i != 0) {
+                    return;
+                }
+                TRACE_SCOPE("detect heavy hitters");
+                std::vector<int> sample_stream;
+                for (const auto& samples : sample_streams) {
+                    sample_stream.insert(sample_stream.end(), samples.begin(), samples.end());
+                }
+                sample_size = sample_stream.size();
+                hh_threshold = planner.threshold(sample_size);
+                k = planner.capacity(sample_size);
+                SpaceSaving::DataStructure ds = SpaceSaving::SortedArray; // Define here data structure to be use
+                SpaceSaving ss(k, ds);
+
+                ss.process(sample_stream);
+                heavy_hitters = ss.get_heavy_hitters(hh_threshold);
+            });
+
+            // Every server counts its R tuples of the candidate keys
+            engine.step(i, LocalEngine::Detect, [&]() {
+                TRACE_SCOPE("count R candidates");
+                for (int j = 0; j < r_data_send[i].filled_rows; ++j) {
+                    int key = r_data_send[i].tuples[j].join_val;
+                    if (heavy_hitters.find(key) != heavy_hitters.end()) {
+                        r_candidate_counts[i][key]++;
+                    }
+                }
+            });
+
+            // Pick the cheapest strategy for every candidate key
+            engine.step(i, LocalEngine::Detect, [&]() {
+                if (i != 0) {
+                    return;
+                }
+                TRACE_SCOPE("plan");
+                std::unordered_map<int, size_t> r_counts;
+                for (int j = 0; j < n_servers; ++j) {
+                    for (const auto& [key, count] : r_candidate_counts[j]) {
+                        r_counts[key] += count;
+                    }
+                }
+                planner.plan(heavy_hitters, r_counts, r_tuples(), s_tuples());
+            });
+
+            // Histogram pass: every server determines how many tuples it delivers to each receive buffer,
+            // the destination is computed by the partition function in this pass and again in the scatter pass
+            engine.step(i, LocalEngine::Shuffle, [&]() {
+                TRACE_SCOPE("histogram");
+                s_histograms[i] = radix_scatter::histogram(s_data_send[i].tuples, s_data_send[i].filled_rows, n_servers, s_destination(i, partition, planner.skewed_keys()));
+                r_histograms[i] = radix_scatter::histogram(r_data_send[i].tuples, r_data_send[i].filled_rows, n_servers, r_destination(i, partition, planner.skewed_keys()));
+            });
+            allocate_receive_buffers(engine, i);
+
+            // Scatter pass: write the local data into the receive buffers of all servers
+            engine.step(i, LocalEngine::Shuffle, [&]() {
+                TRACE_SCOPE("scatter");
+                num_s_tuples_sent[i] = scatter_to_receive_buffers(i, s_data_send[i], s_data_receive, s_histograms[i], s_offsets[i], s_destination(i, partition, planner.skewed_keys()));
+                num_r_tuples_sent[i] = scatter_to_receive_buffers(i, r_data_send[i], r_data_receive, r_histograms[i], r_offsets[i], r_destination(i, partition, planner.skewed_keys()));
+            });
+
+            join(engine, i);
+        });
+    }
+
+    const std::unordered_map<int, float>& detected_heavy_hitters() const { return heavy_hitters; }
+    const SkewPlanner& skew_planner() const { return planner; }
+    size_t sample_tuples() const { return sample_size; }
+    float threshold() const { return hh_threshold; }
+    int capacity() const { return k; }
+
+private:
+    std::vector<std::vector<int>> sample_streams;
+    std::unordered_map<int, float> heavy_hitters;
+    std::vector<std::unordered_map<int, size_t>> r_candidate_counts;
+    SkewPlanner planner;
+    size_t sample_size = 0;
+    float hh_threshold = 0;
+    int k = 0;
+};
+
+// Hashes every tuple to the server of its key, S grouped with a counting sort
+class LocalHashJoin : public LocalJoin {
+public:
+    LocalHashJoin(int n_servers, const options& opts) : LocalJoin(n_servers, opts), memory_locations(n_servers) {}
+
+    void run(LocalEngine& engine, const partition_loader& loader) {
+        auto destination = [this](const joined_row& t) { return static_cast<int>(partition(t.join_val)); };
+        engine.run([&](int i) {
+            engine.step(i, LocalEngine::Load, [&]() { load(i, loader); });
+
+            // Group S by target server (the server threads already use all cores), count R per target server
+            engine.step(i, LocalEngine::Shuffle, [&]() {
+                TRACE_SCOPE("group S");
+                memory_locations[i] = radix_scatter::counting_sort(s_data_send[i].tuples, s_data_send[i].filled_rows, n_servers, destination, 1);
+                s_histograms[i].assign(n_servers, 0);
+                for (const auto& [server_id, offset, count] : memory_locations[i]) {
+                    s_histograms[i][server_id - 1] = count;
+                }
+                TRACE_SCOPE("histogram R");
+                r_histograms[i] = radix_scatter::histogram(r_data_send[i].tuples, r_data_send[i].filled_rows, n_servers, destination);
+            });
+            allocate_receive_buffers(engine, i);
+
+            engine.step(i, LocalEngine::Shuffle, [&]() {
+                TRACE_SCOPE("copy");
+                num_s_tuples_sent[i] = copy_s_to_receive_buffers(i);
+                num_r_tuples_sent[i] = scatter_to_receive_buffers(i, r_data_send[i], r_data_receive, r_histograms[i], r_offsets[i], destination);
+            });
+
+            join(engine, i);
+        });
+    }
+
+private:
+    std::vector<std::vector<std::tuple<uint32_t, size_t, size_t>>> memory_locations;
+
+    // Copies the grouped S slices of server my_id to its ranges [offsets[i], offsets[i] + count) of the receive buffers
+    size_t copy_s_to_receive_buffers(int my_id) {
+        const tuples_data& send = s_data_send[my_id];
+        size_t n_tuples_copied = 0;
+        for (const auto& [server_id, offset, count] : memory_locations[my_id]) {
+            int i = server_id - 1;
+            // Check if offset and count are within the bounds of s_data_send
+            if (offset + count > send.tuples.size()) {
+                throw std::out_of_range("Offset and count exceed the size of s_data_send");
+            }
+            std::copy(send.tuples.begin() + offset, send.tuples.begin() + offset + count, s_data_receive[i].tuples.begin() + s_offsets[my_id][i]);
+            if (my_id != i) { // Increment counter only if the data is sent to a different server
+                n_tuples_copied += count;
+            }
+        }
+        return n_tuples_copied;
+    }
+};
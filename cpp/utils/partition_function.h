@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+// Maps a join key to one of n_partitions partitions (servers). The destination is computed
+// on the fly in the routing/scatter pass, so no tuple field is needed to carry it.
+// - Modulo:         key % n, the original routing (one integer division per tuple)
+// - Multiplicative: Fibonacci hashing, the high bits of key * 2^32/phi select the partition
+//                   (bit shift for power of two n, otherwise fastrange: (h * n) >> 32)
+// - Crc32:          CRC32-C of the key (SSE 4.2 instruction if available), then fastrange
+// - Radix:          bits [shift, shift + ceil(log2(n))) of the key
+class PartitionFunction {
+public:
+    enum Method { Modulo, Multiplicative, Crc32, Radix };
+
+    PartitionFunction(Method method, uint32_t n_partitions, uint32_t shift = 0)
+        : method(method), n_partitions(n_partitions), shift(shift), bits(0) {
+        if (n_partitions == 0) {
+            throw std::invalid_argument("PartitionFunction: n_partitions must be positive");
+        }
+        while ((1ull << bits) < n_partitions) {
+            bits++;
+        }
+        power_of_two = (1ull << bits) == n_partitions;
+    }
+
+    uint32_t operator()(uint32_t key) const {
+        switch (method) {
+            case Modulo:
+                return key % n_partitions;
+            case Multiplicative:
+                return reduce(key * 2654435769u);
+            case Crc32:
+                return reduce(crc32(key));
+            case Radix: {
+                uint32_t radix = shift >= 32 ? 0 : static_cast<uint32_t>((key >> shift) & ((1ull << bits) - 1));
+                return power_of_two ? radix : static_cast<uint32_t>((static_cast<uint64_t>(radix) * n_partitions) >> bits);
+            }
+        }
+        return 0;
+    }
+
+    Method get_method() const { return method; }
+    uint32_t get_n_partitions() const { return n_partitions; }
+
+    static Method parse(const std::string& name) {
+        if (name == "modulo") return Modulo;
+        if (name == "multiplicative") return Multiplicative;
+        if (name == "crc32") return Crc32;
+        if (name == "radix") return Radix;
+        throw std::invalid_argument("Unknown partition function: " + name + " (modulo, multiplicative, crc32, radix)");
+    }
+
+    static std::string name(Method method) {
+        switch (method) {
+            case Modulo: return "modulo";
+            case Multiplicative: return "multiplicative";
+            case Crc32: return "crc32";
+            case Radix: return "radix";
+        }
+        return "";
+    }
+
+private:
+    Method method;
+    uint32_t n_partitions;
+    uint32_t shift;
+    uint32_t bits; // ceil(log2(n_partitions))
+    bool power_of_two;
+
+    // Maps a 32 bit hash to [0, n_partitions) using its high bits
+    uint32_t reduce(uint32_t hash) const {
+        if (power_of_two) {
+            return bits == 0 ? 0 : hash >> (32 - bits);
+        }
+        return static_cast<uint32_t>((static_cast<uint64_t>(hash) * n_partitions) >> 32);
+    }
+
+    static uint32_t crc32(uint32_t key) {
+#if defined(__SSE4_2__)
+        return _mm_crc32_u32(0xFFFFFFFFu, key);
+#else
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1; // Reflected CRC32-C polynomial
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+        uint32_t crc = 0xFFFFFFFFu;
+        for (int i = 0; i < 4; ++i) {
+            crc = table[(crc ^ (key >> (8 * i))) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+#endif
+    }
+};
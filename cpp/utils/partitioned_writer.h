@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes a table of (value, row number) pairs directly into n_partitions files
+// <dir>/<p>_<dir>.<txt|bin>, p = 1..n_partitions, i.e. the layout produced by
+// add_row_numbers + split_file. Partition p holds a contiguous range of rows, the
+// first (n_rows % n_partitions) partitions get one row more. Row numbers start at 1.
+//
+// value_at(i) must return the value of row i + 1 and be safe to call concurrently.
+// txt: one "<value> <row>" line per row, bin: two little-endian uint32_t per row.
+namespace partitioned_writer {
+
+const uint64_t ROWS_PER_BLOCK = 1 << 18;  // Rows formatted before each block write
+
+inline std::string partition_file_name(const std::string& dir, int partition, bool binary) {
+    std::string base = std::filesystem::path(dir).filename().string();
+    return dir + "/" + std::to_string(partition) + "_" + base + (binary ? ".bin" : ".txt");
+}
+
+inline std::pair<uint64_t, uint64_t> partition_range(uint64_t n_rows, int n_partitions, int partition_idx) {
+    uint64_t rows_per_partition = n_rows / n_partitions;
+    uint64_t extra_rows = n_rows % n_partitions;
+    uint64_t p = static_cast<uint64_t>(partition_idx);
+    uint64_t begin = p * rows_per_partition + std::min(p, extra_rows);
+    uint64_t end = begin + rows_per_partition + (p < extra_rows ? 1 : 0);
+    return {begin, end};
+}
+
+template <typename ValueFn>
+void write_partition(const std::string& file_name, uint64_t begin, uint64_t end, bool binary, const ValueFn& value_at) {
+    std::ofstream out(file_name, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Could not open file: " + file_name);
+    }
+
+    std::string buffer;
+    for (uint64_t block_begin = begin; block_begin < end; block_begin += ROWS_PER_BLOCK) {
+        uint64_t block_end = std::min(end, block_begin + ROWS_PER_BLOCK);
+        if (binary) {
+            buffer.resize((block_end - block_begin) * 2 * sizeof(uint32_t));
+            uint32_t* cursor = reinterpret_cast<uint32_t*>(buffer.data());
+            for (uint64_t i = block_begin; i < block_end; ++i) {
+                *cursor++ = value_at(i);
+                *cursor++ = static_cast<uint32_t>(i + 1);
+            }
+        } else {
+            buffer.resize((block_end - block_begin) * 22); // Two uint32_t, a space and a newline
+            char* cursor = buffer.data();
+            char* last = buffer.data() + buffer.size();
+            for (uint64_t i = block_begin; i < block_end; ++i) {
+                cursor = std::to_chars(cursor, last, value_at(i)).ptr;
+                *cursor++ = ' ';
+                cursor = std::to_chars(cursor, last, static_cast<uint32_t>(i + 1)).ptr;
+                *cursor++ = '\n';
+            }
+            buffer.resize(cursor - buffer.data());
+        }
+        out.write(buffer.data(), buffer.size());
+    }
+
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Could not write file: " + file_name);
+    }
+}
+
+// Generates and writes all partitions in a single pass, up to n_threads partitions in parallel
+template <typename ValueFn>
+void write_partitioned(const std::string& dir, uint64_t n_rows, int n_partitions, bool binary, unsigned n_threads, const ValueFn& value_at) {
+    if (n_partitions <= 0) {
+        throw std::invalid_argument("Number of partitions must be greater than 0");
+    }
+    std::filesystem::create_directories(dir);
+
+    std::atomic<int> next_partition(0);
+    std::vector<std::exception_ptr> errors(n_partitions);
+    auto writer = [&]() {
+        for (int p = next_partition++; p < n_partitions; p = next_partition++) {
+            try {
+                auto [begin, end] = partition_range(n_rows, n_partitions, p);
+                write_partition(partition_file_name(dir, p + 1, binary), begin, end, binary, value_at);
+            } catch (...) {
+                errors[p] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> writers;
+    for (unsigned t = 0; t < std::max(1u, std::min<unsigned>(n_threads, n_partitions)); ++t) {
+        writers.emplace_back(writer);
+    }
+    for (auto& w : writers) {
+        w.join();
+    }
+    for (auto& e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+}
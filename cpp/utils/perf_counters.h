@@ -0,0 +1,234 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware performance counters of the calling thread through perf_event_open, to tell whether a
+// join kernel is bound by DRAM (LLC misses), the TLB, branches or the allocator (page faults).
+// Every counter is opened on its own (not as a group), so the kernel multiplexes them when there
+// are fewer hardware counters than events; the values are scaled by time enabled / time running.
+// Counters the CPU, VM or perf_event_paranoid do not provide are reported as unavailable.
+// Threads and processes started inside a measured region are included once they have exited.
+namespace perf {
+
+enum Counter { Cycles, Instructions, LlcMisses, L1dMisses, DtlbMisses, BranchMisses, PageFaults, N_COUNTERS };
+
+inline const char* counter_name(Counter counter) {
+    static const char* names[N_COUNTERS] = {"cycles", "instructions", "llc_misses", "l1d_misses", "dtlb_misses", "branch_misses", "page_faults"};
+    return names[counter];
+}
+
+// Counts of one measured region (or the sum of several)
+struct sample {
+    std::array<double, N_COUNTERS> values{};
+    std::array<bool, N_COUNTERS> available{};
+    double seconds = 0;
+
+    void add(const sample& other) {
+        for (int c = 0; c < N_COUNTERS; ++c) {
+            values[c] += other.values[c];
+            available[c] = available[c] || other.available[c];
+        }
+        seconds += other.seconds;
+    }
+
+    bool has(Counter c) const { return available[c]; }
+    double ipc() const { return has(Cycles) && has(Instructions) && values[Cycles] > 0 ? values[Instructions] / values[Cycles] : 0; }
+
+    // CSV fields: the counters, IPC and the counters per item (empty if unavailable)
+    static void write_csv_header(std::ostream& out) {
+        for (int c = 0; c < N_COUNTERS; ++c) {
+            out << ',' << counter_name(static_cast<Counter>(c));
+        }
+        out << ",ipc";
+        for (int c = 0; c < N_COUNTERS; ++c) {
+            out << ',' << counter_name(static_cast<Counter>(c)) << "_per_item";
+        }
+    }
+
+    void write_csv(std::ostream& out, uint64_t items) const {
+        for (int c = 0; c < N_COUNTERS; ++c) {
+            out << ',';
+            if (available[c]) {
+                out << static_cast<uint64_t>(values[c]);
+            }
+        }
+        out << ',';
+        if (has(Cycles) && has(Instructions)) {
+            out << ipc();
+        }
+        for (int c = 0; c < N_COUNTERS; ++c) {
+            out << ',';
+            if (available[c] && items > 0) {
+                out << values[c] / items;
+            }
+        }
+    }
+
+    // One line: IPC and the available counters per item
+    void print(std::ostream& out, uint64_t items) const {
+        if (has(Cycles) && has(Instructions)) {
+            out << "IPC " << std::setprecision(3) << ipc() << std::setprecision(6);
+        } else {
+            out << "IPC n/a";
+        }
+        for (int c = 0; c < N_COUNTERS; ++c) {
+            if (available[c]) {
+                out << ", " << counter_name(static_cast<Counter>(c)) << (items > 0 ? "/tuple " : " ") << (items > 0 ? values[c] / items : values[c]);
+            }
+        }
+    }
+};
+
+// Counters of the thread that creates the object; start and stop must be called on that thread
+class ThreadCounters {
+public:
+    ThreadCounters() {
+        for (int c = 0; c < N_COUNTERS; ++c) {
+            fds[c] = open(static_cast<Counter>(c));
+        }
+    }
+
+    ~ThreadCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    ThreadCounters(const ThreadCounters&) = delete;
+    ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+    bool any_available() const {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void start() {
+        for (int c = 0; c < N_COUNTERS; ++c) {
+            if (fds[c] >= 0) {
+                ioctl(fds[c], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fds[c], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+        start_time = now();
+    }
+
+    sample stop() {
+        sample result;
+        result.seconds = (now() - start_time) * 1e-9;
+        for (int c = 0; c < N_COUNTERS; ++c) {
+            if (fds[c] < 0) {
+                continue;
+            }
+            ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t data[3]; // value, time enabled, time running
+            if (read(fds[c], data, sizeof(data)) != sizeof(data)) {
+                continue;
+            }
+            result.available[c] = true;
+            result.values[c] = data[2] > 0 ? static_cast<double>(data[0]) * data[1] / data[2] : 0; // Multiplexed: extrapolate
+        }
+        return result;
+    }
+
+private:
+    std::array<int, N_COUNTERS> fds;
+    uint64_t start_time = 0;
+
+    static uint64_t now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    static int open(Counter counter) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        auto cache = [](uint64_t cache_id, uint64_t op, uint64_t result) { return cache_id | (op << 8) | (result << 16); };
+        switch (counter) {
+            case Cycles:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case Instructions:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case LlcMisses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+            case L1dMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+                break;
+            case DtlbMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+                break;
+            case BranchMisses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+            case PageFaults:
+                attr.type = PERF_TYPE_SOFTWARE;
+                attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+                break;
+            default:
+                return -1;
+        }
+        // This thread on any CPU; -1 if the event is not supported or not permitted
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+};
+
+// Counters of the calling thread, opened on its first use
+inline ThreadCounters& thread_counters() {
+    thread_local ThreadCounters counters;
+    return counters;
+}
+
+// Measures the enclosing scope into *target (added to it), nothing if target is null. Scopes of
+// one thread must not nest, they share the counters of the thread.
+class Scope {
+public:
+    explicit Scope(sample* target) : target(target) {
+        if (target) {
+            thread_counters().start();
+        }
+    }
+    ~Scope() {
+        if (target) {
+            target->add(thread_counters().stop());
+        }
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    sample* target;
+};
+
+} // namespace perf
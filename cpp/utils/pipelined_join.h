@@ -0,0 +1,68 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include "helper_functions.h"
+#include "trace.h"
+
+// Join that runs while the shuffle is still in flight. R tuples are inserted into the hash table
+// as they arrive, S tuples are probed as they arrive. S tuples that arrive before R is complete
+// (not every source has finished sending R yet) are buffered and probed once it is.
+// A source is a sending node; a node's own data counts as one source, so a node of n
+// expects n sources per relation.
+class PipelinedJoin {
+public:
+    explicit PipelinedJoin(int n_sources) : r_sources_remaining(n_sources), s_sources_remaining(n_sources) {}
+
+    void add_r(const joined_row* rows, size_t n) {
+        std::lock_guard<std::mutex> lock(mutex);
+        TRACE_SCOPE("insert R batch");
+        for (size_t i = 0; i < n; ++i) {
+            table[rows[i].join_val].push_back(rows[i]);
+        }
+        n_r += n;
+    }
+
+    void add_s(const joined_row* rows, size_t n) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (r_sources_remaining > 0) {
+            pending_s.insert(pending_s.end(), rows, rows + n);
+        } else {
+            probe_hash_table(table, rows, n, result);
+        }
+        n_s += n;
+    }
+
+    // A source has sent all of its R tuples, once all have the buffered S tuples are probed
+    void finish_r_source() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--r_sources_remaining == 0) {
+            probe_hash_table(table, pending_s.data(), pending_s.size(), result);
+            std::vector<joined_row>().swap(pending_s);
+        }
+    }
+
+    void finish_s_source() {
+        std::lock_guard<std::mutex> lock(mutex);
+        s_sources_remaining--;
+    }
+
+    bool done() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return r_sources_remaining == 0 && s_sources_remaining == 0;
+    }
+
+    size_t r_tuples() const { return n_r; }
+    size_t s_tuples() const { return n_s; }
+    std::vector<joined_row>& get_result() { return result; }
+
+private:
+    std::mutex mutex;
+    join_hash_table table;
+    std::vector<joined_row> pending_s;
+    std::vector<joined_row> result;
+    int r_sources_remaining;
+    int s_sources_remaining;
+    size_t n_r = 0;
+    size_t n_s = 0;
+};
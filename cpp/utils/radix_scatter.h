@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "helper_functions.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Two-pass partitioning kernel used for the shuffle copy routines.
+// 1. histogram(): count the tuples per destination
+// 2. prefix_offsets(): exclusive prefix sums give every sender a disjoint range in every receive buffer
+// 3. scatter(): write the tuples through cache-line sized software write-combining (SWWC) buffers;
+//    full buffers are flushed with non-temporal stores that bypass the cache.
+// Balkesen C. et al. Main-Memory Hash Joins on Multi-Core CPUs: Tuning to the Underlying Hardware. 2013
+//
+// dest(t) returns the destination index of tuple t, or BROADCAST to copy it to every destination.
+namespace radix_scatter {
+
+const int BROADCAST = -1;
+const size_t SWWC_TUPLES = 16; // 16 * 12 bytes = 3 cache lines, keeps flushed blocks 64-byte aligned
+
+template <typename DestFn>
+std::vector<size_t> histogram(const tuple_buffer& tuples, size_t n, int fanout, DestFn dest) {
+    std::vector<size_t> counts(fanout, 0);
+    size_t n_broadcast = 0;
+    for (size_t i = 0; i < n; ++i) {
+        int d = dest(tuples[i]);
+        if (d == BROADCAST) {
+            n_broadcast++;
+        } else {
+            counts[d]++;
+        }
+    }
+    for (auto& count : counts) {
+        count += n_broadcast;
+    }
+    return counts;
+}
+
+// offsets[i][d] is where sender i starts writing in receive buffer d, totals[d] the size of receive buffer d
+inline std::vector<std::vector<size_t>> prefix_offsets(const std::vector<std::vector<size_t>>& histograms, std::vector<size_t>& totals) {
+    size_t fanout = histograms.empty() ? 0 : histograms[0].size();
+    std::vector<std::vector<size_t>> offsets(histograms.size(), std::vector<size_t>(fanout, 0));
+    totals.assign(fanout, 0);
+    for (size_t i = 0; i < histograms.size(); ++i) {
+        for (size_t d = 0; d < fanout; ++d) {
+            offsets[i][d] = totals[d];
+            totals[d] += histograms[i][d];
+        }
+    }
+    return offsets;
+}
+
+struct alignas(64) swwc_slot {
+    joined_row tuples[SWWC_TUPLES];
+};
+
+// Copies a block of SWWC_TUPLES tuples to 16-byte aligned memory without polluting the cache
+inline void stream_block(joined_row* dst, const swwc_slot& slot) {
+#if defined(__SSE2__)
+    const __m128i* src = reinterpret_cast<const __m128i*>(slot.tuples);
+    __m128i* out = reinterpret_cast<__m128i*>(dst);
+    for (size_t j = 0; j < SWWC_TUPLES * sizeof(joined_row) / sizeof(__m128i); ++j) {
+        _mm_stream_si128(out + j, _mm_load_si128(src + j));
+    }
+#else
+    std::memcpy(dst, slot.tuples, sizeof(slot.tuples));
+#endif
+}
+
+// Scatters tuples[0, n) to out[d] (one cursor per destination, e.g. receive buffer + offset).
+// The ranges [out[d], out[d] + histogram[d]) must be disjoint and preallocated.
+template <typename DestFn>
+void scatter(const joined_row* tuples, size_t n, DestFn dest, const std::vector<joined_row*>& out) {
+    const size_t fanout = out.size();
+    std::vector<swwc_slot> slots(fanout);
+
+    // Every slot mirrors a 64-byte aligned block of SWWC_TUPLES tuples of its output. The first
+    // block usually starts before out[d], fill[d] is the position of out[d] inside it.
+    std::vector<joined_row*> block(fanout);
+    std::vector<size_t> fill(fanout, 0);
+    std::vector<size_t> first(fanout);
+    std::vector<bool> streamable(fanout, false);
+    for (size_t d = 0; d < fanout; ++d) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(out[d]);
+        for (size_t f = 0; f < SWWC_TUPLES; ++f) {
+            if ((address - f * sizeof(joined_row)) % 64 == 0) {
+                fill[d] = f;
+                streamable[d] = true;
+                break;
+            }
+        }
+        first[d] = fill[d];
+        block[d] = out[d] - fill[d];
+    }
+
+    auto flush = [&](size_t d) {
+        if (first[d] == 0 && streamable[d]) {
+            stream_block(block[d], slots[d]);
+        } else {
+            // Partial first block, the tuples before first[d] belong to another sender
+            std::memcpy(block[d] + first[d], slots[d].tuples + first[d], (SWWC_TUPLES - first[d]) * sizeof(joined_row));
+            first[d] = 0;
+        }
+        block[d] += SWWC_TUPLES;
+        fill[d] = 0;
+    };
+
+    auto push = [&](size_t d, const joined_row& t) {
+        slots[d].tuples[fill[d]++] = t;
+        if (fill[d] == SWWC_TUPLES) {
+            flush(d);
+        }
+    };
+
+    for (size_t i = 0; i < n; ++i) {
+        const joined_row& t = tuples[i];
+        int d = dest(t);
+        if (d == BROADCAST) {
+            for (size_t b = 0; b < fanout; ++b) {
+                push(b, t);
+            }
+        } else {
+            push(d, t);
+        }
+    }
+
+    // Write the remaining tuples of every slot
+    for (size_t d = 0; d < fanout; ++d) {
+        if (fill[d] > first[d]) {
+            std::memcpy(block[d] + first[d], slots[d].tuples + first[d], (fill[d] - first[d]) * sizeof(joined_row));
+        }
+    }
+#if defined(__SSE2__)
+    _mm_sfence(); // Make the non-temporal stores visible before the buffers are used
+#endif
+}
+
+template <typename DestFn>
+void scatter(const tuple_buffer& tuples, size_t n, DestFn dest, const std::vector<joined_row*>& out) {
+    scatter(tuples.data(), n, dest, out);
+}
+
+// Groups tuples[0, n) by destination in O(n): per-thread histograms, prefix sums over
+// (destination, thread) and a parallel scatter into a second buffer which then replaces tuples.
+// Returns the (server id, offset, count) table with one entry per destination, server ids
+// start at 1 and destinations without tuples have count 0. BROADCAST is not allowed here.
+template <typename DestFn>
+std::vector<std::tuple<uint32_t, size_t, size_t>> counting_sort(tuple_buffer& tuples, size_t n, int fanout, DestFn dest,
+                                                                 int n_threads = std::thread::hardware_concurrency()) {
+    const size_t MIN_TUPLES_PER_THREAD = 1 << 16;
+    n_threads = static_cast<int>(std::max<size_t>(1, std::min<size_t>(std::max(n_threads, 1), n / MIN_TUPLES_PER_THREAD)));
+
+    std::vector<size_t> chunk_begin(n_threads + 1);
+    for (int t = 0; t <= n_threads; ++t) {
+        chunk_begin[t] = n * t / n_threads;
+    }
+
+    auto run = [n_threads](auto&& body) {
+        std::vector<std::thread> threads;
+        for (int t = 1; t < n_threads; ++t) {
+            threads.emplace_back(body, t);
+        }
+        body(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    };
+
+    // Histogram pass, every thread counts its own chunk
+    std::vector<std::vector<size_t>> histograms(n_threads, std::vector<size_t>(fanout, 0));
+    run([&](int t) {
+        for (size_t i = chunk_begin[t]; i < chunk_begin[t + 1]; ++i) {
+            histograms[t][dest(tuples[i])]++;
+        }
+    });
+
+    // Destination-major offsets keep the order of the input within every group
+    std::vector<std::tuple<uint32_t, size_t, size_t>> table;
+    std::vector<std::vector<joined_row*>> out(n_threads, std::vector<joined_row*>(fanout));
+    tuple_buffer grouped;
+    grouped.resize(n);
+    size_t offset = 0;
+    for (int d = 0; d < fanout; ++d) {
+        size_t count = 0;
+        for (int t = 0; t < n_threads; ++t) {
+            out[t][d] = grouped.data() + offset + count;
+            count += histograms[t][d];
+        }
+        table.emplace_back(d + 1, offset, count);
+        offset += count;
+    }
+
+    // Scatter pass, every thread writes its chunk into its own ranges
+    run([&](int t) {
+        scatter(tuples.data() + chunk_begin[t], chunk_begin[t + 1] - chunk_begin[t], dest, out[t]);
+    });
+
+    tuples.swap(grouped);
+    return table;
+}
+
+}
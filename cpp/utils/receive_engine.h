@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "batch_protocol.h"
+#include "helper_functions.h"
+#include "transport.h"
+#include "trace.h"
+
+// Receive side of the distributed joins. Sleeps in the transport (zmq::poll or a futex) until a
+// batch is ready and returns as soon as every peer has sent its end-of-stream frame for R and S.
+// If no frame arrives for idle_timeout, a peer is assumed to be gone and an exception is thrown
+// instead of waiting forever.
+// With flow control, every consumed batch is counted for the credits of its sender, and credits
+// returned by the peers are handed to the send side. The engine then runs until the send side of
+// the node is done as well, since it may still wait for credits after all peers ended their streams.
+// traffic, if given, records the data batches received per source.
+class ReceiveEngine {
+public:
+    ReceiveEngine(Transport& transport, int n_servers, batch_protocol::FlowControl* flow = nullptr, NodeTraffic* traffic = nullptr,
+                  std::chrono::milliseconds idle_timeout = std::chrono::seconds(60))
+        : transport(transport), streams(n_servers), flow(flow), traffic(traffic), idle_timeout(idle_timeout) {}
+
+    // deliver(relation, rows, n) is called for every data batch, finish_source(relation) for every
+    // end-of-stream frame
+    template <typename DeliverFn, typename FinishFn>
+    void run(DeliverFn deliver, FinishFn finish_source) {
+        TRACE_SCOPE("receive");
+        try {
+            receive_all(deliver, finish_source);
+        } catch (...) {
+            if (flow) {
+                flow->finish_receiving(); // The send side must not wait for credits forever
+            }
+            throw;
+        }
+        if (flow) {
+            flow->finish_receiving();
+        }
+    }
+
+    // Any thread: run() returns within POLL_SLICE without waiting for the remaining frames, used
+    // when the node fails before its streams are done
+    void stop() {
+        stop_requested.store(true, std::memory_order_release);
+        if (flow) {
+            flow->finish_receiving();
+        }
+    }
+
+    size_t batches_received() const { return n_batches; }
+    size_t tuples_received() const { return n_tuples; }
+    size_t wakeups() const { return transport.wakeups(); }
+
+private:
+    Transport& transport;
+    batch_protocol::StreamTracker streams;
+    batch_protocol::FlowControl* flow;
+    NodeTraffic* traffic;
+    std::chrono::milliseconds idle_timeout;
+    size_t n_batches = 0;
+    size_t n_tuples = 0;
+    std::atomic<bool> stop_requested{false};
+
+    // Longest sleep in the transport, so that stop() is noticed
+    static constexpr std::chrono::milliseconds POLL_SLICE{100};
+
+    template <typename DeliverFn, typename FinishFn>
+    void receive_all(DeliverFn& deliver, FinishFn& finish_source) {
+        Transport::frame received;
+        std::chrono::milliseconds idle(0);
+        while (!stop_requested.load(std::memory_order_acquire) && (!streams.done() || (flow && !flow->sending_finished()))) {
+            // Once all streams ended only credits can arrive, check the send side every millisecond
+            bool streams_done = streams.done();
+            std::chrono::milliseconds slice = streams_done ? std::chrono::milliseconds(1) : std::min(idle_timeout, POLL_SLICE);
+            if (!transport.receive(received, slice)) {
+                if (streams_done) {
+                    continue;
+                }
+                idle += slice;
+                if (idle >= idle_timeout) {
+                    throw std::runtime_error("No message for " + std::to_string(idle_timeout.count()) + " ms, a peer did not finish its streams");
+                }
+                continue;
+            }
+            idle = std::chrono::milliseconds(0);
+            auto header = batch_protocol::parse(received);
+            if (header.type == batch_protocol::Credit) {
+                if (!flow) {
+                    throw std::runtime_error("Credit frame of node " + std::to_string(header.sender) + " without flow control");
+                }
+                flow->grant(header.sender, header.count);
+            } else if (streams.accept(header)) {
+                finish_source(header.relation);
+            } else {
+                deliver(header.relation, received.rows, header.count);
+                n_batches++;
+                n_tuples += header.count;
+                if (flow) {
+                    flow->consume(header.sender);
+                }
+                if (traffic) {
+                    traffic->received(header.sender, header.count, received.header_bytes + received.n_rows * sizeof(joined_row));
+                }
+            }
+        }
+        transport.finish_receiving();
+    }
+};
+
+// Appends a batch to a receive buffer shared by several threads without a lock: the range is
+// reserved with fetch_add on the fill counter, then every thread copies into its own range.
+// The buffer has to be sized for all tuples beforehand (count exchange).
+inline void append_batch(tuples_data& total, const joined_row* rows, size_t n) {
+    size_t begin = std::atomic_ref<int>(total.filled_rows).fetch_add(static_cast<int>(n), std::memory_order_relaxed);
+    if (begin + n > total.tuples.size()) {
+        throw std::runtime_error("Receive buffer of " + std::to_string(total.tuples.size()) + " tuples overflows");
+    }
+    std::copy(rows, rows + n, total.tuples.begin() + begin);
+}
+
+// Thread running a ReceiveEngine. If the node fails before join(), the destructor stops the engine
+// and joins the thread, so the exception reaches the node's handler instead of std::terminate.
+class ReceiveThread {
+public:
+    template <typename Fn>
+    ReceiveThread(ReceiveEngine& engine, Fn body) : engine(engine), thread(std::move(body)) {}
+
+    ~ReceiveThread() {
+        if (thread.joinable()) {
+            engine.stop();
+            thread.join();
+        }
+    }
+
+    ReceiveThread(const ReceiveThread&) = delete;
+    ReceiveThread& operator=(const ReceiveThread&) = delete;
+
+    void join() { thread.join(); }
+
+private:
+    ReceiveEngine& engine;
+    std::thread thread;
+};
@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "result_writer.h"
+
+ResultWriter::ResultWriter(const std::string& file_name, Format format, bool background, size_t buffer_bytes)
+    : file_name(file_name), format(format), background(background), current(0), filled(0), n_rows(0),
+      n_bytes(sizeof(result_file_header)), closed(false), pending_bytes(0), stop(false) {
+
+    // Round the buffers up to whole pages
+    buffer_capacity = (std::max(buffer_bytes, ALIGNMENT) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    buffers[0] = static_cast<char*>(std::aligned_alloc(ALIGNMENT, buffer_capacity));
+    buffers[1] = background ? static_cast<char*>(std::aligned_alloc(ALIGNMENT, buffer_capacity)) : nullptr;
+    if (buffers[0] == nullptr || (background && buffers[1] == nullptr)) {
+        std::free(buffers[0]);
+        std::free(buffers[1]);
+        throw std::bad_alloc();
+    }
+
+    fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::free(buffers[0]);
+        std::free(buffers[1]);
+        throw std::runtime_error("Could not open file: " + file_name);
+    }
+
+    try {
+        // Reserve space for the header, it is written on close once n_rows is known
+        result_file_header header = {{'F', 'J', 'R', 'S'}, 1, format, 0, 0};
+        write_all(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        if (background) {
+            writer_thread = std::thread(&ResultWriter::writer_loop, this);
+        }
+    } catch (...) {
+        // The destructor does not run for a failed constructor
+        ::close(fd);
+        std::free(buffers[0]);
+        std::free(buffers[1]);
+        throw;
+    }
+}
+
+ResultWriter::~ResultWriter() {
+    try {
+        close();
+    } catch (const std::exception& e) {
+        std::cerr << "Error closing result file " << file_name << ": " << e.what() << std::endl;
+    }
+    std::free(buffers[0]);
+    std::free(buffers[1]);
+}
+
+void ResultWriter::write(const joined_row* rows, size_t count) {
+    if (format == Varint) {
+        for (size_t i = 0; i < count; ++i) {
+            write(rows[i]);
+        }
+        return;
+    }
+
+    // Raw rows are copied in as large pieces as the buffer allows
+    const char* data = reinterpret_cast<const char*>(rows);
+    size_t remaining = count * sizeof(joined_row);
+    while (remaining > 0) {
+        if (filled == buffer_capacity) {
+            flush_buffer();
+        }
+        size_t n = std::min(remaining, buffer_capacity - filled);
+        std::memcpy(buffers[current] + filled, data, n);
+        filled += n;
+        data += n;
+        remaining -= n;
+    }
+    n_rows += count;
+}
+
+void ResultWriter::close() {
+    if (closed) {
+        return;
+    }
+    closed = true;
+
+    std::exception_ptr flush_error;
+    try {
+        flush_buffer();
+    } catch (...) {
+        flush_error = std::current_exception();
+    }
+    if (background) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        writer_thread.join();
+        if (!flush_error) {
+            flush_error = error;
+        }
+    }
+    if (flush_error) {
+        ::close(fd);
+        std::rethrow_exception(flush_error);
+    }
+
+    result_file_header header = {{'F', 'J', 'R', 'S'}, 1, format, 0, n_rows};
+    bool ok = ::pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    ok &= ::close(fd) == 0;
+    if (!ok) {
+        throw std::runtime_error("Could not write file: " + file_name);
+    }
+}
+
+// Hands the current buffer to the writer thread, or writes it directly without one
+void ResultWriter::flush_buffer() {
+    if (filled == 0) {
+        return;
+    }
+    n_bytes += filled;
+    if (!background) {
+        write_all(buffers[0], filled);
+        filled = 0;
+        return;
+    }
+
+    wait_for_writer();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending_bytes = filled;
+        current = 1 - current;
+    }
+    cv.notify_all();
+    filled = 0;
+}
+
+void ResultWriter::wait_for_writer() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return pending_bytes == 0; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ResultWriter::writer_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cv.wait(lock, [this] { return pending_bytes > 0 || stop; });
+        if (pending_bytes == 0) {
+            return; // stop requested and nothing left to write
+        }
+        const char* data = buffers[1 - current];
+        size_t size = pending_bytes;
+        lock.unlock();
+        try {
+            write_all(data, size);
+        } catch (...) {
+            lock.lock();
+            error = std::current_exception();
+            pending_bytes = 0;
+            cv.notify_all();
+            return;
+        }
+        lock.lock();
+        pending_bytes = 0;
+        cv.notify_all();
+    }
+}
+
+void ResultWriter::write_all(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Could not write file: " + file_name + " (" + std::strerror(errno) + ")");
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+size_t ResultWriter::encode_raw(const joined_row& row, char* out) {
+    std::memcpy(out, &row, sizeof(joined_row));
+    return sizeof(joined_row);
+}
+
+static inline size_t put_varint(uint32_t value, char* out) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = static_cast<char>(value);
+    return n;
+}
+
+size_t ResultWriter::encode_varint(const joined_row& row, char* out) {
+    size_t n = put_varint(row.join_val, out);
+    n += put_varint(row.row_R, out + n);
+    n += put_varint(row.row_S, out + n);
+    return n;
+}
+
+static inline uint32_t get_varint(const uint8_t*& in, const uint8_t* end) {
+    uint32_t value = 0;
+    for (int shift = 0; in < end && shift < 35; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Corrupt varint in result file");
+}
+
+std::vector<joined_row> read_results(const std::string& file_name) {
+    ifstream file(file_name, ios::binary);
+    if (!file.is_open()) {
+        throw runtime_error("Could not open file: " + file_name);
+    }
+
+    ResultWriter::result_file_header header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, "FJRS", 4) != 0) {
+        throw runtime_error("Not a result file: " + file_name);
+    }
+
+    std::vector<char> payload(fs::file_size(file_name) - sizeof(header));
+    file.read(payload.data(), payload.size());
+
+    std::vector<joined_row> rows(header.n_rows);
+    if (header.format == ResultWriter::Raw) {
+        if (payload.size() != rows.size() * sizeof(joined_row)) {
+            throw runtime_error("Truncated result file: " + file_name);
+        }
+        std::memcpy(rows.data(), payload.data(), payload.size());
+    } else {
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(payload.data());
+        const uint8_t* end = in + payload.size();
+        for (auto& row : rows) {
+            row.join_val = get_varint(in, end);
+            row.row_R = get_varint(in, end);
+            row.row_S = get_varint(in, end);
+        }
+    }
+    return rows;
+}
+
+std::string result_file_name(const std::string& folder, int server) {
+    return folder + "/" + std::to_string(server + 1) + "_result.bin";
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "helper_functions.h"
+
+// Spools join results to a file without going through iostreams.
+// Rows are encoded into large page-aligned buffers; with a background writer the
+// buffers are double-buffered, so encoding continues while the previous buffer is
+// written. File layout: result_file_header followed by the encoded rows.
+//   Raw:    12 bytes per row (joined_row as in memory)
+//   Varint: join_val, row_R and row_S as LEB128 varints (usually 4-9 bytes per row)
+class ResultWriter {
+public:
+    enum Format : uint32_t {
+        Raw = 0,
+        Varint = 1
+    };
+
+    struct result_file_header {
+        char magic[4];      // "FJRS"
+        uint32_t version;
+        uint32_t format;
+        uint32_t reserved;
+        uint64_t n_rows;    // Written on close
+    };
+
+    static constexpr size_t DEFAULT_BUFFER_BYTES = 8 << 20;
+
+    ResultWriter(const std::string& file_name, Format format = Raw, bool background = true, size_t buffer_bytes = DEFAULT_BUFFER_BYTES);
+    ~ResultWriter();
+    ResultWriter(const ResultWriter&) = delete;
+    ResultWriter& operator=(const ResultWriter&) = delete;
+
+    void write(const joined_row& row) {
+        if (buffer_capacity - filled < MAX_ROW_BYTES) {
+            flush_buffer();
+        }
+        filled += format == Raw ? encode_raw(row, buffers[current] + filled) : encode_varint(row, buffers[current] + filled);
+        n_rows++;
+    }
+
+    void write(const joined_row* rows, size_t count);
+    void write(const std::vector<joined_row>& rows) { write(rows.data(), rows.size()); }
+
+    // Flushes all buffers, writes the header and closes the file; throws on I/O errors
+    void close();
+
+    uint64_t rows_written() const { return n_rows; }
+    uint64_t bytes_written() const { return n_bytes + filled; }
+
+private:
+    static constexpr size_t MAX_ROW_BYTES = 15;  // 3 varints of at most 5 bytes
+    static constexpr size_t ALIGNMENT = 4096;
+
+    int fd;
+    std::string file_name;
+    Format format;
+    bool background;
+    size_t buffer_capacity;
+    char* buffers[2];
+    int current;
+    size_t filled;
+    uint64_t n_rows;
+    uint64_t n_bytes;
+    bool closed;
+
+    // Background writer state, pending_bytes > 0 means buffers[1 - current] waits to be written
+    std::thread writer_thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t pending_bytes;
+    bool stop;
+    std::exception_ptr error;
+
+    void flush_buffer();
+    void wait_for_writer();
+    void writer_loop();
+    void write_all(const char* data, size_t size);
+
+    static size_t encode_raw(const joined_row& row, char* out);
+    static size_t encode_varint(const joined_row& row, char* out);
+};
+
+// Reads a result file written by ResultWriter (any format) back into memory
+std::vector<joined_row> read_results(const std::string& file_name);
+
+// Path of the result file of one server, <folder>/<server + 1>_result.bin
+std::string result_file_name(const std::string& folder, int server);
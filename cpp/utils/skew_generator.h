@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "partition_function.h"
+#include "zipf_generator.h"
+
+// Skewed workloads beyond plain Zipf. S is a mixture of
+//   - hot_keys hot keys that together receive hot_fraction of the S rows and
+//   - a background over 1..n_unique drawn from Zipf(alpha) (alpha = 0 is uniform).
+// The placement decides where the hot rows show up in the input order:
+//   random:    anywhere in the stream
+//   late:      only in the last late_window fraction of the stream (unseen by early samples)
+//   clustered: in one contiguous block at the start, so the first partition(s) hold all the skew
+// R holds every key 1..n_unique once; with r_dup > 1 every hot key appears r_dup times
+// (correlated skew), the extra copies are appended after the unique keys.
+struct skew_config {
+    enum Placement { Random, Late, Clustered };
+    enum KeyChoice { First, Spread, Collide };
+
+    uint64_t seed = 1;
+    uint64_t n_unique = 0;
+    uint64_t n_rows = 0;
+    double alpha = 0.0;
+    uint32_t hot_keys = 0;
+    double hot_fraction = 0.0;
+    Placement placement = Random;
+    double late_window = 0.25;
+    KeyChoice key_choice = First;
+    int n_servers = 1;  // Only used by key_choice = Collide
+    PartitionFunction::Method partition = PartitionFunction::Modulo; // Only used by key_choice = Collide
+    uint32_t r_dup = 1;
+};
+
+class SkewGenerator {
+public:
+    explicit SkewGenerator(const skew_config& config)
+        : config(config), rng(config.seed ^ 0x5bd1e995ULL), background(config.seed, config.alpha, config.n_unique) {
+        if (config.hot_fraction < 0 || config.hot_fraction > 1) {
+            throw std::invalid_argument("hot_fraction must be in [0, 1]");
+        }
+        if (config.hot_fraction > 0 && config.hot_keys == 0) {
+            throw std::invalid_argument("hot_fraction > 0 needs at least one hot key");
+        }
+        if (config.placement == skew_config::Late && (config.late_window <= 0 || config.late_window > 1)) {
+            throw std::invalid_argument("late_window must be in (0, 1]");
+        }
+        choose_hot_keys();
+
+        hot_rows = static_cast<uint64_t>(config.hot_fraction * config.n_rows + 0.5);
+        late_begin = config.n_rows - static_cast<uint64_t>(config.late_window * config.n_rows);
+        late_hot_probability = config.placement == skew_config::Late
+                                   ? std::min(1.0, config.hot_fraction / config.late_window) : config.hot_fraction;
+    }
+
+    // Value of S row i (0-based), random access and thread-safe
+    uint32_t s_value(uint64_t i) const {
+        auto bits = rng(i, 0);
+        double u = Philox4x32::to_unit_double(bits[0], bits[1]);
+        bool is_hot = false;
+        switch (config.placement) {
+            case skew_config::Random:
+                is_hot = u < config.hot_fraction;
+                break;
+            case skew_config::Late:
+                is_hot = i >= late_begin && u < late_hot_probability;
+                break;
+            case skew_config::Clustered:
+                is_hot = i < hot_rows;
+                break;
+        }
+        if (is_hot) {
+            return hot[bits[2] % hot.size()];
+        }
+        return background(i);
+    }
+
+    // Value of R row i (0-based)
+    uint32_t r_value(uint64_t i) const {
+        if (i < config.n_unique) {
+            return static_cast<uint32_t>(i + 1);
+        }
+        return hot[(i - config.n_unique) % hot.size()];
+    }
+
+    uint64_t r_rows() const {
+        return config.n_unique + (config.r_dup > 1 ? static_cast<uint64_t>(config.hot_keys) * (config.r_dup - 1) : 0);
+    }
+
+    const std::vector<uint32_t>& hot_key_values() const { return hot; }
+
+private:
+    skew_config config;
+    Philox4x32 rng;
+    ZipfGenerator background;
+    std::vector<uint32_t> hot;
+    uint64_t hot_rows;
+    uint64_t late_begin;
+    double late_hot_probability;
+
+    void choose_hot_keys() {
+        if (config.hot_keys > config.n_unique) {
+            throw std::invalid_argument("More hot keys than unique keys");
+        }
+        for (uint32_t j = 0; j < config.hot_keys; ++j) {
+            switch (config.key_choice) {
+                case skew_config::First:
+                    hot.push_back(j + 1);
+                    break;
+                case skew_config::Spread: {
+                    // Pseudo-random distinct keys across the whole domain
+                    uint32_t key;
+                    uint64_t attempt = 0;
+                    do {
+                        key = static_cast<uint32_t>(rng(j, ++attempt << 32)[0] % config.n_unique) + 1;
+                    } while (std::find(hot.begin(), hot.end(), key) != hot.end());
+                    hot.push_back(key);
+                    break;
+                }
+                case skew_config::Collide: {
+                    // The smallest keys the partition function routes to server 0, i.e. all hot keys
+                    // go to the same server; for modulo the multiples of n_servers
+                    PartitionFunction partition(config.partition, config.n_servers);
+                    uint64_t key = hot.empty() ? 1 : static_cast<uint64_t>(hot.back()) + 1;
+                    while (key <= config.n_unique && partition(static_cast<uint32_t>(key)) != 0) {
+                        ++key;
+                    }
+                    if (key > config.n_unique) {
+                        throw std::invalid_argument("Not enough keys for colliding hot keys");
+                    }
+                    hot.push_back(static_cast<uint32_t>(key));
+                    break;
+                }
+            }
+        }
+        if (hot.empty()) {
+            hot.push_back(1); // Never drawn, keeps r_value/s_value branch-free
+        }
+    }
+};
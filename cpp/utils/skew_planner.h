@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+#include "partition_function.h"
+
+// Chooses how the tuples of every candidate heavy hitter key are distributed, instead of
+// always keeping S local and broadcasting R:
+// - Hash:       R_k and S_k are sent to the server of the key, no replication
+// - BroadcastR: S_k stays where it is, R_k is copied to every server
+// - BroadcastS: R_k stays where it is, S_k is copied to every server
+// Costs are counted in tuples. For a key with |R_k| = r and |S_k| = s on n servers:
+//   shipped tuples        Hash: (r + s)(n - 1)/n   BroadcastR: r(n - 1)   BroadcastS: s(n - 1)
+//   load of one server    Hash: r + s              BroadcastR: r + s/n    BroadcastS: s + r/n
+// cost = network_cost * shipped + tuple_cost * max(0, load - slack), where the slack is the
+// extra load a server may take before it exceeds the target imbalance:
+//   slack = target_imbalance * (|R| + |S|) / n
+// Keys that are not candidates are hashed.
+class SkewPlanner {
+public:
+    enum Strategy { Hash, BroadcastR, BroadcastS };
+
+    struct parameters {
+        double target_imbalance = 0.1; // Tolerated load above the average, relative to it
+        double network_cost = 2.0;     // Cost of shipping one tuple, relative to processing it
+        double tuple_cost = 1.0;       // Cost of building or probing one tuple
+    };
+
+    struct key_plan {
+        int key;
+        double r_tuples;  // |R_k|
+        double s_tuples;  // |S_k|, estimated from the sample
+        Strategy strategy;
+        double cost[3];   // Predicted cost of every strategy
+    };
+
+    SkewPlanner(int n_servers, const parameters& params) : n_servers(n_servers), params(params) {}
+
+    // Smallest S frequency of a key that can push one server over the target imbalance on its
+    // own, but no lower than the sample can resolve (about 10 occurrences in the sample)
+    double threshold(size_t sample_size) const {
+        double min_frequency = sample_size > 0 ? 10.0 / sample_size : 1.0;
+        return std::min(1.0, std::max(params.target_imbalance / n_servers, min_frequency));
+    }
+
+    // SpaceSaving with k counters overestimates a frequency by at most 1/k,
+    // 2/threshold counters keep the error below half the threshold
+    int capacity(size_t sample_size) const {
+        int k = static_cast<int>(std::ceil(2.0 / threshold(sample_size)));
+        return std::max(1, std::min<int>(k, std::max<size_t>(sample_size, 1)));
+    }
+
+    // candidates: key -> estimated S frequency, r_counts: key -> |R_k|
+    void plan(const std::unordered_map<int, float>& candidates, const std::unordered_map<int, size_t>& r_counts,
+              size_t total_r, size_t total_s) {
+        keys.clear();
+        strategies.clear();
+        this->total_r = total_r;
+        this->total_s = total_s;
+        double slack = params.target_imbalance * (total_r + total_s) / n_servers;
+        double n = n_servers;
+
+        for (const auto& [key, frequency] : candidates) {
+            key_plan p;
+            p.key = key;
+            auto it = r_counts.find(key);
+            p.r_tuples = it == r_counts.end() ? 0 : it->second;
+            p.s_tuples = frequency * total_s;
+            double r = p.r_tuples, s = p.s_tuples;
+
+            p.cost[Hash] = params.network_cost * (r + s) * (n - 1) / n + params.tuple_cost * std::max(0.0, r + s - slack);
+            p.cost[BroadcastR] = params.network_cost * r * (n - 1) + params.tuple_cost * std::max(0.0, r + s / n - slack);
+            p.cost[BroadcastS] = params.network_cost * s * (n - 1) + params.tuple_cost * std::max(0.0, s + r / n - slack);
+            p.strategy = static_cast<Strategy>(std::min_element(p.cost, p.cost + 3) - p.cost);
+
+            keys.push_back(p);
+            if (p.strategy != Hash) {
+                strategies[key] = p.strategy;
+            }
+        }
+        std::sort(keys.begin(), keys.end(), [](const key_plan& a, const key_plan& b) { return a.s_tuples > b.s_tuples; });
+    }
+
+    Strategy strategy(int key) const {
+        auto it = strategies.find(key);
+        return it == strategies.end() ? Hash : it->second;
+    }
+
+    // Keys that are not hashed
+    const std::unordered_map<int, Strategy>& skewed_keys() const { return strategies; }
+    const std::vector<key_plan>& plans() const { return keys; }
+
+    // Predicted number of tuples every server receives: the tuples of non-candidate keys are
+    // spread evenly, candidate keys are placed according to their strategy
+    std::vector<double> predicted_load(const PartitionFunction& partition) const {
+        std::vector<double> load(n_servers, 0);
+        double remaining = total_r + total_s;
+        for (const auto& p : keys) {
+            double r = p.r_tuples, s = p.s_tuples;
+            remaining -= r + s;
+            for (int i = 0; i < n_servers; ++i) {
+                switch (p.strategy) {
+                    case Hash: load[i] += static_cast<int>(partition(p.key)) == i ? r + s : 0; break;
+                    case BroadcastR: load[i] += r + s / n_servers; break;
+                    case BroadcastS: load[i] += s + r / n_servers; break;
+                }
+            }
+        }
+        for (auto& l : load) {
+            l += std::max(0.0, remaining) / n_servers;
+        }
+        return load;
+    }
+
+    static const char* strategy_name(Strategy strategy) {
+        static const char* names[3] = {"hash", "broadcast_R", "broadcast_S"};
+        return names[strategy];
+    }
+
+    void print_plan(std::ostream& out) const {
+        out << "Skew plan (" << n_servers << " servers, target imbalance " << params.target_imbalance
+            << ", network cost " << params.network_cost << "):\n";
+        for (const auto& p : keys) {
+            out << "Key " << p.key << ": |R_k| = " << p.r_tuples << ", |S_k| ~ " << std::llround(p.s_tuples)
+                << ", cost hash/broadcast_R/broadcast_S = " << p.cost[Hash] << "/" << p.cost[BroadcastR] << "/" << p.cost[BroadcastS]
+                << " -> " << strategy_name(p.strategy) << "\n";
+        }
+    }
+
+    // Logs predicted and actual tuples per server and the imbalance (max / average) of both
+    void print_load(std::ostream& out, const std::vector<double>& predicted, const std::vector<size_t>& actual) const {
+        auto imbalance = [](const auto& load) {
+            double sum = 0, max_load = 0;
+            for (auto l : load) {
+                sum += l;
+                max_load = std::max<double>(max_load, l);
+            }
+            return sum > 0 ? max_load * load.size() / sum : 1.0;
+        };
+        out << "Server load (tuples received): predicted / actual\n";
+        for (int i = 0; i < n_servers; ++i) {
+            out << "Server " << i << ": " << std::llround(predicted[i]) << " / " << actual[i] << "\n";
+        }
+        out << "Imbalance (max / average): predicted " << imbalance(predicted) << ", actual " << imbalance(actual) << "\n";
+    }
+
+private:
+    int n_servers;
+    parameters params;
+    size_t total_r = 0;
+    size_t total_s = 0;
+    std::vector<key_plan> keys;
+    std::unordered_map<int, Strategy> strategies;
+};
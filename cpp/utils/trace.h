@@ -0,0 +1,205 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+// Tracing of the join phases, exported as Chrome trace-event JSON (chrome://tracing, Perfetto).
+// Compiled in with -DJOIN_TRACE only; otherwise the macros expand to nothing and
+// trace::write_chrome_json returns false.
+//
+//   TRACE_SCOPE("probe");         span from here to the end of the enclosing scope
+//   TRACE_PHASES("load");         consecutive spans of straight-line code: load, then sample, ...
+//   TRACE_NEXT_PHASE("sample");   until the end of the enclosing scope
+//   TRACE_THREAD_NAME(name);      name of the calling thread in the trace (std::string)
+//
+// Every thread records its spans into its own ring buffer (no locks, no allocation after the
+// first span of the thread); once a ring is full the oldest spans are overwritten. Timestamps are
+// read with rdtsc on x86-64 and converted with a calibration against steady_clock at export,
+// steady_clock is used elsewhere. Span names must be string literals (only the pointer is kept).
+// Export after the traced threads are finished.
+
+#if defined(JOIN_TRACE)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace trace {
+
+const size_t EVENTS_PER_THREAD = 1 << 16;
+
+struct event {
+    const char* name;
+    uint64_t start, end; // Ticks
+};
+
+struct thread_buffer {
+    int tid;
+    std::string name;
+    std::vector<event> ring;
+    uint64_t n_events = 0; // Recorded so far, ring holds the last EVENTS_PER_THREAD of them
+
+    void record(const char* span, uint64_t start, uint64_t end) {
+        ring[n_events % EVENTS_PER_THREAD] = {span, start, end};
+        n_events++;
+    }
+};
+
+inline uint64_t now_ticks() {
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// All thread buffers of the process; they outlive their threads until the export
+class Registry {
+public:
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    thread_buffer& local() {
+        thread_local std::shared_ptr<thread_buffer> buffer;
+        if (!buffer) {
+            buffer = std::make_shared<thread_buffer>();
+            buffer->ring.resize(EVENTS_PER_THREAD);
+            std::lock_guard<std::mutex> lock(mutex);
+            buffer->tid = static_cast<int>(buffers.size());
+            buffer->name = "thread " + std::to_string(buffer->tid);
+            buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    bool write_chrome_json(const std::string& file_name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ofstream file(file_name);
+        if (!file.is_open()) {
+            return false;
+        }
+        // Ticks per microsecond, measured over the lifetime of the registry
+        uint64_t end_ticks = now_ticks();
+        auto end_time = std::chrono::steady_clock::now();
+        double elapsed_us = std::chrono::duration<double, std::micro>(end_time - start_time).count();
+        double ticks_per_us = elapsed_us > 0 && end_ticks > start_ticks ? (end_ticks - start_ticks) / elapsed_us : 1000.0;
+
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        for (const auto& buffer : buffers) {
+            file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << buffer->tid << ", \"args\": {\"name\": \""
+                 << buffer->name << "\"}}";
+            first = false;
+            uint64_t n = std::min<uint64_t>(buffer->n_events, EVENTS_PER_THREAD);
+            for (uint64_t i = buffer->n_events - n; i < buffer->n_events; ++i) {
+                const event& e = buffer->ring[i % EVENTS_PER_THREAD];
+                double ts = static_cast<int64_t>(e.start - start_ticks) / ticks_per_us;
+                file << ",\n{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << buffer->tid << ", \"ts\": " << ts
+                     << ", \"dur\": " << (e.end - e.start) / ticks_per_us << "}";
+            }
+            if (buffer->n_events > n) {
+                file << ",\n{\"name\": \"" << buffer->n_events - n << " spans overwritten\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 0, \"tid\": " << buffer->tid
+                     << ", \"ts\": 0}";
+            }
+        }
+        file << "\n]}\n";
+        return static_cast<bool>(file);
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::shared_ptr<thread_buffer>> buffers;
+    uint64_t start_ticks = now_ticks();
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+};
+
+class Span {
+public:
+    explicit Span(const char* name) : buffer(Registry::instance().local()), name(name), start(now_ticks()) {}
+    ~Span() { buffer.record(name, start, now_ticks()); }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    thread_buffer& buffer;
+    const char* name;
+    uint64_t start;
+};
+
+// Span that is ended and restarted under a new name at every phase boundary
+class PhaseSpan {
+public:
+    explicit PhaseSpan(const char* name) : buffer(Registry::instance().local()), name(name), start(now_ticks()) {}
+    ~PhaseSpan() { buffer.record(name, start, now_ticks()); }
+
+    void next(const char* next_name) {
+        uint64_t now = now_ticks();
+        buffer.record(name, start, now);
+        name = next_name;
+        start = now;
+    }
+
+    PhaseSpan(const PhaseSpan&) = delete;
+    PhaseSpan& operator=(const PhaseSpan&) = delete;
+
+private:
+    thread_buffer& buffer;
+    const char* name;
+    uint64_t start;
+};
+
+inline void set_thread_name(const std::string& name) { Registry::instance().local().name = name; }
+
+inline bool write_chrome_json(const std::string& file_name) { return Registry::instance().write_chrome_json(file_name); }
+
+} // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) trace::Span TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define TRACE_PHASES(name) trace::PhaseSpan trace_phases(name)
+#define TRACE_NEXT_PHASE(name) trace_phases.next(name)
+#define TRACE_THREAD_NAME(name) trace::set_thread_name(name)
+
+#else
+
+namespace trace {
+inline bool write_chrome_json(const std::string&) { return false; }
+} // namespace trace
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_PHASES(name) ((void)0)
+#define TRACE_NEXT_PHASE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+
+#endif
+
+namespace trace {
+
+// Writes the trace of the run to file_name, if one was given (trace=<file> of the joins)
+inline void write_requested(const std::string& file_name) {
+    if (file_name.empty()) {
+        return;
+    }
+    if (write_chrome_json(file_name)) {
+        std::cout << "Trace written to " << file_name << " (open in https://ui.perfetto.dev or chrome://tracing)." << std::endl;
+    } else {
+#if defined(JOIN_TRACE)
+        std::cerr << "Could not write the trace to " << file_name << ".\n";
+#else
+        std::cerr << "Tracing is compiled out, build with -DJOIN_TRACE to write " << file_name << ".\n";
+#endif
+    }
+}
+
+} // namespace trace
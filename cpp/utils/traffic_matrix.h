@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Shuffle traffic of one link (sender -> receiver) of the distributed joins. The send side fields
+// are recorded by the sender, the receive side fields by the receiver. The diagonal holds the
+// tuples a node kept for itself (no messages).
+struct link_traffic {
+    uint64_t tuples[2];           // R, S
+    uint64_t broadcast_tuples[2]; // Copies of broadcast tuples among them (heavy hitters of the flow join)
+    uint64_t bytes;               // Headers and tuples of all frames
+    uint64_t messages;            // Data batches
+    uint64_t control_messages;    // End-of-stream and credit frames
+    double send_seconds;          // First to last frame sent on the link
+    double queue_wait_seconds;    // Sum over the batches that waited for credits
+    uint64_t received_tuples;
+    uint64_t received_bytes;
+    uint64_t received_messages;
+    double receive_seconds;       // First to last data batch received on the link
+
+    void add(const link_traffic& other) {
+        for (int r = 0; r < 2; ++r) {
+            tuples[r] += other.tuples[r];
+            broadcast_tuples[r] += other.broadcast_tuples[r];
+        }
+        bytes += other.bytes;
+        messages += other.messages;
+        control_messages += other.control_messages;
+        send_seconds += other.send_seconds;
+        queue_wait_seconds += other.queue_wait_seconds;
+        received_tuples += other.received_tuples;
+        received_bytes += other.received_bytes;
+        received_messages += other.received_messages;
+        receive_seconds += other.receive_seconds;
+    }
+};
+
+// Traffic of one node. The send thread records the outgoing links, the receive thread the
+// incoming ones, so neither needs a lock.
+class NodeTraffic {
+public:
+    NodeTraffic(int id, int n_servers) : id(id), outgoing(n_servers), incoming(n_servers), send_spans(n_servers), receive_spans(n_servers) {}
+
+    // Send thread
+    void sent(int destination, char relation, size_t tuples, size_t bytes) {
+        auto& link = outgoing.at(destination);
+        link.tuples[relation == 'R' ? 0 : 1] += tuples;
+        link.bytes += bytes;
+        link.messages++;
+        send_spans[destination].touch();
+    }
+
+    void sent_control(int destination, size_t bytes) {
+        outgoing.at(destination).bytes += bytes;
+        outgoing[destination].control_messages++;
+        send_spans[destination].touch();
+    }
+
+    void broadcast(int destination, char relation, size_t tuples) {
+        outgoing.at(destination).broadcast_tuples[relation == 'R' ? 0 : 1] += tuples;
+    }
+
+    void waited(int destination, double seconds) { outgoing.at(destination).queue_wait_seconds += seconds; }
+
+    void kept(char relation, size_t tuples) { outgoing[id].tuples[relation == 'R' ? 0 : 1] += tuples; }
+
+    // Receive thread
+    void received(int source, size_t tuples, size_t bytes) {
+        auto& link = incoming.at(source);
+        link.received_tuples += tuples;
+        link.received_bytes += bytes;
+        link.received_messages++;
+        receive_spans[source].touch();
+    }
+
+    // Outgoing links (id, 0..n-1) followed by incoming links (0..n-1, id)
+    std::vector<link_traffic> links() const {
+        std::vector<link_traffic> result(outgoing);
+        result.insert(result.end(), incoming.begin(), incoming.end());
+        int n_servers = outgoing.size();
+        for (int i = 0; i < n_servers; ++i) {
+            result[i].send_seconds = send_spans[i].seconds();
+            result[n_servers + i].receive_seconds = receive_spans[i].seconds();
+        }
+        return result;
+    }
+
+private:
+    struct span {
+        std::chrono::steady_clock::time_point first, last;
+        bool used = false;
+
+        void touch() {
+            last = std::chrono::steady_clock::now();
+            if (!used) {
+                first = last;
+                used = true;
+            }
+        }
+
+        double seconds() const { return std::chrono::duration<double>(last - first).count(); }
+    };
+
+    int id;
+    std::vector<link_traffic> outgoing;
+    std::vector<link_traffic> incoming;
+    std::vector<span> send_spans;
+    std::vector<span> receive_spans;
+};
+
+// n x n traffic matrix of a run, assembled from the links() of all nodes
+class TrafficMatrix {
+public:
+    explicit TrafficMatrix(const std::vector<std::vector<link_traffic>>& node_links) : n_servers(node_links.size()), links(n_servers * n_servers) {
+        for (int node = 0; node < n_servers; ++node) {
+            if (node_links[node].size() != 2 * static_cast<size_t>(n_servers)) {
+                throw std::invalid_argument("Node " + std::to_string(node) + " reported " + std::to_string(node_links[node].size()) + " links");
+            }
+            for (int other = 0; other < n_servers; ++other) {
+                at(node, other).add(node_links[node][other]);             // Send side of (node, other)
+                at(other, node).add(node_links[node][n_servers + other]); // Receive side of (other, node)
+            }
+        }
+    }
+
+    link_traffic& at(int sender, int receiver) { return links[sender * n_servers + receiver]; }
+    const link_traffic& at(int sender, int receiver) const { return links[sender * n_servers + receiver]; }
+    int size() const { return n_servers; }
+
+    // Sum over the links between different nodes (without the kept tuples); the times are summed
+    // as well, use the links for throughput
+    link_traffic network_total() const {
+        link_traffic total = {};
+        for (int i = 0; i < n_servers; ++i) {
+            for (int j = 0; j < n_servers; ++j) {
+                if (i != j) {
+                    total.add(at(i, j));
+                }
+            }
+        }
+        return total;
+    }
+
+    void print_summary(std::ostream& out) const {
+        auto total = network_total();
+        uint64_t kept = 0;
+        for (int i = 0; i < n_servers; ++i) {
+            kept += at(i, i).tuples[0] + at(i, i).tuples[1];
+        }
+        out << "Network traffic: " << total.tuples[0] << " R tuples (" << total.broadcast_tuples[0] << " broadcast), " << total.tuples[1] << " S tuples ("
+            << total.broadcast_tuples[1] << " broadcast), " << total.bytes << " bytes in " << total.messages << " batches and " << total.control_messages
+            << " control frames, " << total.queue_wait_seconds << " seconds of batches waiting for credits; " << kept << " tuples kept local.\n";
+    }
+
+    // One row per link
+    void write_csv(const std::string& file_name) const {
+        std::ofstream file = open(file_name);
+        file << "sender,receiver,r_tuples,s_tuples,r_broadcast_tuples,s_broadcast_tuples,bytes,messages,control_messages,send_seconds,"
+                "send_tuples_per_second,queue_wait_seconds,received_tuples,received_bytes,received_messages,receive_seconds,receive_tuples_per_second\n";
+        for (int i = 0; i < n_servers; ++i) {
+            for (int j = 0; j < n_servers; ++j) {
+                const auto& l = at(i, j);
+                file << i << ',' << j << ',' << l.tuples[0] << ',' << l.tuples[1] << ',' << l.broadcast_tuples[0] << ',' << l.broadcast_tuples[1] << ','
+                     << l.bytes << ',' << l.messages << ',' << l.control_messages << ',' << l.send_seconds << ',' << rate(l.tuples[0] + l.tuples[1], l.send_seconds) << ','
+                     << l.queue_wait_seconds << ',' << l.received_tuples << ',' << l.received_bytes << ',' << l.received_messages << ',' << l.receive_seconds << ','
+                     << rate(l.received_tuples, l.receive_seconds) << '\n';
+            }
+        }
+    }
+
+    // Run description and one object per link, matrices of tuples sent for quick plotting
+    void write_json(const std::string& file_name, const std::string& join, const std::string& transport) const {
+        std::ofstream file = open(file_name);
+        file << "{\n  \"join\": \"" << join << "\",\n  \"transport\": \"" << transport << "\",\n  \"n_servers\": " << n_servers << ",\n";
+        const char* names[2] = {"r_tuples", "s_tuples"};
+        for (int r = 0; r < 2; ++r) {
+            file << "  \"" << names[r] << "\": [";
+            for (int i = 0; i < n_servers; ++i) {
+                file << (i ? ", [" : "[");
+                for (int j = 0; j < n_servers; ++j) {
+                    file << (j ? ", " : "") << at(i, j).tuples[r];
+                }
+                file << "]";
+            }
+            file << "],\n";
+        }
+        file << "  \"links\": [\n";
+        for (int i = 0; i < n_servers; ++i) {
+            for (int j = 0; j < n_servers; ++j) {
+                const auto& l = at(i, j);
+                file << "    {\"sender\": " << i << ", \"receiver\": " << j << ", \"r_tuples\": " << l.tuples[0] << ", \"s_tuples\": " << l.tuples[1]
+                     << ", \"r_broadcast_tuples\": " << l.broadcast_tuples[0] << ", \"s_broadcast_tuples\": " << l.broadcast_tuples[1]
+                     << ", \"bytes\": " << l.bytes << ", \"messages\": " << l.messages << ", \"control_messages\": " << l.control_messages
+                     << ", \"send_seconds\": " << l.send_seconds << ", \"send_tuples_per_second\": " << rate(l.tuples[0] + l.tuples[1], l.send_seconds)
+                     << ", \"queue_wait_seconds\": " << l.queue_wait_seconds << ", \"received_tuples\": " << l.received_tuples
+                     << ", \"received_bytes\": " << l.received_bytes << ", \"received_messages\": " << l.received_messages
+                     << ", \"receive_seconds\": " << l.receive_seconds << ", \"receive_tuples_per_second\": " << rate(l.received_tuples, l.receive_seconds) << "}"
+                     << (i == n_servers - 1 && j == n_servers - 1 ? "\n" : ",\n");
+            }
+        }
+        file << "  ]\n}\n";
+    }
+
+private:
+    int n_servers;
+    std::vector<link_traffic> links;
+
+    static double rate(uint64_t tuples, double seconds) { return seconds > 0 ? tuples / seconds : 0; }
+
+    static std::ofstream open(const std::string& file_name) {
+        std::ofstream file(file_name);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open " + file_name);
+        }
+        return file;
+    }
+};
@@ -0,0 +1,481 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <zmq.hpp>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "helper_functions.h"
+
+// Moves frames between the nodes of the distributed joins. A frame is a small header (opaque to
+// the transport, see batch_protocol.h) and an optional block of tuples. Every node owns one
+// Transport; frames from one sender arrive in the order they were sent.
+//   Tcp:          ZMQ PUSH/PULL over tcp://localhost:<port_base + id>, one ZMQ context per node
+//   Inproc:       ZMQ PUSH/PULL over inproc://, one ZMQ context shared by all nodes of the process
+//   SharedMemory: a lock-free single-producer single-consumer ring per (sender, receiver) pair in
+//                 a shared memory object; processes attach by name (shm_open)
+class Transport {
+public:
+    enum Kind { Tcp, Inproc, SharedMemory };
+
+    // Called with the tuples of a sent frame once the transport does not need them anymore
+    using release_fn = void(void* data, void* hint);
+
+    struct frame {
+        const void* header;
+        size_t header_bytes;
+        const joined_row* rows; // nullptr if the frame has no tuples
+        size_t n_rows;
+    };
+
+    virtual ~Transport() = default;
+
+    // Connects to the other nodes; every node has to be constructed (bound) before
+    virtual void connect() {}
+
+    // Sends a frame to destination. rows may be used until release(rows, hint) is called,
+    // release may be nullptr if rows stay valid until the transport is destroyed.
+    virtual void send(int destination, const void* header, size_t header_bytes, const joined_row* rows, size_t n_rows,
+                      release_fn* release, void* hint) = 0;
+
+    // Waits at most timeout for the next frame; the frame stays valid until the next call
+    // (or finish_receiving()).
+    // Returns false on timeout.
+    virtual bool receive(frame& received, std::chrono::milliseconds timeout) = 0;
+
+    // Releases the frame returned by the last receive(), called once nothing is received anymore
+    virtual void finish_receiving() {}
+
+    // Number of times receive() had to sleep until a frame arrived
+    size_t wakeups() const { return n_wakeups; }
+
+    static Kind parse(const std::string& name) {
+        if (name == "tcp") return Tcp;
+        if (name == "inproc") return Inproc;
+        if (name == "shm") return SharedMemory;
+        throw std::invalid_argument("Unknown transport: " + name + " (tcp, inproc or shm)");
+    }
+
+    static const char* name(Kind kind) {
+        static const char* names[3] = {"tcp", "inproc", "shm"};
+        return names[kind];
+    }
+
+protected:
+    size_t n_wakeups = 0;
+};
+
+class ZmqTransport : public Transport {
+public:
+    // endpoint(i) is bound by node i and connected to by all others
+    template <typename EndpointFn>
+    ZmqTransport(zmq::context_t& context, int id, int n_servers, EndpointFn endpoint)
+        : context(&context), id(id), receiver(context, zmq::socket_type::pull), senders(n_servers) {
+        std::string address = endpoint(id);
+        if (address.rfind("tcp://", 0) == 0) {
+            address = "tcp://*:" + address.substr(address.rfind(':') + 1);
+        }
+        receiver.bind(address);
+        for (int i = 0; i < n_servers; ++i) {
+            endpoints.push_back(endpoint(i));
+        }
+    }
+
+    // Transport with its own context (one ZMQ I/O thread per node)
+    template <typename EndpointFn>
+    static std::unique_ptr<ZmqTransport> with_own_context(int id, int n_servers, EndpointFn endpoint) {
+        auto own_context = std::make_unique<zmq::context_t>(1);
+        auto transport = std::make_unique<ZmqTransport>(*own_context, id, n_servers, endpoint);
+        transport->own_context = std::move(own_context);
+        return transport;
+    }
+
+    ~ZmqTransport() override {
+        // Sockets have to be closed before their context is terminated
+        receiver.close();
+        for (auto& sender : senders) {
+            sender.close();
+        }
+    }
+
+    void connect() override {
+        for (int i = 0; i < static_cast<int>(senders.size()); ++i) {
+            if (i != id) {
+                senders[i] = zmq::socket_t(*context, zmq::socket_type::push);
+                senders[i].connect(endpoints[i]);
+            }
+        }
+    }
+
+    // The header is copied, the tuples are handed to ZMQ without copying
+    void send(int destination, const void* header, size_t header_bytes, const joined_row* rows, size_t n_rows,
+              release_fn* release, void* hint) override {
+        zmq::message_t header_frame(header, header_bytes);
+        if (!rows) {
+            senders.at(destination).send(header_frame, zmq::send_flags::none);
+            return;
+        }
+        senders.at(destination).send(header_frame, zmq::send_flags::sndmore);
+        zmq::message_t rows_frame(const_cast<joined_row*>(rows), n_rows * sizeof(joined_row), release ? release : no_release, hint);
+        senders.at(destination).send(rows_frame, zmq::send_flags::none);
+    }
+
+    bool receive(frame& received, std::chrono::milliseconds timeout) override {
+        if (!receiver.recv(header_frame, zmq::recv_flags::dontwait)) {
+            zmq::pollitem_t items[] = {{static_cast<void*>(receiver), 0, ZMQ_POLLIN, 0}};
+            n_wakeups++;
+            if (zmq::poll(items, 1, timeout) == 0 || !receiver.recv(header_frame, zmq::recv_flags::dontwait)) {
+                return false;
+            }
+        }
+        received = {header_frame.data(), header_frame.size(), nullptr, 0};
+        if (!header_frame.more()) {
+            return true;
+        }
+        // The rows frame is part of the same message, so it is already queued
+        if (!receiver.recv(rows_frame, zmq::recv_flags::dontwait) || rows_frame.size() % sizeof(joined_row) != 0) {
+            throw std::runtime_error("Invalid rows frame after a header frame");
+        }
+        received.n_rows = rows_frame.size() / sizeof(joined_row);
+        if (reinterpret_cast<uintptr_t>(rows_frame.data()) % alignof(joined_row) == 0) {
+            received.rows = static_cast<const joined_row*>(rows_frame.data());
+        } else {
+            // Small frames are stored inside message_t
+            copy_buffer.resize(received.n_rows);
+            memcpy(copy_buffer.data(), rows_frame.data(), rows_frame.size());
+            received.rows = copy_buffer.data();
+        }
+        return true;
+    }
+
+    // With inproc the rows frame is the sender's buffer, which the sender waits for
+    void finish_receiving() override {
+        header_frame = zmq::message_t();
+        rows_frame = zmq::message_t();
+    }
+
+private:
+    std::unique_ptr<zmq::context_t> own_context; // Declared first, terminated after the sockets
+    zmq::context_t* context;
+    int id;
+    zmq::socket_t receiver;
+    std::vector<zmq::socket_t> senders;
+    std::vector<std::string> endpoints;
+    zmq::message_t header_frame;
+    zmq::message_t rows_frame;
+    std::vector<joined_row> copy_buffer;
+
+    static void no_release(void*, void*) {}
+};
+
+// n_servers x n_servers rings in one shared memory object. Layout: one doorbell per receiver,
+// then the rings; ring (sender, receiver) has a control block and ring_bytes of records.
+// A record is [uint32 record bytes][uint32 header bytes][uint32 tuples][header][tuples], padded to 16 bytes;
+// a record size of 0 tells the reader to continue at the start of the ring (records never wrap).
+// All fields start zeroed, which is a valid empty state, so any process may create the object.
+class SharedMemoryRings {
+public:
+    static constexpr size_t DEFAULT_RING_BYTES = 4 << 20;
+
+    struct alignas(64) doorbell {
+        std::atomic<uint32_t> sequence; // Incremented for every published record, futex word
+        std::atomic<uint32_t> waiting;  // Receiver sleeps on sequence
+    };
+
+    struct alignas(64) ring_control {
+        alignas(64) std::atomic<uint64_t> head; // Bytes written, only the sender writes it
+        alignas(64) std::atomic<uint64_t> tail; // Bytes read, only the receiver writes it
+        std::atomic<uint32_t> tail_sequence;    // Incremented whenever tail moves, futex word
+        std::atomic<uint32_t> sender_waiting;   // Sender sleeps on tail_sequence
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring positions are shared between processes");
+
+    // name: shm_open name shared by all processes; empty for an anonymous object (memfd) used
+    // by the threads of one process
+    SharedMemoryRings(int n_servers, size_t ring_bytes = DEFAULT_RING_BYTES, const std::string& name = "")
+        : n_servers(n_servers), ring_bytes(ring_bytes / 16 * 16), name(name) {
+        if (this->ring_bytes < 1024) {
+            throw std::invalid_argument("Ring of " + std::to_string(ring_bytes) + " bytes is too small");
+        }
+        ring_stride = sizeof(ring_control) + this->ring_bytes;
+        size_t doorbell_bytes = (n_servers * sizeof(doorbell) + 63) / 64 * 64;
+        total_bytes = doorbell_bytes + static_cast<size_t>(n_servers) * n_servers * ring_stride;
+
+        int fd = name.empty() ? static_cast<int>(syscall(SYS_memfd_create, "flow_join_rings", 0)) : shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+        if (fd < 0 || ftruncate(fd, total_bytes) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Cannot create shared memory " + (name.empty() ? std::string("(memfd)") : name) + ": " + strerror(errno));
+        }
+        base = static_cast<char*>(mmap(nullptr, total_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        close(fd);
+        if (base == MAP_FAILED) {
+            throw std::runtime_error(std::string("Cannot map shared memory: ") + strerror(errno));
+        }
+        rings_begin = base + doorbell_bytes;
+    }
+
+    ~SharedMemoryRings() {
+        munmap(base, total_bytes);
+    }
+
+    SharedMemoryRings(const SharedMemoryRings&) = delete;
+    SharedMemoryRings& operator=(const SharedMemoryRings&) = delete;
+
+    // Removes a named object, processes that mapped it keep their mapping
+    static void remove(const std::string& name) {
+        shm_unlink(name.c_str());
+    }
+
+    doorbell& bell(int receiver) { return reinterpret_cast<doorbell*>(base)[receiver]; }
+    ring_control& control(int sender, int receiver) { return *reinterpret_cast<ring_control*>(ring(sender, receiver)); }
+    char* data(int sender, int receiver) { return ring(sender, receiver) + sizeof(ring_control); }
+    size_t capacity() const { return ring_bytes; }
+    int size() const { return n_servers; }
+
+    // Bytes a frame takes in the ring, rows start aligned after the sizes and the header
+    static size_t record_bytes(size_t header_bytes, size_t n_rows) {
+        return (rows_offset(header_bytes) + n_rows * sizeof(joined_row) + 15) / 16 * 16;
+    }
+
+    static size_t rows_offset(size_t header_bytes) {
+        return (3 * sizeof(uint32_t) + header_bytes + alignof(joined_row) - 1) / alignof(joined_row) * alignof(joined_row);
+    }
+
+    // Largest frame a ring of ring_bytes accepts, a record may take at most half of the ring
+    static size_t max_rows(size_t header_bytes, size_t ring_bytes = DEFAULT_RING_BYTES) {
+        size_t capacity = ring_bytes / 16 * 16;
+        return (capacity / 2 / 16 * 16 - rows_offset(header_bytes)) / sizeof(joined_row);
+    }
+
+    // Futex on a word that may be shared between processes (no FUTEX_PRIVATE_FLAG)
+    static bool futex_wait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::milliseconds timeout) {
+        timespec ts = {static_cast<time_t>(timeout.count() / 1000), static_cast<long>(timeout.count() % 1000) * 1000000};
+        return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0) == 0;
+    }
+
+    static void futex_wake(std::atomic<uint32_t>& word) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+    }
+
+private:
+    int n_servers;
+    size_t ring_bytes;
+    std::string name;
+    size_t ring_stride;
+    size_t total_bytes;
+    char* base;
+    char* rings_begin;
+
+    char* ring(int sender, int receiver) {
+        return rings_begin + (static_cast<size_t>(sender) * n_servers + receiver) * ring_stride;
+    }
+};
+
+class SharedMemoryTransport : public Transport {
+public:
+    SharedMemoryTransport(SharedMemoryRings& rings, int id) : rings(rings), id(id), next_source(0) {}
+
+    ~SharedMemoryTransport() override {
+        consume_pending();
+    }
+
+    void finish_receiving() override {
+        consume_pending();
+    }
+
+    // Copies the frame into the ring of destination (waits while the ring is full) and releases
+    // the tuples right away
+    void send(int destination, const void* header, size_t header_bytes, const joined_row* rows, size_t n_rows,
+              release_fn* release, void* hint) override {
+        size_t rows_offset = SharedMemoryRings::rows_offset(header_bytes);
+        size_t record_bytes = SharedMemoryRings::record_bytes(header_bytes, n_rows);
+        const size_t capacity = rings.capacity();
+        if (record_bytes > capacity / 2) {
+            throw std::runtime_error("Frame of " + std::to_string(record_bytes) + " bytes does not fit into a ring of " + std::to_string(capacity) + " bytes");
+        }
+        auto& control = rings.control(id, destination);
+        char* data = rings.data(id, destination);
+        uint64_t head = control.head.load(std::memory_order_relaxed);
+        size_t offset = head % capacity;
+        size_t skip = capacity - offset < record_bytes ? capacity - offset : 0; // Rest of the ring if the record does not fit
+        wait_for_space(control, head + skip + record_bytes - capacity);
+
+        if (skip > 0) {
+            uint32_t wrap = 0;
+            memcpy(data + offset, &wrap, sizeof(uint32_t));
+            head += skip;
+            offset = 0;
+        }
+        uint32_t sizes[3] = {static_cast<uint32_t>(record_bytes), static_cast<uint32_t>(header_bytes), static_cast<uint32_t>(n_rows)};
+        memcpy(data + offset, sizes, sizeof(sizes));
+        memcpy(data + offset + sizeof(sizes), header, header_bytes);
+        if (n_rows > 0) {
+            memcpy(data + offset + rows_offset, rows, n_rows * sizeof(joined_row));
+        }
+        control.head.store(head + record_bytes, std::memory_order_release);
+
+        auto& bell = rings.bell(destination);
+        bell.sequence.fetch_add(1, std::memory_order_seq_cst);
+        if (bell.waiting.load(std::memory_order_seq_cst)) {
+            SharedMemoryRings::futex_wake(bell.sequence);
+        }
+        if (rows && release) {
+            release(const_cast<joined_row*>(rows), hint);
+        }
+    }
+
+    // Reads the next record in place, round robin over the senders; the record is consumed by the
+    // next call
+    bool receive(frame& received, std::chrono::milliseconds timeout) override {
+        consume_pending();
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        auto& bell = rings.bell(id);
+        while (true) {
+            uint32_t sequence = bell.sequence.load(std::memory_order_seq_cst);
+            for (int k = 0; k < rings.size(); ++k) {
+                int source = (next_source + k) % rings.size();
+                if (source != id && read_record(source, received)) {
+                    next_source = (source + 1) % rings.size();
+                    return true;
+                }
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return false;
+            }
+            n_wakeups++;
+            bell.waiting.store(1, std::memory_order_seq_cst);
+            if (bell.sequence.load(std::memory_order_seq_cst) == sequence) {
+                SharedMemoryRings::futex_wait(bell.sequence, sequence, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1));
+            }
+            bell.waiting.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    SharedMemoryRings& rings;
+    int id;
+    int next_source;
+    int pending_source = -1; // Ring of the record returned by the last receive()
+    uint64_t pending_tail = 0;
+
+    bool read_record(int source, frame& received) {
+        auto& control = rings.control(source, id);
+        const char* data = rings.data(source, id);
+        const size_t capacity = rings.capacity();
+        uint64_t tail = control.tail.load(std::memory_order_relaxed);
+        uint64_t head = control.head.load(std::memory_order_acquire);
+        if (tail == head) {
+            return false;
+        }
+        size_t offset = tail % capacity;
+        uint32_t sizes[3];
+        memcpy(sizes, data + offset, sizeof(uint32_t));
+        if (sizes[0] == 0) {
+            // Wrap marker, the record starts at the beginning of the ring
+            tail += capacity - offset;
+            offset = 0;
+        }
+        memcpy(sizes, data + offset, sizeof(sizes));
+        size_t rows_offset = SharedMemoryRings::rows_offset(sizes[1]);
+        received.header = data + offset + sizeof(sizes);
+        received.header_bytes = sizes[1];
+        received.n_rows = sizes[2];
+        received.rows = received.n_rows > 0 ? reinterpret_cast<const joined_row*>(data + offset + rows_offset) : nullptr;
+        pending_source = source;
+        pending_tail = tail + sizes[0];
+        return true;
+    }
+
+    // Frees the record returned last, the sender may then overwrite it
+    void consume_pending() {
+        if (pending_source < 0) {
+            return;
+        }
+        auto& control = rings.control(pending_source, id);
+        control.tail.store(pending_tail, std::memory_order_release);
+        control.tail_sequence.fetch_add(1, std::memory_order_seq_cst);
+        if (control.sender_waiting.load(std::memory_order_seq_cst)) {
+            SharedMemoryRings::futex_wake(control.tail_sequence);
+        }
+        pending_source = -1;
+    }
+
+    // Waits until the receiver has read past position (bytes written - capacity + needed)
+    void wait_for_space(SharedMemoryRings::ring_control& control, uint64_t min_tail) {
+        if (static_cast<int64_t>(min_tail) <= 0) {
+            return;
+        }
+        while (control.tail.load(std::memory_order_acquire) < min_tail) {
+            uint32_t sequence = control.tail_sequence.load(std::memory_order_seq_cst);
+            control.sender_waiting.store(1, std::memory_order_seq_cst);
+            if (control.tail.load(std::memory_order_acquire) < min_tail) {
+                SharedMemoryRings::futex_wait(control.tail_sequence, sequence, std::chrono::milliseconds(100));
+            }
+            control.sender_waiting.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Creates the transport of every node and owns what the nodes of a process share
+// (the ZMQ context for inproc, the rings for shared memory)
+class TransportFactory {
+public:
+    // All nodes are threads of this process
+    TransportFactory(Transport::Kind kind, int n_servers, int port_base = 5550, size_t ring_bytes = SharedMemoryRings::DEFAULT_RING_BYTES)
+        : kind(kind), n_servers(n_servers) {
+        for (int i = 0; i < n_servers; ++i) {
+            nodes.push_back("localhost:" + std::to_string(port_base + i));
+        }
+        if (kind == Transport::Inproc) {
+            context = std::make_unique<zmq::context_t>(1);
+        } else if (kind == Transport::SharedMemory) {
+            rings = std::make_unique<SharedMemoryRings>(n_servers, ring_bytes);
+        }
+    }
+
+    // Every node is a process: nodes are the host:port addresses of the cluster config, the rings
+    // of shm are attached by name (all processes on one host)
+    TransportFactory(Transport::Kind kind, const std::vector<std::string>& nodes, const std::string& shm_name,
+                     size_t ring_bytes = SharedMemoryRings::DEFAULT_RING_BYTES)
+        : kind(kind), n_servers(nodes.size()), nodes(nodes) {
+        if (kind == Transport::Inproc) {
+            throw std::invalid_argument("The inproc transport only connects the nodes of one process");
+        } else if (kind == Transport::SharedMemory) {
+            rings = std::make_unique<SharedMemoryRings>(n_servers, ring_bytes, shm_name);
+        }
+    }
+
+    std::unique_ptr<Transport> create(int id) {
+        switch (kind) {
+            case Transport::Tcp:
+                return ZmqTransport::with_own_context(id, n_servers, [this](int i) { return "tcp://" + nodes[i]; });
+            case Transport::Inproc:
+                return std::make_unique<ZmqTransport>(*context, id, n_servers, [this](int i) { return "inproc://node_" + nodes[i]; });
+            case Transport::SharedMemory:
+                return std::make_unique<SharedMemoryTransport>(*rings, id);
+        }
+        return nullptr;
+    }
+
+    Transport::Kind get_kind() const { return kind; }
+
+private:
+    Transport::Kind kind;
+    int n_servers;
+    std::vector<std::string> nodes;
+    std::unique_ptr<zmq::context_t> context;
+    std::unique_ptr<SharedMemoryRings> rings;
+};
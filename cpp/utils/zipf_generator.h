@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+// Counter-based random number generator Philox4x32-10.
+// Salmon J. et al. Parallel Random Numbers: As Easy as 1, 2, 3. 2011
+// Every output block is a pure function of (key, counter), so any thread can
+// jump to any position of a stream without sharing state with other threads.
+class Philox4x32 {
+public:
+    explicit Philox4x32(uint64_t seed) : key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)} {}
+
+    // Returns the 128 random bits of block (counter_lo, counter_hi)
+    std::array<uint32_t, 4> operator()(uint64_t counter_lo, uint64_t counter_hi) const {
+        std::array<uint32_t, 4> ctr = {static_cast<uint32_t>(counter_lo), static_cast<uint32_t>(counter_lo >> 32),
+                                       static_cast<uint32_t>(counter_hi), static_cast<uint32_t>(counter_hi >> 32)};
+        std::array<uint32_t, 2> k = key;
+        for (int round = 0; round < 10; ++round) {
+            ctr = single_round(ctr, k);
+            k[0] += W0;
+            k[1] += W1;
+        }
+        return ctr;
+    }
+
+    // Converts 64 random bits into a uniform double in [0, 1)
+    static double to_unit_double(uint32_t lo, uint32_t hi) {
+        uint64_t bits = (static_cast<uint64_t>(hi) << 32) | lo;
+        return static_cast<double>(bits >> 11) * 0x1.0p-53;
+    }
+
+private:
+    static constexpr uint32_t M0 = 0xD2511F53;
+    static constexpr uint32_t M1 = 0xCD9E8D57;
+    static constexpr uint32_t W0 = 0x9E3779B9;
+    static constexpr uint32_t W1 = 0xBB67AE85;
+
+    std::array<uint32_t, 2> key;
+
+    static std::array<uint32_t, 4> single_round(const std::array<uint32_t, 4>& ctr, const std::array<uint32_t, 2>& k) {
+        uint64_t p0 = static_cast<uint64_t>(M0) * ctr[0];
+        uint64_t p1 = static_cast<uint64_t>(M1) * ctr[2];
+        return {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ k[0], static_cast<uint32_t>(p1),
+                static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ k[1], static_cast<uint32_t>(p0)};
+    }
+};
+
+// Zipf sampler based on rejection-inversion, O(1) expected cost per sample and no CDF table.
+// Hoermann W., Derflinger G. Rejection-inversion to generate variates from monotone discrete distributions. 1996
+// Implements p(i) = C/i^alpha for i = 1 to n
+class ZipfSampler {
+public:
+    ZipfSampler(uint64_t n, double alpha) : n(n), alpha(alpha) {
+        if (n == 0) {
+            throw std::invalid_argument("Zipf sampler needs at least one element");
+        }
+        if (alpha < 0) {
+            throw std::invalid_argument("Zipf exponent alpha must not be negative");
+        }
+        h_integral_x1 = h_integral(1.5) - 1.0;
+        h_integral_n = h_integral(static_cast<double>(n) + 0.5);
+        s = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+    }
+
+    // Maps a uniform number u in [0, 1) to a candidate; returns 0 if the candidate is rejected
+    uint64_t try_sample(double uniform) const {
+        double u = h_integral_n + uniform * (h_integral_x1 - h_integral_n);
+        double x = h_integral_inverse(u);
+        double k = std::floor(x + 0.5);
+        if (k < 1) {
+            k = 1;
+        } else if (k > static_cast<double>(n)) {
+            k = static_cast<double>(n);
+        }
+        if (k - x <= s || u >= h_integral(k + 0.5) - h(k)) {
+            return static_cast<uint64_t>(k);
+        }
+        return 0;
+    }
+
+    uint64_t size() const { return n; }
+    double exponent() const { return alpha; }
+
+private:
+    uint64_t n;
+    double alpha;
+    double h_integral_x1;
+    double h_integral_n;
+    double s;
+
+    // H(x) = integral of h(x) = x^-alpha, shifted such that H(1) = 0
+    double h_integral(double x) const {
+        double log_x = std::log(x);
+        return helper2((1.0 - alpha) * log_x) * log_x;
+    }
+
+    double h(double x) const { return std::exp(-alpha * std::log(x)); }
+
+    double h_integral_inverse(double x) const {
+        double t = x * (1.0 - alpha);
+        if (t < -1.0) {
+            t = -1.0; // Limit value to the range [-1, +inf) to avoid NaNs from rounding errors
+        }
+        return std::exp(helper1(t) * x);
+    }
+
+    // log(1 + x) / x, numerically stable around 0
+    static double helper1(double x) {
+        if (std::abs(x) > 1e-8) {
+            return std::log1p(x) / x;
+        }
+        return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+    }
+
+    // (exp(x) - 1) / x, numerically stable around 0
+    static double helper2(double x) {
+        if (std::abs(x) > 1e-8) {
+            return std::expm1(x) / x;
+        }
+        return 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+    }
+};
+
+// Deterministic, random-access Zipf stream: value(i) depends only on (seed, stream, i).
+// Threads can therefore generate disjoint index ranges and obtain exactly the output
+// of a single-threaded run, independent of the number of threads.
+class ZipfGenerator {
+public:
+    ZipfGenerator(uint64_t seed, double alpha, uint64_t n, uint32_t stream = 0)
+        : rng(seed), sampler(n, alpha), stream(stream) {}
+
+    uint32_t operator()(uint64_t index) const {
+        // Each Philox block yields two uniforms, i.e. two rejection-inversion attempts
+        for (uint64_t attempt_block = 0;; ++attempt_block) {
+            auto bits = rng(index, (attempt_block << 32) | stream);
+            uint64_t value = sampler.try_sample(Philox4x32::to_unit_double(bits[0], bits[1]));
+            if (value == 0) {
+                value = sampler.try_sample(Philox4x32::to_unit_double(bits[2], bits[3]));
+            }
+            if (value != 0) {
+                return static_cast<uint32_t>(value);
+            }
+        }
+    }
+
+    const ZipfSampler& distribution() const { return sampler; }
+
+private:
+    Philox4x32 rng;
+    ZipfSampler sampler;
+    uint32_t stream;
+};
@@ -1,6 +1,27 @@
+import sys
+import csv
 import matplotlib.pyplot as plt
 import numpy as np
 
+# Usage: python comparison_joins_visualization.py [<skew_sweep csv> [n_servers]]
+# The CSV is written by skew_sweep, e.g. ./skew_sweep alpha=0,1.25 csv=skew_sweep.csv; the lowest
+# and the highest alpha of the sweep are compared. Without it the times of an earlier run are plotted.
+
+
+def times_from_sweep(file_name, n_servers=None):
+    # {(join, alpha): row} of the first |R|, |S| (and n_servers) in the sweep
+    rows = {}
+    with open(file_name) as file:
+        for row in csv.DictReader(file):
+            if n_servers is None:
+                n_servers = row['n_servers']
+            if row['n_servers'] == n_servers:
+                rows.setdefault((row['join'], float(row['alpha'])), row)
+    return rows
+
+
+skew_title = 'Skew (Zipf 1.25)'
+
 # Local data for Flow-Join and Hash Join
 
 hash_join_no_skew = {
@@ -21,6 +42,19 @@ flow_join_zipf = {
     'process_probe': np.max([0.24765, 0.244236, 0.235815, 0.273832])
 }
 
+if len(sys.argv) >= 2:
+    sweep = times_from_sweep(sys.argv[1], sys.argv[2] if len(sys.argv) > 2 else None)
+    alphas = sorted({alpha for _, alpha in sweep})
+    low, high = sweep[('hash', alphas[0])], sweep[('hash', alphas[-1])]
+    flow_low, flow_high = sweep[('flow', alphas[0])], sweep[('flow', alphas[-1])]
+    hash_join_no_skew = {'process_probe': float(low['makespan_seconds'])}
+    hash_join_zipf = {'process_probe': float(high['makespan_seconds'])}
+    flow_join_no_skew = {'detect_skew': float(flow_low['detect_seconds']),
+                         'process_probe': float(flow_low['makespan_seconds']) - float(flow_low['detect_seconds'])}
+    flow_join_zipf = {'detect_skew': float(flow_high['detect_seconds']),
+                      'process_probe': float(flow_high['makespan_seconds']) - float(flow_high['detect_seconds'])}
+    skew_title = 'Skew (Zipf ' + str(alphas[-1]) + ')'
+
 
 # Plot
 fig, axs = plt.subplots(2, 1, figsize=(16, 6))
@@ -40,13 +74,14 @@ skew_data = [
 ]
 
 colors = ['#f0a207', '#399164']  # Colors for detect skew, process probe
+x_max = 1.1 * max(no_skew_data + skew_data) if len(sys.argv) >= 2 else 0.5
 
 # Plot no skew
 axs[0].barh(categories, no_skew_data, color=[colors[1], colors[1]])
 axs[0].barh(categories[1], flow_join_no_skew['detect_skew'], color=colors[0])
 
 axs[0].set_title('No skew')
-axs[0].set_xlim(0, 0.5)
+axs[0].set_xlim(0, x_max)
 axs[0].set_xlabel('Maximum Time (s)')
 axs[0].legend(['process probe', 'detect skew'], loc='upper right')
 
@@ -54,8 +89,8 @@ axs[0].legend(['process probe', 'detect skew'], loc='upper right')
 axs[1].barh(categories, skew_data, color=[colors[1], colors[1]])
 axs[1].barh(categories[1], flow_join_zipf['detect_skew'], color=colors[0])
 
-axs[1].set_title('Skew (Zipf 1.25)')
-axs[1].set_xlim(0, 0.5)
+axs[1].set_title(skew_title)
+axs[1].set_xlim(0, x_max)
 axs[1].set_xlabel('Maximum Time (s)')
 axs[1].legend(['process probe', 'detect skew'], loc='upper right')
 
@@ -1,11 +1,33 @@
+import sys
+import csv
 import matplotlib.pyplot as plt
 
-# read C++ update rates
-with open("update_rates.txt", "r") as file:
-    lines = file.readlines()
+# Usage: python data_structures_visualization_cpp.py [<join_benchmark csv>]
+# The CSV is written by join_benchmark, e.g.
+#   ./join_benchmark filter=spacesaving r=2,4,8,...,32768 s=1000000 alpha=0 csv=update_rates.csv
+# without it the update rates of an earlier run in update_rates.txt are plotted.
 
-header = lines[0].strip().split()
-data = [list(map(float, line.strip().split())) for line in lines[1:]]
+
+def update_rates_from_benchmark(file_name):
+    # Median updates/s per number of distinct values (|R|) for every data structure
+    rates = {}
+    with open(file_name) as file:
+        for row in csv.DictReader(file):
+            if row['benchmark'].startswith('spacesaving_'):
+                rates.setdefault(row['benchmark'], {})[int(row['r_tuples'])] = float(row['items_per_second'])
+    distinct_values = sorted(rates['spacesaving_hash_table'])
+    return [[v, rates['spacesaving_hash_table'][v], rates['spacesaving_heap'][v], rates['spacesaving_sorted_array'][v]] for v in distinct_values]
+
+
+if len(sys.argv) == 2:
+    data = update_rates_from_benchmark(sys.argv[1])
+else:
+    # read C++ update rates
+    with open("update_rates.txt", "r") as file:
+        lines = file.readlines()
+
+    header = lines[0].strip().split()
+    data = [list(map(float, line.strip().split())) for line in lines[1:]]
 
 distinct_values_list = [row[0] for row in data]
 update_rates_hash_table = [row[1] for row in data]
@@ -1,16 +1,38 @@
+import sys
+import csv
 import matplotlib.pyplot as plt
 import numpy as np
 
-# Assuming the provided data
-data = np.array([
-    [759388, 2077608],
-    [742049, 1513831],
-    [749005, 1893498],
-    [755535, 2015165]
-])
+# Usage: python num_tuples_flow_vs_hash.py [<flow join traffic.csv> <hash join traffic.csv>]
+# The CSV files are the traffic matrices written by the distributed joins with traffic=<prefix>;
+# without them the numbers of an earlier run are plotted.
+
+
+def tuples_sent_per_server(file_name):
+    # Sum of the R and S tuples every server sent to the other servers
+    sent = {}
+    with open(file_name) as file:
+        for row in csv.DictReader(file):
+            sender = int(row['sender'])
+            sent.setdefault(sender, 0)
+            if sender != int(row['receiver']):
+                sent[sender] += int(row['r_tuples']) + int(row['s_tuples'])
+    return [sent[s] for s in sorted(sent)]
+
+
+if len(sys.argv) == 3:
+    data = np.array([tuples_sent_per_server(sys.argv[1]), tuples_sent_per_server(sys.argv[2])]).T
+else:
+    # Assuming the provided data
+    data = np.array([
+        [759388, 2077608],
+        [742049, 1513831],
+        [749005, 1893498],
+        [755535, 2015165]
+    ])
 
 # Creating the bar plot
-servers = ['1', '2', '3', '4']
+servers = [str(i + 1) for i in range(len(data))]
 no_skew = data[:, 0]
 skew = data[:, 1]
 
@@ -31,4 +53,4 @@ plt.title('Num. of sent tuples for hash- and flow-join')
 
 # Saving the plot with high DPI for quality
 plt.savefig('num_tuples_flow_vs_hash.jpeg', format='jpeg', dpi=300)
-plt.show()
\ No newline at end of file
+plt.show()
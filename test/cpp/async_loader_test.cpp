@@ -0,0 +1,94 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <cstddef>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include "../../cpp/utils/async_loader.h"
+
+// Write a binary partition that is not a multiple of the chunk size and load it with every reader
+bool test_load(const loader_options& options, size_t rows) {
+    std::string file_name = "async_loader_test.bin";
+    {
+        std::ofstream file(file_name, std::ios::binary);
+        for (uint32_t i = 0; i < rows; ++i) {
+            uint32_t pair[2] = {i * 2654435761u, i};
+            file.write(reinterpret_cast<const char*>(pair), sizeof(pair));
+        }
+    }
+
+    load_statistics statistics;
+    auto loaded = load_partitions({file_name, file_name}, options, &statistics);
+    auto expected = read_data(file_name);
+    fs::remove(file_name);
+    std::cout << "uring: " << statistics.uring << ", direct files: " << statistics.direct_files << ", chunk: " << options.chunk_bytes
+              << ", depth: " << options.queue_depth << ", bytes: " << statistics.bytes << std::endl;
+    if (options.use_uring && !statistics.uring) {
+        std::cout << "io_uring not available, read with pread" << std::endl;
+    }
+    for (const auto& data : loaded) {
+        if (data.size() != expected.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < data.size(); ++i) {
+            if (data[i].join_val != expected[i].join_val || data[i].row_R != expected[i].row_R || data[i].row_S != expected[i].row_S) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// io_uring_setup fails with EPERM on this thread only, as under the default seccomp profile of Docker
+bool block_io_uring() {
+    sock_filter filter[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_io_uring_setup, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EPERM),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+    };
+    sock_fprog program = {static_cast<unsigned short>(sizeof(filter) / sizeof(filter[0])), filter};
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 && prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0;
+}
+
+// Without io_uring the loader reads with pread instead of failing
+bool test_fallback() {
+    bool ok = false;
+    std::thread blocked([&ok]() {
+        if (!block_io_uring()) {
+            std::cout << "seccomp not permitted, fallback test skipped" << std::endl;
+            ok = true;
+            return;
+        }
+        try {
+            ok = test_load({4096, 4, false, true}, 100001);
+            IoUring ring(4);
+            ok = false; // io_uring_setup was not blocked
+        } catch (const IoUring::unavailable& e) {
+            std::cout << "Blocked: " << e.what() << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Fallback failed: " << e.what() << std::endl;
+            ok = false;
+        }
+    });
+    blocked.join();
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    for (bool uring : {true, false}) {
+        for (bool direct : {false, true}) {
+            ok &= test_load({1 << 20, 32, direct, uring}, 1000003);
+            ok &= test_load({4096, 2, direct, uring}, 100001); // More chunks than buffers
+            ok &= test_load({4096, 4, direct, uring}, 0);
+        }
+    }
+
+    ok &= test_fallback();
+
+    std::cout << (ok ? "All async loader tests passed." : "Async loader tests FAILED.") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "../../cpp/utils/receive_engine.h"
+
+// Flow control with a window and a queue of one batch: node 0 sends to node 1 over shared memory
+// rings. Credits are granted by hand first, so how many batches wait in memory and on disk is
+// known; the spill file is read completely (rewound) and written again before the last drain.
+bool test_spill() {
+    const size_t batch_tuples = 100;
+    SharedMemoryRings rings(2, 1 << 16);
+    SharedMemoryTransport transport_0(rings, 0), transport_1(rings, 1);
+    batch_protocol::flow_control_options options;
+    options.window_tuples = 1;
+    options.queue_tuples = 1;
+    batch_protocol::FlowControl flow_0(transport_0, 0, 2, batch_tuples, options), flow_1(transport_1, 1, 2, batch_tuples, options);
+    batch_protocol::BatchSender to_1(transport_0, 1, 0, batch_tuples, &flow_0), to_0(transport_1, 0, 1, batch_tuples, &flow_1);
+
+    // Node 1 checks that the tuples of every relation arrive in the order they were added
+    bool ok = flow_0.window_batches() == 1 && flow_0.max_queued_batches() == 1;
+    uint32_t next_r = 0, next_s = 0;
+    bool in_order = true, receive_ok = true;
+    ReceiveEngine engine_0(transport_0, 2, &flow_0), engine_1(transport_1, 2, &flow_1);
+    auto receive = [&receive_ok](ReceiveEngine& engine, auto deliver) {
+        try {
+            engine.run(deliver, [](char) {});
+        } catch (const std::exception& e) {
+            std::cerr << "Receive error: " << e.what() << "\n";
+            receive_ok = false;
+        }
+    };
+    ReceiveThread receive_0(engine_0, [&]() { receive(engine_0, [](char, const joined_row*, size_t) {}); });
+    ReceiveThread receive_1(engine_1, [&]() {
+        receive(engine_1, [&](char relation, const joined_row* rows, size_t n) {
+            uint32_t& next = relation == 'R' ? next_r : next_s;
+            for (size_t i = 0; i < n; ++i) {
+                in_order &= rows[i].join_val == next++;
+            }
+        });
+    });
+    auto add = [&](char relation, uint32_t begin, uint32_t end) {
+        for (uint32_t v = begin; v < end; ++v) {
+            to_1.add(relation, {v, 0, v});
+        }
+    };
+
+    // 5 batches: the first takes the only credit, one waits in memory, three are spilled
+    add('R', 0, 500);
+    ok &= to_1.batches_queued() == 4 && to_1.batches_spilled() == 3;
+    // With 4 credits the next batch drains the queue and the whole spill file, then waits itself;
+    // the following four are spilled again from the start of the file
+    flow_0.grant(1, 4);
+    add('R', 500, 1000);
+    ok &= to_1.batches_queued() == 9 && to_1.batches_spilled() == 7;
+    // The memory queue is full, all S batches are spilled behind the R batches
+    add('S', 0, 300);
+    ok &= to_1.batches_queued() == 12 && to_1.batches_spilled() == 10;
+    if (!ok) {
+        std::cerr << "Queued " << to_1.batches_queued() << ", spilled " << to_1.batches_spilled() << "\n";
+    }
+
+    // Node 1 returns credits until it received everything, node 0 drains its queue
+    std::thread node_1([&]() {
+        to_0.end_of_stream('R');
+        to_0.end_of_stream('S');
+        flow_1.finish_sending();
+    });
+    to_1.end_of_stream('R');
+    to_1.end_of_stream('S');
+    flow_0.finish_sending();
+    node_1.join();
+    receive_0.join();
+    receive_1.join();
+
+    ok &= receive_ok && in_order && next_r == 1000 && next_s == 300;
+    ok &= engine_1.tuples_received() == 1300 && engine_1.batches_received() == 13 && to_1.tuples_sent() == 1300;
+    if (!ok) {
+        std::cerr << "Received " << next_r << " R and " << next_s << " S tuples" << (in_order ? "" : ", out of order") << "\n";
+    }
+    return ok;
+}
+
+// The window and the queue are given in tuples: the same limits hold fewer, larger batches
+bool test_window_in_tuples() {
+    SharedMemoryRings rings(2, 1 << 16);
+    SharedMemoryTransport transport(rings, 0);
+    batch_protocol::flow_control_options options;
+    batch_protocol::FlowControl per_tuple(transport, 0, 2, 1, options), default_batches(transport, 0, 2, batch_protocol::DEFAULT_BATCH_TUPLES, options),
+        odd(transport, 0, 2, 3000, options);
+    return per_tuple.window_batches() == batch_protocol::DEFAULT_WINDOW_TUPLES && default_batches.window_batches() == 32 &&
+           default_batches.max_queued_batches() == 64 && odd.window_batches() == 44; // 131072 / 3000, rounded up
+}
+
+int main() {
+    bool ok = test_spill() && test_window_in_tuples();
+    std::cout << (ok ? "All batch protocol tests passed." : "Batch protocol tests FAILED.") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#include <iostream>
+#include <cmath>
+#include <memory>
+#include "../../cpp/utils/benchmark.h"
+
+bool close(double a, double b) { return std::abs(a - b) < 1e-9; }
+
+// Percentiles interpolate between the closest ranks, independent of the order of the repetitions
+bool test_summary() {
+    auto s = benchmark::summary::of({5, 1, 4, 2, 3});
+    bool ok = s.repetitions == 5 && close(s.min, 1) && close(s.median, 3) && close(s.p90, 4.6) && close(s.p99, 4.96) && close(s.max, 5) && close(s.mean, 3);
+    auto single = benchmark::summary::of({7});
+    ok &= close(single.min, 7) && close(single.median, 7) && close(single.p99, 7);
+    return ok;
+}
+
+// Only the parameters a benchmark uses are swept
+bool test_grid() {
+    benchmark::sweep grid;
+    grid.n_servers = {2, 4, 8};
+    grid.r_tuples = {10, 20};
+    grid.s_tuples = {100};
+    grid.alpha = {0, 0.5, 1};
+    bool ok = grid.grid(benchmark::All).size() == 18;
+    ok &= grid.grid(benchmark::Sizes | benchmark::Alpha).size() == 6;
+    auto servers = grid.grid(benchmark::Servers);
+    ok &= servers.size() == 3 && servers[2].n_servers == 8 && servers[2].r_tuples == 10 && servers[2].alpha == 0;
+    return ok;
+}
+
+// Warmups are not measured, every repetition is
+bool test_run() {
+    benchmark::Registry registry;
+    int calls = 0;
+    registry.add("count", "", benchmark::Alpha, [&](const benchmark::parameters&) -> benchmark::body {
+        return [&calls]() {
+            calls++;
+            return uint64_t(42);
+        };
+    });
+    registry.add("other", "", benchmark::All, [](const benchmark::parameters&) -> benchmark::body { return []() { return uint64_t(0); }; });
+    benchmark::sweep grid;
+    grid.alpha = {0, 1};
+    grid.warmups = 2;
+    grid.repetitions = 3;
+    int results = 0;
+    auto selected = registry.matching("cou");
+    if (selected.size() != 1) {
+        return false;
+    }
+    benchmark::run(*selected[0], grid, [&](const benchmark::result& r) {
+        results += r.items == 42 && r.seconds.repetitions == 3;
+    });
+    return results == 2 && calls == 10;
+}
+
+// reset runs before every warmup and repetition, so a body that consumes its input always gets it fresh
+bool test_reset() {
+    benchmark::Registry registry;
+    int resets = 0;
+    bool fresh = true;
+    registry.add("consume", "", benchmark::Alpha, [&](const benchmark::parameters&) -> benchmark::body {
+        auto input = std::make_shared<bool>(true);
+        auto run = [&fresh, input]() {
+            fresh &= *input;
+            *input = false;
+            return uint64_t(1);
+        };
+        return {run, [&resets, input]() {
+                    resets++;
+                    *input = true;
+                }};
+    });
+    benchmark::sweep grid;
+    grid.alpha = {0};
+    grid.warmups = 1;
+    grid.repetitions = 4;
+    benchmark::run(*registry.matching("consume")[0], grid, [](const benchmark::result&) {});
+    return fresh && resets == 5;
+}
+
+int main() {
+    bool ok = test_summary() && test_grid() && test_run() && test_reset();
+    std::cout << (ok ? "All benchmark tests passed." : "Benchmark tests FAILED.") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <vector>
+#include "../../cpp/utils/radix_scatter.h"
+
+// Scatter n tuples from several senders to fanout destinations and compare with a plain per-tuple copy
+bool test_scatter(size_t n, int fanout, int n_senders) {
+    auto dest = [fanout](const joined_row& t) {
+        return t.join_val % 97 == 0 ? radix_scatter::BROADCAST : static_cast<int>(t.join_val % fanout);
+    };
+
+    std::vector<tuple_buffer> senders(n_senders);
+    std::vector<std::vector<size_t>> histograms(n_senders);
+    for (int i = 0; i < n_senders; ++i) {
+        for (uint32_t j = 0; j < n + i * 7; ++j) {
+            senders[i].push_back({j * 2654435761u, j, static_cast<uint32_t>(i)});
+        }
+        histograms[i] = radix_scatter::histogram(senders[i], senders[i].size(), fanout, dest);
+    }
+
+    std::vector<size_t> totals;
+    auto offsets = radix_scatter::prefix_offsets(histograms, totals);
+    std::vector<tuple_buffer> receive(fanout);
+    std::vector<std::vector<joined_row>> expected(fanout);
+    for (int d = 0; d < fanout; ++d) {
+        receive[d].resize(totals[d]);
+    }
+    for (int i = 0; i < n_senders; ++i) {
+        std::vector<joined_row*> out(fanout);
+        for (int d = 0; d < fanout; ++d) {
+            out[d] = receive[d].data() + offsets[i][d];
+        }
+        radix_scatter::scatter(senders[i], senders[i].size(), dest, out);
+        for (const auto& t : senders[i]) {
+            int d = dest(t);
+            for (int b = 0; b < fanout; ++b) {
+                if (d == radix_scatter::BROADCAST || d == b) {
+                    expected[b].push_back(t);
+                }
+            }
+        }
+    }
+
+    for (int d = 0; d < fanout; ++d) {
+        if (expected[d].size() != receive[d].size()) {
+            return false;
+        }
+        for (size_t j = 0; j < expected[d].size(); ++j) {
+            const auto& a = expected[d][j];
+            const auto& b = receive[d][j];
+            if (a.join_val != b.join_val || a.row_R != b.row_R || a.row_S != b.row_S) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Counting sort must group by destination, keep the input order within a group and report every destination
+bool test_counting_sort(size_t n, int fanout, int n_threads) {
+    tuple_buffer tuples;
+    for (uint32_t j = 0; j < n; ++j) {
+        tuples.push_back({j * 2654435761u, j, 0});
+    }
+    auto dest = [fanout](const joined_row& t) { return static_cast<int>(t.join_val % fanout); };
+    auto table = radix_scatter::counting_sort(tuples, tuples.size(), fanout, dest, n_threads);
+
+    if (table.size() != static_cast<size_t>(fanout) || tuples.size() != n) {
+        return false;
+    }
+    size_t expected_offset = 0;
+    for (const auto& [server_id, offset, count] : table) {
+        if (offset != expected_offset) {
+            return false;
+        }
+        for (size_t j = offset; j < offset + count; ++j) {
+            if (dest(tuples[j]) != static_cast<int>(server_id) - 1 || (j > offset && tuples[j].row_R <= tuples[j - 1].row_R)) {
+                return false;
+            }
+        }
+        expected_offset += count;
+    }
+    return expected_offset == n;
+}
+
+int main() {
+    bool ok = true;
+    for (size_t n : {0, 1, 15, 17, 1000, 1000003}) {
+        for (int fanout : {1, 2, 7, 64}) {
+            ok &= test_scatter(n, fanout, 3);
+            ok &= test_counting_sort(n, fanout, 1);
+            ok &= test_counting_sort(n, fanout, 8);
+        }
+    }
+
+    std::cout << (ok ? "All radix scatter tests passed." : "Radix scatter tests FAILED.") << std::endl;
+    return ok ? 0 : 1;
+}
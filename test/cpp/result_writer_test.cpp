@@ -0,0 +1,65 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include "../../cpp/utils/result_writer.h"
+
+// Write rows with every format/writer combination and read them back
+bool test_round_trip(ResultWriter::Format format, bool background, size_t buffer_bytes) {
+    std::vector<joined_row> rows;
+    for (uint32_t i = 0; i < 1000000; ++i) {
+        rows.push_back({i % 977, i * 7, UINT32_MAX - i});
+    }
+
+    std::string file_name = "result_writer_test.bin";
+    {
+        ResultWriter writer(file_name, format, background, buffer_bytes);
+        writer.write(rows.data(), rows.size() / 2);
+        for (size_t i = rows.size() / 2; i < rows.size(); ++i) {
+            writer.write(rows[i]);
+        }
+        writer.close();
+        std::cout << "format: " << format << ", background: " << background << ", bytes: " << writer.bytes_written() << std::endl;
+    }
+
+    auto read = read_results(file_name);
+    fs::remove(file_name);
+    if (read.size() != rows.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (read[i].join_val != rows[i].join_val || read[i].row_R != rows[i].row_R || read[i].row_S != rows[i].row_S) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Writing the header to /dev/full fails in the constructor, which closes the file again
+bool test_constructor_failure() {
+    auto open_files = [] { return std::distance(std::filesystem::directory_iterator("/proc/self/fd"), std::filesystem::directory_iterator()); };
+    auto before = open_files();
+    bool failed = false;
+    for (int i = 0; i < 10; ++i) {
+        try {
+            ResultWriter writer("/dev/full", ResultWriter::Raw, true);
+        } catch (const std::runtime_error&) {
+            failed = true;
+        }
+    }
+    return failed && open_files() == before;
+}
+
+int main() {
+    bool ok = true;
+    for (auto format : {ResultWriter::Raw, ResultWriter::Varint}) {
+        for (bool background : {false, true}) {
+            ok &= test_round_trip(format, background, ResultWriter::DEFAULT_BUFFER_BYTES);
+            ok &= test_round_trip(format, background, 1); // Smallest buffer, many flushes
+        }
+    }
+    ok &= test_constructor_failure();
+
+    std::cout << (ok ? "All result writer tests passed." : "Result writer tests FAILED.") << std::endl;
+    return ok ? 0 : 1;
+}
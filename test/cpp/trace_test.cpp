@@ -0,0 +1,51 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#define JOIN_TRACE
+#include "../../cpp/utils/trace.h"
+
+size_t count(const std::string& text, const std::string& pattern) {
+    size_t n = 0;
+    for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1)) {
+        n++;
+    }
+    return n;
+}
+
+// Spans of several threads end up in one trace; a full ring keeps the newest spans
+int main() {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; ++t) {
+        threads.emplace_back([t]() {
+            TRACE_THREAD_NAME("worker " + std::to_string(t));
+            TRACE_PHASES("first");
+            TRACE_NEXT_PHASE("second");
+            for (int i = 0; i < (t == 2 ? static_cast<int>(trace::EVENTS_PER_THREAD) + 10 : 5); ++i) {
+                TRACE_SCOPE("inner");
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::string file_name = "trace_test.json";
+    bool ok = trace::write_chrome_json(file_name);
+    std::ifstream file(file_name);
+    std::stringstream content;
+    content << file.rdbuf();
+    std::remove(file_name.c_str());
+    std::string json = content.str();
+
+    ok &= count(json, "\"ph\": \"M\"") == 3 && count(json, "worker 2") == 1;
+    ok &= count(json, "\"name\": \"first\"") == 2 && count(json, "\"name\": \"second\"") == 3; // Ring of worker 2 overwrote its first spans
+    ok &= count(json, "\"name\": \"inner\"") == 5 + 5 + trace::EVENTS_PER_THREAD - 1;
+    ok &= count(json, "12 spans overwritten") == 1;
+    ok &= json.rfind("]}") != std::string::npos;
+
+    std::cout << (ok ? "All trace tests passed." : "Trace tests FAILED.") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "../../cpp/utils/transport.h"
+
+// Frames of the tests: (sender, sequence number) as header, rows holding (sequence, sender, row index)
+struct test_header {
+    uint32_t sender;
+    uint32_t sequence;
+};
+
+std::vector<joined_row> make_rows(uint32_t sequence, uint32_t sender, size_t n) {
+    std::vector<joined_row> rows(n);
+    for (size_t i = 0; i < n; ++i) {
+        rows[i] = {sequence, sender, static_cast<uint32_t>(i)};
+    }
+    return rows;
+}
+
+bool check_frame(const Transport::frame& received, uint32_t sequence, uint32_t sender, size_t n) {
+    test_header header;
+    if (received.header_bytes != sizeof(header) || received.n_rows != n || (n == 0) != (received.rows == nullptr)) {
+        return false;
+    }
+    memcpy(&header, received.header, sizeof(header));
+    if (header.sender != sender || header.sequence != sequence) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (received.rows[i].join_val != sequence || received.rows[i].row_R != sender || received.rows[i].row_S != i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Records of almost half the ring do not fit behind each other, the sender leaves a wrap marker
+// and continues at the start of the ring; the receiver follows it
+bool test_wrap() {
+    SharedMemoryRings rings(2, 4096);
+    SharedMemoryTransport sender(rings, 0), receiver(rings, 1);
+    size_t max_rows = SharedMemoryRings::max_rows(sizeof(test_header), 4096);
+    uint64_t record_bytes = 0;
+    bool ok = true;
+    for (uint32_t sequence = 0; sequence < 20; ++sequence) {
+        size_t n = max_rows - sequence % 7;
+        auto rows = make_rows(sequence, 0, n);
+        test_header header = {0, sequence};
+        sender.send(1, &header, sizeof(header), rows.data(), n, nullptr, nullptr);
+        record_bytes += SharedMemoryRings::record_bytes(sizeof(header), n);
+        Transport::frame received;
+        ok &= receiver.receive(received, std::chrono::milliseconds(100)) && check_frame(received, sequence, 0, n);
+        receiver.finish_receiving(); // Frees the record, the next one may need its space
+    }
+    // The skipped rest of the ring counts as written: records have wrapped
+    ok &= rings.control(0, 1).head.load() > record_bytes;
+    ok &= rings.control(0, 1).tail.load() == rings.control(0, 1).head.load();
+    return ok;
+}
+
+// A frame without tuples carries only its header
+bool test_empty_frame() {
+    SharedMemoryRings rings(2, 4096);
+    SharedMemoryTransport sender(rings, 0), receiver(rings, 1);
+    test_header header = {0, 7};
+    sender.send(1, &header, sizeof(header), nullptr, 0, nullptr, nullptr);
+    Transport::frame received;
+    bool ok = receiver.receive(received, std::chrono::milliseconds(100)) && check_frame(received, 7, 0, 0);
+    ok &= !receiver.receive(received, std::chrono::milliseconds(1));
+    return ok;
+}
+
+// A record may take at most half of the ring, max_rows is the largest frame that is accepted
+bool test_oversize() {
+    SharedMemoryRings rings(2, 4096);
+    SharedMemoryTransport sender(rings, 0), receiver(rings, 1);
+    size_t max_rows = SharedMemoryRings::max_rows(sizeof(test_header), 4096);
+    auto rows = make_rows(0, 0, max_rows + 1);
+    test_header header = {0, 0};
+    bool ok = false;
+    try {
+        sender.send(1, &header, sizeof(header), rows.data(), max_rows + 1, nullptr, nullptr);
+    } catch (const std::runtime_error&) {
+        ok = true;
+    }
+    sender.send(1, &header, sizeof(header), rows.data(), max_rows, nullptr, nullptr);
+    Transport::frame received;
+    ok &= receiver.receive(received, std::chrono::milliseconds(100)) && check_frame(received, 0, 0, max_rows);
+    return ok;
+}
+
+// Two senders fill the small rings of one receiver from their own threads, so senders wait for
+// space and the receiver for frames. Every sender's frames arrive complete and in order.
+bool test_threads() {
+    const int n_senders = 2;
+    const uint32_t n_frames = 20000;
+    SharedMemoryRings rings(n_senders + 1, 4096);
+    std::vector<std::unique_ptr<SharedMemoryTransport>> transports;
+    for (int id = 0; id <= n_senders; ++id) {
+        transports.push_back(std::make_unique<SharedMemoryTransport>(rings, id));
+    }
+    std::atomic<size_t> released{0};
+    auto count_release = [](void*, void* hint) { static_cast<std::atomic<size_t>*>(hint)->fetch_add(1); };
+
+    std::vector<std::thread> senders;
+    uint64_t expected_checksum = 0;
+    for (int id = 0; id < n_senders; ++id) {
+        for (uint32_t sequence = 0; sequence < n_frames; ++sequence) {
+            for (uint32_t i = 0; i < sequence % 61; ++i) {
+                expected_checksum += sequence + i;
+            }
+        }
+        senders.emplace_back([&, id]() {
+            for (uint32_t sequence = 0; sequence < n_frames; ++sequence) {
+                auto rows = make_rows(sequence, id, sequence % 61);
+                test_header header = {static_cast<uint32_t>(id), sequence};
+                transports[id]->send(n_senders, &header, sizeof(header), rows.empty() ? nullptr : rows.data(), rows.size(), count_release, &released);
+            }
+        });
+    }
+
+    bool ok = true;
+    uint64_t checksum = 0;
+    std::vector<uint32_t> next(n_senders, 0);
+    auto& receiver = *transports[n_senders];
+    for (uint32_t frames = 0; frames < n_senders * n_frames && ok; ++frames) {
+        Transport::frame received;
+        if (!receiver.receive(received, std::chrono::seconds(10))) {
+            std::cerr << "Timeout after " << frames << " frames\n";
+            ok = false;
+            break;
+        }
+        test_header header;
+        memcpy(&header, received.header, sizeof(header));
+        uint32_t sender = header.sender;
+        ok &= sender < static_cast<uint32_t>(n_senders) && check_frame(received, next[sender], sender, next[sender] % 61);
+        for (size_t i = 0; i < received.n_rows; ++i) {
+            checksum += received.rows[i].join_val + received.rows[i].row_S;
+        }
+        next[sender]++;
+    }
+    receiver.finish_receiving();
+    for (auto& t : senders) {
+        t.join();
+    }
+    ok &= checksum == expected_checksum && next[0] == n_frames && next[1] == n_frames;
+    ok &= released == n_senders * (n_frames - (n_frames + 60) / 61); // Frames with rows only
+    if (!ok) {
+        std::cerr << "Checksum " << checksum << ", expected " << expected_checksum << "; frames " << next[0] << ", " << next[1] << "\n";
+    }
+    return ok;
+}
+
+int main() {
+    bool ok = test_wrap() && test_empty_frame() && test_oversize() && test_threads();
+    std::cout << (ok ? "All transport tests passed." : "Transport tests FAILED.") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include "../../cpp/utils/zipf_generator.h"
+
+// Compare sampled frequencies of the first ranks against p(i) = C/i^alpha
+bool test_zipf_frequencies(double alpha, uint64_t n) {
+    const uint64_t num_samples = 1000000;
+    ZipfGenerator zipf(1, alpha, n);
+
+    std::vector<uint64_t> counts(n + 1, 0);
+    for (uint64_t i = 0; i < num_samples; ++i) {
+        uint32_t value = zipf(i);
+        if (value < 1 || value > n) {
+            std::cout << "Value out of range: " << value << std::endl;
+            return false;
+        }
+        counts[value]++;
+    }
+
+    double c = 0;
+    for (uint64_t i = 1; i <= n; ++i) {
+        c += 1.0 / std::pow(static_cast<double>(i), alpha);
+    }
+
+    bool ok = true;
+    for (uint64_t i = 1; i <= 5; ++i) {
+        double expected = 1.0 / (c * std::pow(static_cast<double>(i), alpha));
+        double observed = static_cast<double>(counts[i]) / num_samples;
+        std::cout << "alpha: " << alpha << ", rank: " << i << ", expected: " << expected << ", observed: " << observed << std::endl;
+        if (std::abs(expected - observed) > 0.005) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// The stream must only depend on the seed, so restarting at any index gives the same values
+bool test_zipf_random_access() {
+    ZipfGenerator zipf_a(42, 1.25, 1000);
+    ZipfGenerator zipf_b(42, 1.25, 1000);
+    for (uint64_t i = 1000; i > 0; --i) {
+        if (zipf_a(i - 1) != zipf_b(i - 1)) {
+            return false;
+        }
+    }
+    ZipfGenerator zipf_c(43, 1.25, 1000);
+    int equal = 0;
+    for (uint64_t i = 0; i < 1000; ++i) {
+        equal += zipf_a(i) == zipf_c(i);
+    }
+    return equal < 1000;
+}
+
+int main() {
+    bool ok = test_zipf_frequencies(0.0, 16);
+    ok &= test_zipf_frequencies(1.0, 1000);
+    ok &= test_zipf_frequencies(1.25, 100000);
+    ok &= test_zipf_random_access();
+
+    std::cout << (ok ? "All Zipf generator tests passed." : "Zipf generator tests FAILED.") << std::endl;
+    return ok ? 0 : 1;
+}